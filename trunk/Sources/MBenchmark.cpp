@@ -0,0 +1,583 @@
+//          Copyright Maarten L. Hekkelman 2006-2008
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "MJapi.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <unistd.h>
+
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include "MBenchmark.h"
+#include "MTextBuffer.h"
+#include "MSelection.h"
+#include "MLanguage.h"
+#include "MDiff.h"
+#include "MTrace.h"
+#include "MError.h"
+
+using namespace std;
+
+namespace
+{
+
+const uint32
+	kRuns = 7,
+	kCorpusSize = 4 * 1024 * 1024;
+
+// ---------------------------------------------------------------------------
+//	samples the corpora are built from
+
+const char kCppSample[] =
+	"// count the elements equal to x\n"
+	"#include <vector>\n"
+	"\n"
+	"/* a block comment\n"
+	"   spanning two lines */\n"
+	"template<class T>\n"
+	"int count(const std::vector<T>& v, const T& x)\n"
+	"{\n"
+	"\tint n = 0;\t// running total\n"
+	"\tfor (typename std::vector<T>::const_iterator i = v.begin(); i != v.end(); ++i)\n"
+	"\t{\n"
+	"\t\tif (*i == x)\n"
+	"\t\t\t++n;\n"
+	"\t}\n"
+	"\tconst char* s = \"a string with \\\"quotes\\\" in it\";\n"
+	"\treturn n + sizeof(s) + 'c';\n"
+	"}\n"
+	"\n";
+
+const char kPerlSample[] =
+	"# count the words in a file\n"
+	"use strict;\n"
+	"my %count;\n"
+	"while (my $line = <STDIN>) {\n"
+	"\tforeach my $w (split(m/\\s+/, $line)) {\n"
+	"\t\t$count{lc $w}++ if $w =~ m/^[a-z]+$/i;\n"
+	"\t}\n"
+	"}\n"
+	"print \"$_: $count{$_}\\n\" foreach sort keys %count;\n"
+	"\n";
+
+const char kPythonSample[] =
+	"# count the words in a file\n"
+	"import sys\n"
+	"\n"
+	"def count(lines):\n"
+	"    \"\"\"return a dict with the number of times each word occurs\"\"\"\n"
+	"    result = {}\n"
+	"    for line in lines:\n"
+	"        for w in line.split():\n"
+	"            result[w.lower()] = result.get(w.lower(), 0) + 1\n"
+	"    return result\n"
+	"\n"
+	"print(count(sys.stdin), 'done')\n"
+	"\n";
+
+const char kPascalSample[] =
+	"{ count the elements equal to x }\n"
+	"function Count(const v: array of Integer; x: Integer): Integer;\n"
+	"var\n"
+	"  i, n: Integer;\n"
+	"begin\n"
+	"  n := 0; (* running total *)\n"
+	"  for i := Low(v) to High(v) do\n"
+	"    if v[i] = x then\n"
+	"      Inc(n);\n"
+	"  WriteLn('counted ', n);\n"
+	"  Count := n;\n"
+	"end;\n"
+	"\n";
+
+const char kHTMLSample[] =
+	"<!-- a table with some rows -->\n"
+	"<table class=\"list\" border=\"0\">\n"
+	"  <tr><th>Name</th><th>Count</th></tr>\n"
+	"  <tr><td><a href=\"item.html?id=1&amp;x=2\">first</a></td><td>1</td></tr>\n"
+	"  <tr><td><b>second</b></td><td>2</td></tr>\n"
+	"</table>\n"
+	"<script type=\"text/javascript\">var n = 1;</script>\n"
+	"\n";
+
+const char kTeXSample[] =
+	"% count the elements\n"
+	"\\section{Counting}\n"
+	"\\label{sec:count}\n"
+	"The number of elements $n = \\sum_{i=1}^{k} x_i$ is given in\n"
+	"table~\\ref{tab:count}, see also \\cite{knuth84}.\n"
+	"\\begin{itemize}\n"
+	"  \\item first {\\em emphasized} item\n"
+	"  \\item second item\n"
+	"\\end{itemize}\n"
+	"\n";
+
+const char kXMLSample[] =
+	"<!-- a list of items -->\n"
+	"<items xmlns:x=\"http://www.example.com/x\">\n"
+	"  <item id=\"1\" x:kind=\"first\">first &amp; foremost</item>\n"
+	"  <item id=\"2\"><![CDATA[ <raw> text ]]></item>\n"
+	"  <?process instruction?>\n"
+	"</items>\n"
+	"\n";
+
+struct MSample
+{
+	const char*		language;
+	const char*		text;
+};
+
+const MSample kSamples[] =
+{
+	{ "C++",	kCppSample },
+	{ "Perl",	kPerlSample },
+	{ "Python",	kPythonSample },
+	{ "Pascal",	kPascalSample },
+	{ "HTML",	kHTMLSample },
+	{ "TeX",	kTeXSample },
+	{ "XML",	kXMLSample }
+};
+
+// ---------------------------------------------------------------------------
+//	A simple generator, the same on every platform and with every library
+
+class MRandom
+{
+  public:
+					MRandom(uint32 inSeed) : mState(inSeed) {}
+
+	uint32			Next(
+						uint32		inMax)
+					{
+						mState = mState * 1103515245 + 12345;
+						return (mState >> 8) % inMax;
+					}
+
+  private:
+	uint32			mState;
+};
+
+string MakeCorpus(
+	const char*		inSample,
+	uint32			inSize)
+{
+	string result;
+	result.reserve(inSize + strlen(inSample));
+
+	while (result.length() < inSize)
+		result += inSample;
+
+	return result;
+}
+
+// ---------------------------------------------------------------------------
+//	MBenchmark, Setup is not timed, Run is
+
+class MBenchmark
+{
+  public:
+					MBenchmark(
+						const string&	inName,
+						uint32			inBytes)
+						: mName(inName)
+						, mBytes(inBytes) {}
+
+	virtual			~MBenchmark() {}
+
+	virtual void	Setup() {}
+
+	virtual void	Run() = 0;
+
+	const string&	GetName() const			{ return mName; }
+
+	uint32			GetBytes() const		{ return mBytes; }
+
+  private:
+	string			mName;
+	uint32			mBytes;
+};
+
+// ---------------------------------------------------------------------------
+//	Editing in the gap buffer, the edits are recorded for undo as usual
+
+class MEditBenchmark : public MBenchmark
+{
+  public:
+	enum MEditKind
+	{
+		eTyping,			// insert characters one after the other
+		eBackspace,			// delete characters one before the other
+		eScattered			// insert and delete all over the text
+	};
+
+					MEditBenchmark(
+						const string&	inName,
+						MEditKind		inKind)
+						: MBenchmark(inName, 0)
+						, mKind(inKind) {}
+
+	virtual void	Setup();
+
+	virtual void	Run();
+
+  private:
+	MEditKind		mKind;
+	unique_ptr<MTextBuffer>
+					mText;
+};
+
+void MEditBenchmark::Setup()
+{
+	mText.reset(new MTextBuffer(MakeCorpus(kCppSample, kCorpusSize)));
+}
+
+void MEditBenchmark::Run()
+{
+	const uint32 kEdits = 100000;
+
+	MRandom random(1);
+	uint32 offset = mText->GetSize() / 2;
+
+	mText->StartAction("Typing", MSelection(nil, offset, offset));
+
+	for (uint32 i = 0; i < kEdits; ++i)
+	{
+		switch (mKind)
+		{
+			case eTyping:
+				mText->Insert(offset, "x", 1);
+				++offset;
+				break;
+
+			case eBackspace:
+				--offset;
+				mText->Delete(offset, 1);
+				break;
+
+			case eScattered:
+				offset = random.Next(mText->GetSize() - 16);
+				if (i % 2)
+					mText->Insert(offset, "scattered", 9);
+				else
+					mText->Delete(offset, 9);
+				break;
+		}
+	}
+
+	mText->ActionFinished();
+}
+
+// ---------------------------------------------------------------------------
+//	MTextBuffer::Find over the whole text, the pattern is not in it
+
+class MFindBenchmark : public MBenchmark
+{
+  public:
+					MFindBenchmark(
+						const string&	inName,
+						const string&	inWhat,
+						bool			inIgnoreCase,
+						bool			inRegex)
+						: MBenchmark(inName, kCorpusSize)
+						, mText(MakeCorpus(kCppSample, kCorpusSize))
+						, mWhat(inWhat)
+						, mIgnoreCase(inIgnoreCase)
+						, mRegex(inRegex) {}
+
+	virtual void	Run();
+
+  private:
+	MTextBuffer		mText;
+	string			mWhat;
+	bool			mIgnoreCase, mRegex;
+};
+
+void MFindBenchmark::Run()
+{
+	MSelection found(nil);
+	if (mText.Find(0, mWhat, kDirectionForward, mIgnoreCase, mRegex, found))
+		THROW(("benchmark pattern %s should not be found", mWhat.c_str()));
+}
+
+// ---------------------------------------------------------------------------
+//	MDiff on two lists of line hashes, the second has some lines changed,
+//	inserted and deleted.
+
+class MDiffBenchmark : public MBenchmark
+{
+  public:
+					MDiffBenchmark();
+
+	virtual void	Run();
+
+  private:
+	vector<uint32>	mA, mB;
+};
+
+MDiffBenchmark::MDiffBenchmark()
+	: MBenchmark("diff: 50000 lines, 0.5% changed", 0)
+{
+	const uint32 kLines = 50000;
+
+	MRandom random(2);
+
+	for (uint32 i = 0; i < kLines; ++i)
+		mA.push_back(random.Next(kLines / 4));
+
+	for (uint32 i = 0; i < kLines; ++i)
+	{
+		switch (random.Next(600))
+		{
+			case 0:	mB.push_back(kLines + i);					break;	// changed
+			case 1:	mB.push_back(kLines + i); mB.push_back(mA[i]);	break;	// inserted
+			case 2:													break;	// deleted
+			default: mB.push_back(mA[i]);							break;
+		}
+	}
+}
+
+void MDiffBenchmark::Run()
+{
+	MDiff diff(mA, mB);
+
+	MDiffScript script;
+	diff.Report(script);
+}
+
+// ---------------------------------------------------------------------------
+//	MLanguage::StyleLine for each line, collecting the style runs like
+//	drawing a line does.
+
+class MStyleBenchmark : public MBenchmark
+{
+  public:
+					MStyleBenchmark(
+						const MSample&	inSample);
+
+	virtual void	Run();
+
+  private:
+	MLanguage*		mLanguage;
+	MTextBuffer		mText;
+	vector<uint32>	mStarts;
+};
+
+MStyleBenchmark::MStyleBenchmark(
+	const MSample&	inSample)
+	: MBenchmark(string("style: ") + inSample.language, kCorpusSize)
+	, mLanguage(MLanguage::GetLanguage(inSample.language))
+	, mText(MakeCorpus(inSample.text, kCorpusSize))
+{
+	THROW_IF_NIL(mLanguage);
+
+	string text = mText.GetText();
+
+	mStarts.push_back(0);
+	for (string::size_type nl = text.find('\n'); nl != string::npos; nl = text.find('\n', nl + 1))
+		mStarts.push_back(nl + 1);
+}
+
+void MStyleBenchmark::Run()
+{
+	uint32 styles[kMaxStyles], offsets[kMaxStyles];
+	uint16 state = 0;
+
+	for (uint32 line = 0; line + 1 < mStarts.size(); ++line)
+	{
+		mLanguage->StyleLine(mText, mStarts[line],
+			mStarts[line + 1] - mStarts[line], state, styles, offsets);
+	}
+}
+
+// ---------------------------------------------------------------------------
+//	Reading a file that is in memory already, this guesses the encoding,
+//	converts the line ends and collects the line starts.
+
+class MReadBenchmark : public MBenchmark
+{
+  public:
+					MReadBenchmark(
+						const string&	inName,
+						const string&	inData)
+						: MBenchmark(inName, inData.length())
+						, mData(inData) {}
+
+	virtual void	Run();
+
+  private:
+	string			mData;
+};
+
+void MReadBenchmark::Run()
+{
+	char* data = new char[mData.length()];
+	memcpy(data, mData.c_str(), mData.length());
+
+	MTextBuffer text;
+	vector<uint32> lineStarts;
+	text.ReadFromData(data, mData.length(), &lineStarts);
+}
+
+string MakeReadData(
+	const char*		inReplace,
+	const char*		inWith)
+{
+	string data = MakeCorpus(kCppSample, kCorpusSize);
+
+	if (inReplace != nil)
+	{
+		string result;
+		result.reserve(data.length() * 2);
+
+		for (string::iterator ch = data.begin(); ch != data.end(); ++ch)
+		{
+			if (*ch == *inReplace)
+				result += inWith;
+			else
+				result += *ch;
+		}
+
+		swap(data, result);
+	}
+
+	return data;
+}
+
+// ---------------------------------------------------------------------------
+
+void Report(
+	ostream&			inOut,
+	const MBenchmark&	inBenchmark,
+	vector<uint64>&		inTimes)
+{
+	sort(inTimes.begin(), inTimes.end());
+
+	double best = inTimes.front() / 1000.0;
+	double median = inTimes[inTimes.size() / 2] / 1000.0;
+
+	char line[256];
+
+	if (inBenchmark.GetBytes() > 0 and median > 0)
+	{
+		snprintf(line, sizeof(line), "%-36s %10.2f %10.2f %10.1f",
+			inBenchmark.GetName().c_str(), best, median,
+			inBenchmark.GetBytes() / (median * 1024 * 1024 / 1000));
+	}
+	else
+	{
+		snprintf(line, sizeof(line), "%-36s %10.2f %10.2f %10s",
+			inBenchmark.GetName().c_str(), best, median, "-");
+	}
+
+	inOut << line << endl;
+}
+
+}
+
+// ---------------------------------------------------------------------------
+//	RunBenchmarks
+
+void RunBenchmarks(
+	ostream&			inOut,
+	const string&		inFilter)
+{
+	boost::ptr_vector<MBenchmark> benchmarks;
+
+	benchmarks.push_back(new MEditBenchmark("buffer: typing", MEditBenchmark::eTyping));
+	benchmarks.push_back(new MEditBenchmark("buffer: backspace", MEditBenchmark::eBackspace));
+	benchmarks.push_back(new MEditBenchmark("buffer: scattered edits", MEditBenchmark::eScattered));
+
+	benchmarks.push_back(new MFindBenchmark("find: literal", "not-in-the-text", false, false));
+	benchmarks.push_back(new MFindBenchmark("find: literal, ignore case", "Not-In-The-Text", true, false));
+	benchmarks.push_back(new MFindBenchmark("find: regex", "n[aeiou]t-in-(the|a)-text", false, true));
+
+	benchmarks.push_back(new MDiffBenchmark);
+
+	for (const MSample* sample = kSamples; sample != kSamples + sizeof(kSamples) / sizeof(MSample); ++sample)
+		benchmarks.push_back(new MStyleBenchmark(*sample));
+
+	benchmarks.push_back(new MReadBenchmark("read: ascii", MakeReadData(nil, nil)));
+	benchmarks.push_back(new MReadBenchmark("read: utf-8", MakeReadData("x", "\xc3\xab")));
+	benchmarks.push_back(new MReadBenchmark("read: latin-1", MakeReadData("x", "\xeb")));
+	benchmarks.push_back(new MReadBenchmark("read: dos line ends", MakeReadData("\n", "\r\n")));
+
+	char header[256];
+	snprintf(header, sizeof(header), "%-36s %10s %10s %10s",
+		"benchmark", "best ms", "median ms", "MB/s");
+	inOut << header << endl;
+
+	for (boost::ptr_vector<MBenchmark>::iterator b = benchmarks.begin(); b != benchmarks.end(); ++b)
+	{
+		if (b->GetName().find(inFilter) == string::npos)
+			continue;
+
+		vector<uint64> times;
+
+		for (uint32 run = 0; run < kRuns; ++run)
+		{
+			b->Setup();
+
+			uint64 start = MTrace::Now();
+			b->Run();
+			times.push_back(MTrace::Now() - start);
+		}
+
+		Report(inOut, *b, times);
+	}
+}
+
+#if defined(JAPI_HEADLESS)
+
+// ---------------------------------------------------------------------------
+//	main
+//
+//	The japi-bench tool in the makefile links this against the text engine
+//	library only, so the benchmarks can run where there is no display.
+//	Usage: japi-bench [-T tracefile] [filter]
+
+int main(int argc, char* argv[])
+{
+	int result = 0;
+	
+	try
+	{
+		string trace;
+		
+		int c;
+		while ((c = getopt(argc, argv, "T:")) != -1)
+		{
+			switch (c)
+			{
+				case 'T':
+					trace = optarg;
+					break;
+
+				default:
+					cerr << "usage: " << argv[0] << " [-T tracefile] [filter]" << endl;
+					exit(1);
+			}
+		}
+		
+		if (not trace.empty())
+			MTrace::Start(trace);
+		
+		RunBenchmarks(cout, optind < argc ? argv[optind] : "");
+		MTrace::Stop();
+	}
+	catch (exception& e)
+	{
+		cerr << e.what() << endl;
+		result = 1;
+	}
+	
+	return result;
+}
+
+#endif
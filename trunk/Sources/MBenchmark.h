@@ -0,0 +1,28 @@
+//          Copyright Maarten L. Hekkelman 2006-2008
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+/*
+	Benchmarks for the core of the editor: editing in the gap buffer,
+	searching, diffing, styling and reading files. Run them with
+	japi -b [filter], only the benchmarks whose name contains filter
+	are run. The input is generated with a fixed seed, each benchmark
+	is run a number of times and the fastest and median time are
+	reported so the numbers can be compared between versions.
+
+	The same benchmarks are built without GTK as japi-bench, see the
+	makefile, for machines that have no display.
+*/
+
+#ifndef MBENCHMARK_H
+#define MBENCHMARK_H
+
+#include <iosfwd>
+#include <string>
+
+void RunBenchmarks(
+	std::ostream&		inOut,
+	const std::string&	inFilter);
+
+#endif
@@ -36,6 +36,7 @@ MColor::MColor(
 	blue = inOther.blue;
 }
 
+#if not defined(JAPI_HEADLESS)
 MColor::MColor(
 	const GdkColor&	inOther)
 {
@@ -43,6 +44,7 @@ MColor::MColor(
 	green = inOther.green >> 8;
 	blue = inOther.blue >> 8;
 }
+#endif
 
 MColor::MColor(
 	const char*		inHex)
@@ -69,6 +71,7 @@ MColor& MColor::operator=(
 	return *this;
 }
 
+#if not defined(JAPI_HEADLESS)
 MColor::operator GdkColor() const
 {
 	GdkColor result = {};
@@ -77,6 +80,7 @@ MColor::operator GdkColor() const
 	result.blue = blue << 8 | blue;
 	return result;
 }
+#endif
 
 string MColor::hex() const
 {
@@ -21,8 +21,10 @@ struct MColor
 				MColor(
 					const MColor&		inOther);
 
+#if not defined(JAPI_HEADLESS)
 				MColor(
 					const GdkColor&		inColor);
+#endif
 
 				MColor(
 					const char*			inHex);
@@ -35,7 +37,9 @@ struct MColor
 	MColor&		operator=(
 					const MColor&		inOther);
 
+#if not defined(JAPI_HEADLESS)
 				operator GdkColor() const;
+#endif
 
 	std::string	hex() const;
 	void		hex(
@@ -71,6 +71,7 @@ const uint32
 	cmd_CompleteLookingBack =	'ComB',
 	cmd_CompleteLookingFwd =	'ComF',
 	cmd_OpenIncludeFile =		'OInc',
+	cmd_FindSymbol =			'FSym',
 	cmd_GoToLine =				'GoTo',
 	cmd_SwitchHeaderSource =	'SHdS',
 	cmd_Softwrap = 				'SftW',
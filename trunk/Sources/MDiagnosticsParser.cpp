@@ -0,0 +1,326 @@
+//          Copyright Maarten L. Hekkelman 2006-2008
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "MJapi.h"
+
+#include <cstring>
+
+#include "MDiagnosticsParser.h"
+
+using namespace std;
+
+namespace
+{
+
+// read a decimal number at ioPos, returns false if there's none
+bool ReadNumber(
+	const string&		inText,
+	string::size_type&	ioPos,
+	uint32&				outNumber)
+{
+	string::size_type pos = ioPos;
+	uint32 number = 0;
+
+	while (pos < inText.length() and isdigit(inText[pos]))
+		number = number * 10 + (inText[pos++] - '0');
+
+	bool result = false;
+	if (pos > ioPos)
+	{
+		ioPos = pos;
+		outNumber = number;
+		result = true;
+	}
+
+	return result;
+}
+
+// read a number followed by a colon, as in the 'line:' of 'file:line: message'
+bool ReadNumberAndColon(
+	const string&		inText,
+	string::size_type&	ioPos,
+	uint32&				outNumber)
+{
+	string::size_type pos = ioPos;
+	uint32 number;
+
+	bool result = false;
+	if (ReadNumber(inText, pos, number) and pos < inText.length() and inText[pos] == ':')
+	{
+		ioPos = pos + 1;
+		outNumber = number;
+		result = true;
+	}
+
+	return result;
+}
+
+struct MKindName
+{
+	const char*		name;
+	uint32			length;
+	MMessageKind	kind;
+} kKindNames[] = {
+	{ " error:",		7, kMsgKindError },
+	{ " warning:",		9, kMsgKindWarning },
+	{ " note:",			6, kMsgKindNote },
+	{ " fatal error:",	13, kMsgKindError },
+	{ " fout:",			6, kMsgKindError },
+};
+
+const char
+	kInFileIncludedFrom[] = "In file included from ",
+	kFrom[] = "from ";
+
+}
+
+// ---------------------------------------------------------------------------
+//	MDiagnosticsParser
+
+MDiagnosticsParser::MDiagnosticsParser()
+	: mBaseDirectory("/")
+	, mBufferStart(0)
+	, mScanned(0)
+	, mLastWasInFileIncluded(false)
+{
+}
+
+void MDiagnosticsParser::SetBaseDirectory(
+	const fs::path&		inDir)
+{
+	if (mBaseDirectory != inDir)
+	{
+		mBaseDirectory = inDir;
+		mPathCache.clear();
+	}
+}
+
+void MDiagnosticsParser::Reset()
+{
+	mBuffer.clear();
+	mBufferStart = 0;
+	mScanned = 0;
+	mPathCache.clear();
+	mLastWasInFileIncluded = false;
+}
+
+// ---------------------------------------------------------------------------
+//	Feed
+//
+//	Lines are parsed in place. The consumed part of the buffer is only
+//	removed once it takes up half of the buffer, which keeps the cost of
+//	moving data linear in the size of the output.
+
+void MDiagnosticsParser::Feed(
+	const char*			inText,
+	uint32				inSize,
+	MDiagnosticList&	outDiagnostics)
+{
+	if (mBufferStart > 0 and mBufferStart >= mBuffer.size() / 2)
+	{
+		mBuffer.erase(mBuffer.begin(), mBuffer.begin() + mBufferStart);
+		mBufferStart = 0;
+	}
+
+	mBuffer.insert(mBuffer.end(), inText, inText + inSize);
+
+	for (;;)
+	{
+		const char* start = &mBuffer[0] + mBufferStart;
+		uint32 size = mBuffer.size() - mBufferStart;
+
+		const char* eol = static_cast<const char*>(
+			memchr(start + mScanned, '\n', size - mScanned));
+
+		if (eol == nil)
+		{
+			mScanned = size;
+			break;
+		}
+
+		ParseLine(start, eol - start, outDiagnostics);
+
+		mBufferStart += eol - start + 1;
+		mScanned = 0;
+	}
+}
+
+void MDiagnosticsParser::Flush(
+	MDiagnosticList&	outDiagnostics)
+{
+	if (mBufferStart < mBuffer.size())
+		ParseLine(&mBuffer[0] + mBufferStart, mBuffer.size() - mBufferStart, outDiagnostics);
+
+	mBuffer.clear();
+	mBufferStart = 0;
+	mScanned = 0;
+}
+
+void MDiagnosticsParser::ParseLine(
+	const char*			inLine,
+	uint32				inLength,
+	MDiagnosticList&	outDiagnostics)
+{
+	if (inLength > 0 and inLine[inLength - 1] == '\r')
+		--inLength;
+
+	string line(inLine, inLength);
+
+	MDiagnostic diagnostic = { kMsgKindNone, fs::path(), 0 };
+
+	if (ParseMessage(line, diagnostic))
+		mLastWasInFileIncluded = false;
+	else if (not ParseIncludedFrom(line, diagnostic))
+	{
+		mLastWasInFileIncluded = true;
+		diagnostic.message = line;
+	}
+
+	outDiagnostics.push_back(diagnostic);
+}
+
+// ---------------------------------------------------------------------------
+//	ParseMessage
+//
+//	Recognizes 'file:[line:[column:]][ kind:] message'
+
+bool MDiagnosticsParser::ParseMessage(
+	const string&		inLine,
+	MDiagnostic&		outDiagnostic)
+{
+	string::size_type colon = inLine.find(':');
+	if (colon == string::npos or colon == 0 or colon + 1 == inLine.length())
+		return false;
+
+	fs::path file;
+	if (not ResolvePath(inLine.substr(0, colon), file))
+		return false;
+
+	string::size_type pos = colon + 1;
+	uint32 column;
+
+	if (ReadNumberAndColon(inLine, pos, outDiagnostic.line))
+		(void)ReadNumberAndColon(inLine, pos, column);
+
+	for (const MKindName* k = kKindNames; k < kKindNames + sizeof(kKindNames) / sizeof(MKindName); ++k)
+	{
+		if (inLine.compare(pos, k->length, k->name) == 0)
+		{
+			outDiagnostic.kind = k->kind;
+			break;
+		}
+	}
+
+	outDiagnostic.file = file;
+	outDiagnostic.message = file.leaf() + inLine.substr(colon);
+
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+//	ParseIncludedFrom
+//
+//	Recognizes 'In file included from file:line[:column][,:]' and the
+//	indented 'from file:line[:column][,:]' lines following it.
+
+bool MDiagnosticsParser::ParseIncludedFrom(
+	const string&		inLine,
+	MDiagnostic&		outDiagnostic)
+{
+	string::size_type pos = 0;
+
+	if (inLine.compare(0, sizeof(kInFileIncludedFrom) - 1, kInFileIncludedFrom) == 0)
+		pos = sizeof(kInFileIncludedFrom) - 1;
+	else if (mLastWasInFileIncluded and not inLine.empty() and isspace(inLine[0]))
+	{
+		while (pos < inLine.length() and isspace(inLine[pos]))
+			++pos;
+
+		if (inLine.compare(pos, sizeof(kFrom) - 1, kFrom) != 0)
+			return false;
+
+		pos += sizeof(kFrom) - 1;
+	}
+	else
+		return false;
+
+	string::size_type end = inLine.length();
+	if (end <= pos or (inLine[end - 1] != ',' and inLine[end - 1] != ':'))
+		return false;
+	--end;
+
+	// strip off the trailing numbers, the last one
+	// is the column if there are two of them
+	string::size_type numbers[2];
+	uint32 count = 0;
+
+	while (count < 2)
+	{
+		string::size_type digit = end;
+		while (digit > pos and isdigit(inLine[digit - 1]))
+			--digit;
+
+		if (digit == end or digit <= pos + 1 or inLine[digit - 1] != ':')
+			break;
+
+		numbers[count++] = digit;
+		end = digit - 1;
+	}
+
+	if (count == 0)
+		return false;
+
+	mLastWasInFileIncluded = true;
+
+	fs::path file;
+	if (not ResolvePath(inLine.substr(pos, end - pos), file))
+		return false;
+
+	string::size_type lineNr = numbers[count - 1];
+	(void)ReadNumber(inLine, lineNr, outDiagnostic.line);
+
+	outDiagnostic.file = file;
+	outDiagnostic.message = inLine;
+
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+//	ResolvePath
+//
+//	Error storms mention the same few files over and over again, remember
+//	what we found, including the names that are not files at all.
+
+bool MDiagnosticsParser::ResolvePath(
+	const string&		inFile,
+	fs::path&			outPath)
+{
+	MPathCache::iterator p = mPathCache.find(inFile);
+
+	if (p == mPathCache.end())
+	{
+		fs::path spec;
+
+		if (IsAbsolutePath(inFile))
+			spec = inFile;
+		else
+			spec = mBaseDirectory / inFile;
+
+		try
+		{
+			if (not fs::exists(spec))
+				spec = fs::path();
+		}
+		catch (...)
+		{
+			spec = fs::path();
+		}
+
+		p = mPathCache.insert(make_pair(inFile, spec)).first;
+	}
+
+	outPath = p->second;
+	return not outPath.empty();
+}
@@ -0,0 +1,91 @@
+//          Copyright Maarten L. Hekkelman 2006-2008
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+/*
+	MDiagnosticsParser turns the output of gcc and clang into messages.
+
+	Output is fed in as it arrives, in chunks of any size. Complete lines
+	are taken from a line buffer and matched against the formats used
+	by the compilers, no regular expressions are involved. File names
+	found in the output are resolved only once, the result is cached.
+*/
+
+#ifndef MDIAGNOSTICSPARSER_H
+#define MDIAGNOSTICSPARSER_H
+
+#include <map>
+#include <vector>
+
+#include "MFile.h"
+
+enum MMessageKind
+{
+	kMsgKindNone,
+	kMsgKindNote,
+	kMsgKindWarning,
+	kMsgKindError
+};
+
+struct MDiagnostic
+{
+	MMessageKind	kind;
+	fs::path		file;		// empty if the message is not about a file
+	uint32			line;		// one based, zero if unknown
+	std::string		message;
+};
+
+typedef std::vector<MDiagnostic> MDiagnosticList;
+
+class MDiagnosticsParser
+{
+  public:
+					MDiagnosticsParser();
+
+	void			SetBaseDirectory(
+						const fs::path&		inDir);
+
+	// parse all complete lines in the buffer after appending inText
+	void			Feed(
+						const char*			inText,
+						uint32				inSize,
+						MDiagnosticList&	outDiagnostics);
+
+	// parse what is left in the buffer, if anything
+	void			Flush(
+						MDiagnosticList&	outDiagnostics);
+
+	void			Reset();
+
+  private:
+
+	void			ParseLine(
+						const char*			inLine,
+						uint32				inLength,
+						MDiagnosticList&	outDiagnostics);
+
+	bool			ParseMessage(
+						const std::string&	inLine,
+						MDiagnostic&		outDiagnostic);
+
+	bool			ParseIncludedFrom(
+						const std::string&	inLine,
+						MDiagnostic&		outDiagnostic);
+
+	bool			ResolvePath(
+						const std::string&	inFile,
+						fs::path&			outPath);
+
+	typedef std::map<std::string,fs::path>	MPathCache;
+
+	fs::path		mBaseDirectory;
+	MPathCache		mPathCache;
+	std::vector<char>
+					mBuffer;
+	uint32			mBufferStart;	// first unconsumed byte in mBuffer
+	uint32			mScanned;		// bytes after mBufferStart known to contain no newline
+	bool			mLastWasInFileIncluded;
+};
+
+#endif
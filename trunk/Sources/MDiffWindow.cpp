@@ -684,7 +684,9 @@ void MDiffWindow::MergeToFile(int inFileNr)
 	string txt;
 	srcDoc->GetSelectedText(txt);
 	
-	dstDoc->StartAction("Merge");
+	if (not dstDoc->StartAction("Merge"))
+		return;
+
 	dstDoc->ReplaceSelectedText(txt, false, true);
 	dstDoc->FinishAction();
 	
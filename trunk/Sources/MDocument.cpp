@@ -81,7 +81,8 @@ void MDocument::SetFile(
 // ---------------------------------------------------------------------------
 //	MDocument::DoLoad
 
-void MDocument::DoLoad()
+void MDocument::DoLoad(
+	bool				inInBackground)
 {
 	if (not mFile.IsValid())
 		THROW(("File is not specified"));
@@ -98,7 +99,13 @@ void MDocument::DoLoad()
 		SetCallback(mFileLoader->eReadFile, this, &MDocument::ReadFile);
 		SetCallback(mFileLoader->eFileLoaded, this, &MDocument::IOFileLoaded);
 		
-		mFileLoader->DoLoad();
+		if (inInBackground)
+		{
+			SetCallback(mFileLoader->eReadText, this, &MDocument::ReadText);
+			mFileLoader->DoLoadText();
+		}
+		else
+			mFileLoader->DoLoad();
 	}
 }
 
@@ -115,6 +122,10 @@ bool MDocument::DoSave()
 	if (mFileSaver != nil)
 		THROW(("File is already being saved"));
 	
+	// saving now would overwrite the file with what was read so far
+	if (mFileLoader != nil)
+		THROW(("File is still being loaded"));
+	
 	mFileSaver = mFile.Save(*this);
 	
 	SetCallback(mFileSaver->eProgress, this, &MDocument::IOProgress);
@@ -361,6 +372,16 @@ string MDocument::GetWindowTitle() const
 	return result;
 }
 
+// ---------------------------------------------------------------------------
+//	ReadText
+
+void MDocument::ReadText(
+	MTextBuffer&			ioText,
+	const vector<uint32>&	inLineStarts)
+{
+	THROW(("This document cannot be loaded in the background"));
+}
+
 // ---------------------------------------------------------------------------
 //	IOProgress
 
@@ -373,6 +394,11 @@ void MDocument::IOProgress(float inProgress, const string& inMessage)
 
 void MDocument::IOError(const std::string& inError)
 {
+	// a document that failed to load is not bound to its file anymore,
+	// saving it should not overwrite the file with what was read of it
+	if (mFileLoader != nil)
+		SetFile(MFile());
+
 	DisplayError(inError);
 }
 
@@ -390,7 +416,7 @@ bool MDocument::IOAskOverwriteNewer()
 void MDocument::IOFileLoaded()
 {
 	SetModified(false);
-//	eDocumentLoaded(this);
+	eDocumentLoaded(this);
 }
 
 // ---------------------------------------------------------------------------
@@ -27,11 +27,12 @@ class MDocument
 
 	template<class D>
 	static D*			Create(
-							const MFile&		inFile)
+							const MFile&		inFile,
+							bool				inInBackground = false)
 						{
 							std::unique_ptr<D> doc(new D(inFile));
 							if (inFile.IsValid())
-								doc->DoLoad();
+								doc->DoLoad(inInBackground);
 							return doc.release();
 						}
 
@@ -57,6 +58,10 @@ class MDocument
 							const MFile&		inFile);
 
 	virtual bool		IsReadOnly() const					{ return mFile.ReadOnly(); }
+
+	// true while the file is being read, the document cannot be edited
+	// or saved until it is done
+	bool				IsLoading() const					{ return mFileLoader != nil; }
 	
 	virtual void		AddNotifier(
 							MDocClosedNotifier&	inNotifier,
@@ -111,6 +116,7 @@ class MDocument
 	MEventOut<void(MDocument*, const MFile&)>
 											eFileSpecChanged;
 	MEventOut<void(const fs::path&)>		eBaseDirChanged;
+	MEventOut<void(MDocument*)>				eDocumentLoaded;
 
 	virtual void		FileLoaderDeleted(
 							MFileLoader*	inFileLoader);
@@ -122,7 +128,10 @@ class MDocument
 	explicit			MDocument(
 							const MFile&		inFile);
 
-	virtual void		DoLoad();
+	// text documents can be read in a background thread, the document
+	// is still empty when DoLoad returns in that case
+	virtual void		DoLoad(
+							bool				inInBackground = false);
 
 	virtual void		CloseDocument();
 
@@ -133,6 +142,12 @@ class MDocument
 	virtual void		WriteFile(
 							std::ostream&		inFile) = 0;
 
+	// only called for documents loaded in the background
+	virtual void		ReadText(
+							MTextBuffer&		ioText,
+							const std::vector<uint32>&
+												inLineStarts);
+
 	virtual void		IOProgress(float inProgress, const std::string&);
 	virtual void		IOError(const std::string& inError);
 	virtual bool		IOAskOverwriteNewer();
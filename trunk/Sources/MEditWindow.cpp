@@ -167,6 +167,7 @@ MEditWindow::MEditWindow()
 	, eSelectionChanged(this, &MEditWindow::SelectionChanged)
 	, eShellStatus(this, &MEditWindow::ShellStatus)
 	, eSSHProgress(this, &MEditWindow::SSHProgress)
+	, eDocumentLoaded(this, &MEditWindow::DocumentLoaded)
 	, mTextView(nil)
 	, mSelectionPanel(nil)
 	, mParsePopup(nil)
@@ -276,6 +277,42 @@ void MEditWindow::Initialize(
 	}
 }
 
+// A document that is read in the background is still empty when the
+// window is initialized, the scroll position is restored once the text
+// is there. The title is updated too, the file may turn out read-only.
+
+void MEditWindow::DocumentLoaded(
+	MDocument*		inDocument)
+{
+	MTextDocument* doc = dynamic_cast<MTextDocument*>(inDocument);
+	
+	if (doc != nil)
+	{
+		try
+		{
+			MDocState state = {};
+		
+			if (doc->IsSpecified() and doc->ReadDocState(state))
+				mTextView->ScrollToPosition(state.mScrollPosition[0], state.mScrollPosition[1]);
+		}
+		catch (...) {
+		}
+	}
+	
+	FileSpecChanged(inDocument, inDocument->GetFile());
+}
+
+void MEditWindow::FileSpecChanged(
+	MDocument*		inDocument,
+	const MFile&		inFile)
+{
+	MDocWindow::FileSpecChanged(inDocument, inFile);
+	
+	MTextDocument* doc = dynamic_cast<MTextDocument*>(mController->GetDocument());
+	if (doc != nil and doc->IsPlainView())
+		SetTitle(GetTitle() + _(" [Plain View]"));
+}
+
 void MEditWindow::SaveState()
 {
 	MTextDocument* doc = dynamic_cast<MTextDocument*>(mController->GetDocument());
@@ -322,7 +359,7 @@ void MEditWindow::SelectionChanged(
 	MSelection		inNewSelection,
 	string			inRangeName)
 {
-	stringstream str;
+	stringstream str, tip;
 
 	try
 	{
@@ -333,11 +370,16 @@ void MEditWindow::SelectionChanged(
 		inNewSelection.GetCaretLineAndColumn(line, column);
 	
 		str << line + 1 << ',' << column + 1;
+		
+		tip << _("Undo history: ") << (doc->GetTextBuffer().GetUndoMemoryUsage() + 1023) / 1024 << " KB";
 	}
 	catch (...) {}
 
 	if (GTK_IS_LABEL(mSelectionPanel))
+	{
 		gtk_label_set_text(GTK_LABEL(mSelectionPanel), str.str().c_str());
+		gtk_widget_set_tooltip_text(mSelectionPanel, tip.str().c_str());
+	}
 	
 	mParsePopup->SetText(inRangeName);
 }
@@ -381,6 +423,7 @@ void MEditWindow::AddRoutes(
 		AddRoute(doc->eSelectionChanged, eSelectionChanged);
 		AddRoute(doc->eShellStatus, eShellStatus);
 		AddRoute(doc->eSSHProgress, eSSHProgress);
+		AddRoute(doc->eDocumentLoaded, eDocumentLoaded);
 	}
 }
 
@@ -396,5 +439,6 @@ void MEditWindow::RemoveRoutes(
 		RemoveRoute(doc->eSelectionChanged, eSelectionChanged);
 		RemoveRoute(doc->eShellStatus, eShellStatus);
 		RemoveRoute(doc->eSSHProgress, eSSHProgress);
+		RemoveRoute(doc->eDocumentLoaded, eDocumentLoaded);
 	}
 }
@@ -34,6 +34,7 @@ class MEditWindow : public MDocWindow
 	MEventIn<void(MSelection,std::string)>	eSelectionChanged;
 	MEventIn<void(bool)>					eShellStatus;
 	MEventIn<void(float,std::string)>		eSSHProgress;
+	MEventIn<void(MDocument*)>				eDocumentLoaded;
 
 	virtual void		AddRoutes(
 							MDocument*		inDocument);
@@ -53,6 +54,13 @@ class MEditWindow : public MDocWindow
 	void				SSHProgress(
 							float			inFraction,
 							std::string		inMessage);
+
+	void				DocumentLoaded(
+							MDocument*		inDocument);
+
+	virtual void		FileSpecChanged(
+							MDocument*		inDocument,
+							const MFile&		inFile);
 	
 	MTextView*			mTextView;
 	GtkWidget*			mSelectionPanel;
@@ -10,9 +10,12 @@
 
 #include "MError.h"
 #include "MTypes.h"
+
+#if not defined(JAPI_HEADLESS)
 #include "MUtils.h"
 #include "MSound.h"
 #include "MAlerts.h"
+#endif
 
 using namespace std;
 
@@ -66,6 +69,7 @@ void __signal_throw(
 	cerr << "Throwing in file " << inFile << " line " << inLine
 		<< " \"" << inFunction << "\": " << endl << inCode << endl;
 	
+#if not defined(JAPI_HEADLESS)
 	if (StOKToThrow::IsOK())
 		return;
 
@@ -78,6 +82,7 @@ void __signal_throw(
 	(void)gtk_dialog_run(GTK_DIALOG(dlg));
 	
 	gtk_widget_destroy(dlg);
+#endif
 }
 
 #endif
@@ -8,6 +8,8 @@
 #include <cstring>
 
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <stack>
 #include <fstream>
 #include <cassert>
@@ -21,6 +23,9 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/regex.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include "MFile.h"
 #include "MDocument.h"
@@ -32,6 +37,7 @@
 #include "MSftpChannel.h"
 
 #include "MJapiApp.h"
+#include "MTextBuffer.h"
 
 using namespace std;
 namespace io = boost::iostreams;
@@ -41,6 +47,7 @@ namespace {
 
 int32 read_attribute(const fs::path& inPath, const char* inName, void* outData, size_t inDataSize);
 int32 write_attribute(const fs::path& inPath, const char* inName, const void* inData, size_t inDataSize);
+void copy_attributes(const fs::path& inFrom, int inToFD);
 
 // reserved characters in URL's
 
@@ -100,6 +107,33 @@ int32 write_attribute(const fs::path& inPath, const char* inName, const void* in
 	last_write_time(inPath, t);
 }
 
+void copy_attributes(const fs::path& inFrom, int inToFD)
+{
+	string path = inFrom.string();
+	
+	ssize_t size = extattr_list_file(path.c_str(), EXTATTR_NAMESPACE_USER, nil, 0);
+	if (size <= 0)
+		return;
+	
+	vector<char> names(size);
+	size = extattr_list_file(path.c_str(), EXTATTR_NAMESPACE_USER, &names[0], size);
+	
+	// the list consists of names prefixed by a length byte
+	for (ssize_t i = 0; i < size; i += 1 + static_cast<unsigned char>(names[i]))
+	{
+		string name(&names[i + 1], static_cast<unsigned char>(names[i]));
+		
+		ssize_t length = extattr_get_file(path.c_str(), EXTATTR_NAMESPACE_USER, name.c_str(), nil, 0);
+		if (length < 0)
+			continue;
+		
+		vector<char> data(length + 1);
+		length = extattr_get_file(path.c_str(), EXTATTR_NAMESPACE_USER, name.c_str(), &data[0], length);
+		if (length >= 0)
+			(void)extattr_set_fd(inToFD, EXTATTR_NAMESPACE_USER, name.c_str(), &data[0], length);
+	}
+}
+
 #endif
 
 // ------------------------------------------------------------------
@@ -108,6 +142,7 @@ int32 write_attribute(const fs::path& inPath, const char* inName, const void* in
 #if defined(__linux__)
 
 #include <attr/attributes.h>
+#include <sys/xattr.h>
 
 int32 read_attribute(const fs::path& inPath, const char* inName, void* outData, size_t inDataSize)
 {
@@ -133,6 +168,33 @@ int32 write_attribute(const fs::path& inPath, const char* inName, const void* in
 	return inDataSize;
 }
 
+void copy_attributes(const fs::path& inFrom, int inToFD)
+{
+	string path = inFrom.string();
+	
+	ssize_t size = ::listxattr(path.c_str(), nil, 0);
+	if (size <= 0)
+		return;
+	
+	vector<char> names(size);
+	size = ::listxattr(path.c_str(), &names[0], size);
+	
+	// the list consists of null terminated names
+	for (ssize_t i = 0; i < size; i += strlen(&names[i]) + 1)
+	{
+		const char* name = &names[i];
+		
+		ssize_t length = ::getxattr(path.c_str(), name, nil, 0);
+		if (length < 0)
+			continue;
+		
+		vector<char> data(length + 1);
+		length = ::getxattr(path.c_str(), name, &data[0], length);
+		if (length >= 0)
+			(void)::fsetxattr(inToFD, name, &data[0], length, 0);
+	}
+}
+
 #endif
 
 // ------------------------------------------------------------------
@@ -156,6 +218,32 @@ int32 write_attribute(const fs::path& inPath, const char* inName, const void* in
 	(void)::setxattr(path.c_str(), inName, inData, inDataSize, 0, 0);
 }
 
+void copy_attributes(const fs::path& inFrom, int inToFD)
+{
+	string path = inFrom.string();
+	
+	ssize_t size = ::listxattr(path.c_str(), nil, 0, 0);
+	if (size <= 0)
+		return;
+	
+	vector<char> names(size);
+	size = ::listxattr(path.c_str(), &names[0], size, 0);
+	
+	for (ssize_t i = 0; i < size; i += strlen(&names[i]) + 1)
+	{
+		const char* name = &names[i];
+		
+		ssize_t length = ::getxattr(path.c_str(), name, nil, 0, 0, 0);
+		if (length < 0)
+			continue;
+		
+		vector<char> data(length + 1);
+		length = ::getxattr(path.c_str(), name, &data[0], length, 0, 0);
+		if (length >= 0)
+			(void)::fsetxattr(inToFD, name, &data[0], length, 0, 0);
+	}
+}
+
 #endif
 	
 }
@@ -224,6 +312,11 @@ MFileLoader::~MFileLoader()
 	mDocument.FileLoaderDeleted(this);
 }
 
+void MFileLoader::DoLoadText()
+{
+	DoLoad();
+}
+
 void MFileLoader::Cancel()
 {
 	delete this;
@@ -238,6 +331,155 @@ void MFileLoader::SetFileInfo(
 
 // --------------------------------------------------------------------
 
+namespace
+{
+
+bool IsReadOnly(
+	const fs::path&		inPath)
+{
+	bool readOnly = false;
+
+	struct stat st;
+
+	if (stat(inPath.string().c_str(), &st) == 0)
+	{
+		// fetch user&group
+		unsigned int gid = getgid();
+		unsigned int uid = getuid();
+		
+		readOnly = not ((uid == st.st_uid and (S_IWUSR & st.st_mode)) or
+						(gid == st.st_gid and (S_IWGRP & st.st_mode)) or
+						(S_IWOTH & st.st_mode));
+		
+		if (readOnly && S_IWGRP & st.st_mode)
+		{
+			int ngroups = getgroups(0, nil);
+			if (ngroups > 0)
+			{
+				vector<gid_t> groups(ngroups);
+				if (getgroups(ngroups, &groups[0]) == 0)
+					readOnly = find(groups.begin(), groups.end(), st.st_gid) == groups.end();
+			}
+		}
+	}
+	
+	return readOnly;
+}
+
+}
+
+// --------------------------------------------------------------------
+//	MTextLoadJob, reads and decodes a file in a background thread.
+//	The job is shared by the loader and the thread, a cancelled loader
+//	leaves the thread to clean up.
+
+struct MTextLoadJob
+{
+						MTextLoadJob(
+							const fs::path&		inPath,
+							MTextBuffer*		inText)
+							: path(inPath)
+							, text(inText)
+							, readOnly(false)
+							, modTime(0)
+							, progress(0)
+							, done(false)
+							, cancelled(false) {}
+
+						~MTextLoadJob()
+						{
+							delete text;
+						}
+
+	void				Run();
+
+	// returns false when the job was cancelled
+	bool				SetProgress(
+							float				inProgress);
+
+	fs::path			path;
+	MTextBuffer*		text;
+	vector<uint32>		lineStarts;
+	bool				readOnly;
+	double				modTime;
+	string				error;
+	boost::mutex		mutex;
+	float				progress;
+	bool				done;
+	bool				cancelled;
+};
+
+void MTextLoadJob::Run()
+{
+	// the last part of the progress bar is for decoding
+	const float kReadPart = 0.9f;
+	const int64 kChunkSize = 1024 * 1024;
+
+	try
+	{
+		if (not fs::exists(path))
+			THROW(("File %s does not exist", path.string().c_str())); 
+		
+		double fileModTime = fs::last_write_time(path);
+		bool fileReadOnly = IsReadOnly(path);
+		
+		fs::ifstream file(path, ios::binary);
+		if (not file.is_open())
+			THROW(("Could not open file %s", path.leaf().c_str()));
+
+		streambuf* b = file.rdbuf();
+		
+		int64 len = b->pubseekoff(0, ios::end);
+		b->pubseekpos(0);
+	
+		if (len < 0)
+			THROW(("File is not open?"));
+	
+		if (len > numeric_limits<uint32>::max())
+			THROW(("File too large to open"));
+		
+		auto_array<char> data(new char[len]);
+		
+		for (int64 offset = 0; offset < len; )
+		{
+			int64 size = min(len - offset, kChunkSize);
+			
+			if (b->sgetn(data.get() + offset, size) != size)
+				THROW(("Error reading file %s", path.leaf().c_str()));
+			
+			offset += size;
+			
+			if (not SetProgress(kReadPart * offset / len))
+				return;
+		}
+		
+		text->ReadFromData(data.release(), len, &lineStarts);
+		
+		boost::mutex::scoped_lock lock(mutex);
+		readOnly = fileReadOnly;
+		modTime = fileModTime;
+	}
+	catch (exception& e)
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		error = e.what();
+	}
+	
+	boost::mutex::scoped_lock lock(mutex);
+	progress = 1.0f;
+	done = true;
+}
+
+bool MTextLoadJob::SetProgress(
+	float				inProgress)
+{
+	boost::mutex::scoped_lock lock(mutex);
+	progress = inProgress;
+	return not cancelled;
+}
+
+// --------------------------------------------------------------------
+
 class MLocalFileLoader : public MFileLoader
 {
   public:
@@ -245,7 +487,25 @@ class MLocalFileLoader : public MFileLoader
 						MDocument&		inDocument,
 						MFile&			inFile);
 
+	virtual			~MLocalFileLoader();
+
 	virtual void	DoLoad();
+
+	virtual void	DoLoadText();
+
+	virtual void	Cancel();
+
+  private:
+
+	static gboolean	PollCB(
+						gpointer		inData);
+
+	bool			Poll();
+
+	boost::shared_ptr<MTextLoadJob>
+					mJob;
+	guint			mPollTag;
+	float			mProgress;
 };
 
 // --------------------------------------------------------------------
@@ -254,9 +514,17 @@ MLocalFileLoader::MLocalFileLoader(
 	MDocument&		inDocument,
 	MFile&			inFile)
 	: MFileLoader(inDocument, inFile)
+	, mPollTag(0)
+	, mProgress(0)
 {
 }
 
+MLocalFileLoader::~MLocalFileLoader()
+{
+	if (mPollTag != 0)
+		g_source_remove(mPollTag);
+}
+
 void MLocalFileLoader::DoLoad()
 {
 	try
@@ -267,31 +535,7 @@ void MLocalFileLoader::DoLoad()
 			THROW(("File %s does not exist", path.string().c_str())); 
 		
 		double modTime = fs::last_write_time(path);
-        bool readOnly = false;
-
-		struct stat st;
-
-		if (stat(path.string().c_str(), &st) == 0)
-		{
-			// fetch user&group
-			unsigned int gid = getgid();
-			unsigned int uid = getuid();
-			
-			readOnly = not ((uid == st.st_uid and (S_IWUSR & st.st_mode)) or
-							(gid == st.st_gid and (S_IWGRP & st.st_mode)) or
-							(S_IWOTH & st.st_mode));
-			
-			if (readOnly && S_IWGRP & st.st_mode)
-			{
-				int ngroups = getgroups(0, nil);
-				if (ngroups > 0)
-				{
-					vector<gid_t> groups(ngroups);
-					if (getgroups(ngroups, &groups[0]) == 0)
-						readOnly = find(groups.begin(), groups.end(), st.st_gid) == groups.end();
-				}
-			}
-		}
+		bool readOnly = IsReadOnly(path);
 		
 		fs::ifstream file(path, ios::binary);
 		eReadFile(file);
@@ -308,6 +552,115 @@ void MLocalFileLoader::DoLoad()
 	delete this;
 }
 
+// --------------------------------------------------------------------
+//	DoLoadText
+//
+//	Reading, decoding, normalizing the line ends and collecting the line
+//	starts all happen in a worker thread. The loader polls the job from a
+//	timeout on the GUI thread to report progress and deliver the result.
+
+void MLocalFileLoader::DoLoadText()
+{
+	// the buffer is created here, its constructor reads the preferences
+	mJob.reset(new MTextLoadJob(mFile.GetPath(), new MTextBuffer()));
+	
+	boost::thread thread(boost::bind(&MTextLoadJob::Run, mJob));
+	thread.detach();
+	
+	mPollTag = g_timeout_add(50, &MLocalFileLoader::PollCB, this);
+}
+
+void MLocalFileLoader::Cancel()
+{
+	if (mJob)
+	{
+		boost::mutex::scoped_lock lock(mJob->mutex);
+		mJob->cancelled = true;
+	}
+
+	MFileLoader::Cancel();
+}
+
+gboolean MLocalFileLoader::PollCB(
+	gpointer		inData)
+{
+	gdk_threads_enter();
+
+	bool result = false;
+	
+	try
+	{
+		result = reinterpret_cast<MLocalFileLoader*>(inData)->Poll();
+	}
+	catch (...) {}
+	
+	gdk_threads_leave();
+	
+	return result;
+}
+
+bool MLocalFileLoader::Poll()
+{
+	bool done;
+	float progress;
+	
+	{
+		boost::mutex::scoped_lock lock(mJob->mutex);
+		done = mJob->done;
+		progress = mJob->progress;
+	}
+	
+	if (not done)
+	{
+		if (progress != mProgress)
+		{
+			mProgress = progress;
+			eProgress(progress, "Loading file");
+		}
+		
+		return true;
+	}
+	
+	// returning false removes the timeout
+	mPollTag = 0;
+	
+	// whatever happens, the loader goes away. Otherwise the document
+	// would be left loading, and thus not editable, forever.
+	string error = mJob->error;
+	
+	if (error.empty())
+	{
+		try
+		{
+			eReadText(*mJob->text, mJob->lineStarts);
+			
+			SetFileInfo(mJob->readOnly, mJob->modTime);
+			
+			eFileLoaded();
+		}
+		catch (exception& e)
+		{
+			error = e.what();
+		}
+		catch (...)
+		{
+			error = _("Unknown error while loading file");
+		}
+	}
+	
+	if (not error.empty())
+	{
+		try
+		{
+			eError(error);
+		}
+		catch (...) {}
+	}
+	
+	delete this;
+	return false;
+}
+
 // --------------------------------------------------------------------
 // MFileSaver, used to save data to a file.
 
@@ -338,6 +691,120 @@ void MFileSaver::SetFileInfo(
 
 // --------------------------------------------------------------------
 
+// a streambuf writing to a file descriptor, large writes bypass the buffer
+
+class MFileDescriptorBuf : public streambuf
+{
+  public:
+					MFileDescriptorBuf(
+						int					inFD);
+
+					~MFileDescriptorBuf();
+
+	// errno of the first failed write, zero if all went well
+	int				GetError() const				{ return mError; }
+
+  protected:
+
+	virtual int_type
+					overflow(
+						int_type			inChar);
+
+	virtual streamsize
+					xsputn(
+						const char*			inData,
+						streamsize			inSize);
+
+	virtual int		sync();
+
+  private:
+
+	bool			Write(
+						const char*			inData,
+						streamsize			inSize);
+
+	static const uint32	kBufferSize = 1024 * 1024;
+
+	int				mFD;
+	int				mError;
+	char*			mBuffer;
+};
+
+MFileDescriptorBuf::MFileDescriptorBuf(
+	int					inFD)
+	: mFD(inFD)
+	, mError(0)
+	, mBuffer(new char[kBufferSize])
+{
+	setp(mBuffer, mBuffer + kBufferSize);
+}
+
+MFileDescriptorBuf::~MFileDescriptorBuf()
+{
+	delete[] mBuffer;
+}
+
+bool MFileDescriptorBuf::Write(
+	const char*			inData,
+	streamsize			inSize)
+{
+	while (inSize > 0 and mError == 0)
+	{
+		ssize_t r = ::write(mFD, inData, inSize);
+
+		if (r >= 0)
+		{
+			inData += r;
+			inSize -= r;
+		}
+		else if (errno != EINTR)
+			mError = errno;
+	}
+	
+	return mError == 0;
+}
+
+MFileDescriptorBuf::int_type MFileDescriptorBuf::overflow(
+	int_type			inChar)
+{
+	if (sync() != 0)
+		return traits_type::eof();
+
+	if (not traits_type::eq_int_type(inChar, traits_type::eof()))
+	{
+		*pptr() = traits_type::to_char_type(inChar);
+		pbump(1);
+	}
+
+	return traits_type::not_eof(inChar);
+}
+
+streamsize MFileDescriptorBuf::xsputn(
+	const char*			inData,
+	streamsize			inSize)
+{
+	streamsize result = inSize;
+
+	if (inSize <= epptr() - pptr())
+	{
+		memcpy(pptr(), inData, inSize);
+		pbump(inSize);
+	}
+	else if (sync() != 0 or not Write(inData, inSize))
+		result = 0;
+	
+	return result;
+}
+
+int MFileDescriptorBuf::sync()
+{
+	bool ok = Write(pbase(), pptr() - pbase());
+	setp(mBuffer, mBuffer + kBufferSize);
+	return ok ? 0 : -1;
+}
+
+// --------------------------------------------------------------------
+
 class MLocalFileSaver : public MFileSaver
 {
   public:
@@ -346,6 +813,14 @@ class MLocalFileSaver : public MFileSaver
 						MFile&				inFile);
 
 	virtual void	DoSave();
+
+  private:
+
+	bool			SaveAtomic(
+						const fs::path&		inPath);
+
+	void			SaveInPlace(
+						const fs::path&		inPath);
 };
 
 // --------------------------------------------------------------------
@@ -367,14 +842,8 @@ void MLocalFileSaver::DoSave()
 		    fs::last_write_time(path) <= mFile.GetModDate() or
 			eAskOverwriteNewer())
 		{
-			fs::ofstream file(path, ios::trunc|ios::binary);
-			
-			if (not file.is_open())
-				THROW(("Could not open file %s for writing", path.leaf().c_str()));
-			
-			eWriteFile(file);
-			
-			file.close();
+			if (not Preferences::GetInteger("atomic save", 1) or not SaveAtomic(path))
+				SaveInPlace(path);
 			
 			eFileWritten();
 			
@@ -389,6 +858,134 @@ void MLocalFileSaver::DoSave()
 	delete this;
 }
 
+// --------------------------------------------------------------------
+//	SaveAtomic
+//
+//	Write the data to a new file in the same directory and rename that
+//	over the original once it is safely on disk. A crash halfway leaves
+//	the original untouched. Returns false if the file cannot be saved this
+//	way without changing its owner or breaking hard links.
+
+bool MLocalFileSaver::SaveAtomic(
+	const fs::path&		inPath)
+{
+	// replace the file a symbolic link points to, not the link itself
+	fs::path path(inPath);
+	
+	char* resolved = realpath(inPath.string().c_str(), nil);
+	if (resolved != nil)
+	{
+		path = resolved;
+		free(resolved);
+	}
+	
+	struct stat st;
+	bool exists = stat(path.string().c_str(), &st) == 0;
+	
+	if (exists and (not S_ISREG(st.st_mode) or st.st_nlink > 1))
+		return false;
+
+	string temp = (path.parent_path() / ("." + path.filename() + ".XXXXXX")).string();
+	vector<char> tempName(temp.begin(), temp.end());
+	tempName.push_back(0);
+	
+	int fd = mkstemp(&tempName[0]);
+	if (fd < 0)		// e.g. no write access to the directory
+		return false;
+	
+	temp = &tempName[0];
+	
+	try
+	{
+		if (exists)
+		{
+			if (fchown(fd, st.st_uid, st.st_gid) < 0 and
+				(st.st_uid != getuid() or fchown(fd, -1, st.st_gid) < 0))
+			{
+				THROW(("Cannot preserve the owner of %s", path.leaf().c_str()));
+			}
+			
+			if (fchmod(fd, st.st_mode & 07777) < 0)
+				THROW(("Cannot preserve the permissions of %s", path.leaf().c_str()));
+			
+			copy_attributes(path, fd);
+		}
+		else
+		{
+			mode_t mask = umask(0);
+			umask(mask);
+			
+			(void)fchmod(fd, 0666 & ~mask);
+		}
+	}
+	catch (...)
+	{
+		close(fd);
+		unlink(temp.c_str());
+		return false;
+	}
+	
+	try
+	{
+		MFileDescriptorBuf buf(fd);
+		ostream file(&buf);
+		
+		eWriteFile(file);
+		file.flush();
+		
+		if (buf.GetError() != 0)
+			THROW(("Error writing %s: %s", path.leaf().c_str(), strerror(buf.GetError())));
+		
+		if (not file)
+			THROW(("Error writing %s", path.leaf().c_str()));
+		
+		if (fsync(fd) < 0)
+			THROW(("Error writing %s: %s", path.leaf().c_str(), strerror(errno)));
+		
+		int err = close(fd);
+		fd = -1;
+		
+		if (err < 0)
+			THROW(("Error writing %s: %s", path.leaf().c_str(), strerror(errno)));
+		
+		if (rename(temp.c_str(), path.string().c_str()) < 0)
+			THROW(("Could not replace %s: %s", path.leaf().c_str(), strerror(errno)));
+	}
+	catch (...)
+	{
+		if (fd >= 0)
+			close(fd);
+		unlink(temp.c_str());
+		throw;
+	}
+	
+	// and make sure the new directory entry is on disk as well
+	int dir = open(path.parent_path().string().c_str(), O_RDONLY);
+	if (dir >= 0)
+	{
+		(void)fsync(dir);
+		close(dir);
+	}
+	
+	return true;
+}
+
+// --------------------------------------------------------------------
+//	SaveInPlace
+
+void MLocalFileSaver::SaveInPlace(
+	const fs::path&		inPath)
+{
+	fs::ofstream file(inPath, ios::trunc|ios::binary);
+	
+	if (not file.is_open())
+		THROW(("Could not open file %s for writing", inPath.leaf().c_str()));
+	
+	eWriteFile(file);
+	
+	file.close();
+}
+
 // --------------------------------------------------------------------
 // MFile, something like a path or URI. 
 
@@ -1126,56 +1723,6 @@ ostream& operator<<(ostream& lhs, const MFile& rhs)
 	return lhs;
 }
 
-namespace {
-
-bool Match(const char* inPattern, const char* inName);
-
-bool Match(
-	const char*		inPattern,
-	const char*		inName)
-{
-	for (;;)
-	{
-		char op = *inPattern;
-
-		switch (op)
-		{
-			case 0:
-				return *inName == 0;
-			case '*':
-			{
-				if (inPattern[1] == 0)	// last '*' matches all 
-					return true;
-
-				const char* n = inName;
-				while (*n)
-				{
-					if (Match(inPattern + 1, n))
-						return true;
-					++n;
-				}
-				return false;
-			}
-			case '?':
-				if (*inName)
-					return Match(inPattern + 1, inName + 1);
-				else
-					return false;
-			default:
-				if (tolower(*inName) == tolower(op))
-				{
-					++inName;
-					++inPattern;
-				}
-				else
-					return false;
-				break;
-		}
-	}
-}
-
-}
-
 bool FileNameMatches(
 	const char*		inPattern,
 	const MFile&	inFile)
@@ -1190,39 +1737,6 @@ bool FileNameMatches(
 	return FileNameMatches(inPattern, inFile.filename());
 }
 
-bool FileNameMatches(
-	const char*		inPattern,
-	const string&	inFile)
-{
-	bool result = false;
-	
-	if (inFile.length() > 0)
-	{
-		string p(inPattern);
-	
-		while (not result and p.length())
-		{
-			string::size_type s = p.find(';');
-			string pat;
-			
-			if (s == string::npos)
-			{
-				pat = p;
-				p.clear();
-			}
-			else
-			{
-				pat = p.substr(0, s);
-				p.erase(0, s + 1);
-			}
-			
-			result = Match(pat.c_str(), inFile.c_str());
-		}
-	}
-	
-	return result;	
-}
-
 // ------------------------------------------------------------
 
 struct MFileIteratorImp
@@ -13,11 +13,13 @@
 #include <boost/filesystem/convenience.hpp>
 
 #include "MCallbacks.h"
+#include "MFileName.h"
 
 namespace fs = boost::filesystem;
 
 class MFileLoader;
 class MFileSaver;
+class MTextBuffer;
 class MDocument;
 
 // --------------------------------------------------------------------
@@ -143,9 +145,16 @@ class MFileLoader
 	MCallback<void(float, const std::string&)>	eProgress;
 	MCallback<void(const std::string&)>			eError;
 	MCallback<void(std::istream&)>				eReadFile;
+	MCallback<void(MTextBuffer&, const std::vector<uint32>&)>
+												eReadText;
 	MCallback<void()>							eFileLoaded;
 
 	virtual void	DoLoad() = 0;
+
+	// Load the file as text in a background thread, the decoded text and
+	// its line starts are passed to eReadText. Loaders that cannot do
+	// this load the file with DoLoad.
+	virtual void	DoLoadText();
 	
 	virtual void	Cancel();
 
@@ -266,10 +275,6 @@ bool FileNameMatches(
 	const char*			inPattern,
 	const MFile&		inFile);
 
-bool FileNameMatches(
-	const char*			inPattern,
-	const std::string&	inFile);
-
 fs::path relative_path(
 	const fs::path&		inFromDir,
 	const fs::path&		inFile);
@@ -0,0 +1,95 @@
+//          Copyright Maarten L. Hekkelman 2006-2008
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "MJapi.h"
+
+#include <cctype>
+
+#include "MFileName.h"
+
+using namespace std;
+
+namespace {
+
+bool Match(const char* inPattern, const char* inName);
+
+bool Match(
+	const char*		inPattern,
+	const char*		inName)
+{
+	for (;;)
+	{
+		char op = *inPattern;
+
+		switch (op)
+		{
+			case 0:
+				return *inName == 0;
+			case '*':
+			{
+				if (inPattern[1] == 0)	// last '*' matches all 
+					return true;
+
+				const char* n = inName;
+				while (*n)
+				{
+					if (Match(inPattern + 1, n))
+						return true;
+					++n;
+				}
+				return false;
+			}
+			case '?':
+				if (*inName)
+					return Match(inPattern + 1, inName + 1);
+				else
+					return false;
+			default:
+				if (tolower(*inName) == tolower(op))
+				{
+					++inName;
+					++inPattern;
+				}
+				else
+					return false;
+				break;
+		}
+	}
+}
+
+}
+
+bool FileNameMatches(
+	const char*		inPattern,
+	const string&	inFile)
+{
+	bool result = false;
+	
+	if (inFile.length() > 0)
+	{
+		string p(inPattern);
+	
+		while (not result and p.length())
+		{
+			string::size_type s = p.find(';');
+			string pat;
+			
+			if (s == string::npos)
+			{
+				pat = p;
+				p.clear();
+			}
+			else
+			{
+				pat = p.substr(0, s);
+				p.erase(0, s + 1);
+			}
+			
+			result = Match(pat.c_str(), inFile.c_str());
+		}
+	}
+	
+	return result;	
+}
@@ -0,0 +1,19 @@
+//          Copyright Maarten L. Hekkelman 2006-2008
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MFILENAME_H
+#define MFILENAME_H
+
+#include <string>
+
+// Match a file name against a list of glob patterns separated by
+// semicolons, e.g. "*.cpp;*.h". The comparison ignores case. This is
+// kept apart from MFile so the languages can use it without GTK.
+
+bool FileNameMatches(
+	const char*			inPattern,
+	const std::string&	inFile);
+
+#endif
@@ -0,0 +1,91 @@
+//          Copyright Maarten L. Hekkelman 2006-2008
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "MJapi.h"
+
+#include "MFindSymbolDialog.h"
+#include "MProject.h"
+#include "MSymbolIndex.h"
+#include "MTextDocument.h"
+#include "MEditWindow.h"
+#include "MMessageWindow.h"
+#include "MPreferences.h"
+#include "MStrings.h"
+#include "MSound.h"
+#include "MJapiApp.h"
+
+using namespace std;
+
+namespace {
+
+enum {
+	kSymbolComboControlID = 'symb'
+};
+
+}
+
+MFindSymbolDialog::MFindSymbolDialog(
+	MProject*			inProject,
+	MWindow*			inWindow)
+	: MDialog("find-symbol-dialog")
+	, mProject(inProject)
+{
+	vector<string> last;
+	
+	Preferences::GetArray("find symbol", last);
+	SetValues(kSymbolComboControlID, last);
+
+	Show(inWindow);
+	SetFocus(kSymbolComboControlID);
+}
+
+bool MFindSymbolDialog::OKClicked()
+{
+	string s;
+
+	GetText(kSymbolComboControlID, s);
+
+	vector<string> last;
+	Preferences::GetArray("find symbol", last);
+	last.erase(remove(last.begin(), last.end(), s), last.end());
+	last.insert(last.begin(), s);
+	if (last.size() > 10)
+		last.erase(last.end() - 1);
+	Preferences::SetArray("find symbol", last);
+	
+	vector<MSymbolLocation> hits;
+	if (mProject != nil and not s.empty())
+		mProject->FindSymbol(s, hits);
+	
+	if (hits.empty())
+		PlaySound("warning");
+	else if (hits.size() == 1)
+	{
+		MTextDocument* doc = dynamic_cast<MTextDocument*>(
+			gApp->OpenOneDocument(MFile(hits.front().file)));
+		
+		if (doc != nil)
+		{
+			MEditWindow::DisplayDocument(doc);
+			doc->Select(hits.front().offset, hits.front().offset + hits.front().length,
+				kScrollToSelection);
+		}
+	}
+	else
+	{
+		MMessageList list;
+		
+		for (vector<MSymbolLocation>::iterator hit = hits.begin(); hit != hits.end(); ++hit)
+		{
+			list.AddMessage(kMsgKindNone, MFile(hit->file), hit->line + 1,
+				hit->offset, hit->offset + hit->length, hit->name);
+		}
+		
+		MMessageWindow* w = new MMessageWindow("", true);
+		w->SetMessages(FormatString("Found ^0 symbols for ^1", hits.size(), s), list);
+	}
+	
+	return true;
+}
@@ -0,0 +1,26 @@
+//          Copyright Maarten L. Hekkelman 2006-2008
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MFINDSYMBOLDIALOG_H
+#define MFINDSYMBOLDIALOG_H
+
+#include "MDialog.h"
+
+class MProject;
+
+class MFindSymbolDialog : public MDialog
+{
+  public:
+						MFindSymbolDialog(
+							MProject*			inProject,
+							MWindow*			inWindow);
+
+	virtual bool		OKClicked();
+	
+  private:
+	MProject*			mProject;
+};
+
+#endif // MFINDSYMBOLDIALOG_H
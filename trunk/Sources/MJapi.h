@@ -6,7 +6,13 @@
 #ifndef MJAPI_H
 #define MJAPI_H
 
+// The text engine can be built without GTK, see JAPI_HEADLESS in the
+// makefile. It still needs glib for the Unicode character tables.
+#if defined(JAPI_HEADLESS)
+#include <glib.h>
+#else
 #include <gtk/gtk.h>
+#endif
 
 #include "MTypes.h"
 
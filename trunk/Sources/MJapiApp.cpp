@@ -28,6 +28,7 @@
 #include "MAcceleratorTable.h"
 #include "MDocClosedNotifier.h"
 #include "MFindAndOpenDialog.h"
+#include "MFindSymbolDialog.h"
 #include "MFindDialog.h"
 #include "MProject.h"
 #include "MPrefsDialog.h"
@@ -41,6 +42,8 @@
 #include "MePubDocument.h"
 #include "MePubWindow.h"
 #include "MShell.h"
+#include "MTrace.h"
+#include "MBenchmark.h"
 
 //#include "MTestWindow.h"
 
@@ -199,6 +202,11 @@ bool MJapiApp::ProcessCommand(
 			new MFindAndOpenDialog(MProject::Instance(), MWindow::GetFirstWindow());
 			break;
 		
+		case cmd_FindSymbol:
+			if (MProject::Instance() != nil)
+				new MFindSymbolDialog(MProject::Instance(), MWindow::GetFirstWindow());
+			break;
+		
 		case cmd_Worksheet:
 			ShowWorksheet();
 			break;
@@ -275,6 +283,10 @@ bool MJapiApp::UpdateCommandStatus(
 			outEnabled = true;
 			break;
 		
+		case cmd_FindSymbol:
+			outEnabled = MProject::Instance() != nil;
+			break;
+		
 		default:
 			result = false;
 			break;
@@ -714,7 +726,7 @@ void MJapiApp::DoOpen()
 	if (ChooseFiles(false, urls))
 	{
 		for (vector<MFile>::iterator url = urls.begin(); url != urls.end(); ++url)
-			doc = OpenOneDocument(*url);
+			doc = OpenOneDocument(*url, true);
 	}
 	
 	if (doc != nil)
@@ -725,7 +737,8 @@ void MJapiApp::DoOpen()
 //	OpenOneDocument
 
 MDocument* MJapiApp::OpenOneDocument(
-	const MFile&			inFileRef)
+	const MFile&			inFileRef,
+	bool					inInBackground)
 {
 	if (inFileRef.IsLocal() and fs::is_directory(inFileRef.GetPath()))
 		THROW(("Cannot open a directory"));
@@ -743,7 +756,7 @@ MDocument* MJapiApp::OpenOneDocument(
 		else if (FileNameMatches("*.epub", inFileRef))
 			OpenEPub(inFileRef);
 		else
-			doc = MDocument::Create<MTextDocument>(inFileRef);
+			doc = MDocument::Create<MTextDocument>(inFileRef, inInBackground);
 	}
 	
 	if (doc != nil)
@@ -1024,6 +1037,10 @@ bool MJapiApp::IsServer()
 	
 	mSocketFD = OpenSocket(addr);
 
+	// the running server does the work, it was not started with -T
+	if (mSocketFD != -1 and MTrace::IsActive())
+		cerr << _("japi is already running, -T is ignored. Use -f to trace a separate instance.") << endl;
+
 	if (mSocketFD == -1)
 	{
 		isServer = true;
@@ -1171,6 +1188,9 @@ void usage()
 		 << "               resulting in /usr/local/bin/japi" << endl
 		 << "    -h         This help message" << endl
 		 << "    -f         Don't fork into client/server mode" << endl
+		 << "    -T file    Write a trace of where the time went to file" << endl
+		 << "    -b         Run the benchmarks, for those containing the first" << endl
+		 << "               argument in their name if it is given" << endl
 		 << endl
 		 << "  One or more files may be specified, use - for reading from stdin" << endl
 		 << endl;
@@ -1303,10 +1323,10 @@ int main(int argc, char* argv[])
 	
 		// Collect the options
 		int c;
-		bool fork = true, readStdin = false, install = false;
-		string target, prefix;
+		bool fork = true, readStdin = false, install = false, benchmark = false;
+		string target, prefix, trace;
 
-		while ((c = getopt(argc, const_cast<char**>(argv), "h?fip:m:vt")) != -1)
+		while ((c = getopt(argc, const_cast<char**>(argv), "h?fip:m:vtT:b")) != -1)
 		{
 			switch (c)
 			{
@@ -1325,6 +1345,14 @@ int main(int argc, char* argv[])
 				case 'm':
 					target = optarg;
 					break;
+				
+				case 'T':
+					trace = optarg;
+					break;
+				
+				case 'b':
+					benchmark = true;
+					break;
 #if DEBUG
 				case 'v':
 					++VERBOSE;
@@ -1342,6 +1370,16 @@ int main(int argc, char* argv[])
 			InstallJapi(prefix);
 		}
 		
+		if (not trace.empty())
+			MTrace::Start(fs::system_complete(trace));
+		
+		if (benchmark)
+		{
+			RunBenchmarks(cout, optind < argc ? argv[optind] : "");
+			MTrace::Stop();
+			exit(0);
+		}
+		
 		// if the option was to build a target, try it and exit.
 		if (not target.empty())
 		{
@@ -1356,6 +1394,7 @@ int main(int argc, char* argv[])
 				cout << "Build successful, " << target << " is up-to-date" << endl;
 			else
 				cout << "Building " << target << " Failed" << endl;
+			MTrace::Stop();
 			exit(0);
 		}
 
@@ -1421,6 +1460,8 @@ int main(int argc, char* argv[])
 			// we're done, clean up
 			MFindDialog::Instance().Close();
 			
+			MTrace::Stop();
+			
 			SaveGlobals();
 	
 			if (fork)
@@ -51,8 +51,10 @@ class MJapiApp : public MHandler
 							const std::string&	inFileName,
 							MFile&				outFile);
 
+	// documents opened in the background are still empty when this returns
 	MDocument*			OpenOneDocument(
-							const MFile&		inFileRef);
+							const MFile&		inFileRef,
+							bool				inInBackground = false);
 
 	MDocument*			AskOpenOneDocument();
 
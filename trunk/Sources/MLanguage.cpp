@@ -18,7 +18,10 @@
 #include "MLanguageTeX.h"
 #include "MLanguageHTML.h"
 #include "MLanguageXML.h"
+
+#if not defined(JAPI_HEADLESS)
 #include "MMenu.h"
+#endif
 
 #include <boost/bind.hpp>
 
@@ -419,10 +422,12 @@ MNamedRange::MNamedRange()
 
 // --------------------------------------------------------------------
 
+__thread uint32* MLanguage::sStyles = nil;
+__thread uint32* MLanguage::sOffsets = nil;
+__thread uint32 MLanguage::sLastStyleIndex = 0;
+
 MLanguage::MLanguage()
 	: mRecognizer(nil)
-	, mStyles(nil)
-	, mOffsets(nil)
 {
 }
 
@@ -507,22 +512,22 @@ MLanguage::StyleLine(
 	uint32				outStyles[],
 	uint32				outOffsets[])
 {
-	mStyles = outStyles;
-	mOffsets = outOffsets;
-	mLastStyleIndex = 0;
+	sStyles = outStyles;
+	sOffsets = outOffsets;
+	sLastStyleIndex = 0;
 	
-	if (mStyles and mOffsets)
+	if (sStyles and sOffsets)
 	{
-		mStyles[0] = 0;
-		mOffsets[0] = 0;
+		sStyles[0] = 0;
+		sOffsets[0] = 0;
 	}
 
 	StyleLine(inText, inOffset, inLength, ioStyle);
 
-	mStyles = nil;
-	mOffsets = nil;
+	sStyles = nil;
+	sOffsets = nil;
 	
-	return mLastStyleIndex + 1;
+	return sLastStyleIndex + 1;
 }
 
 void
@@ -530,15 +535,15 @@ MLanguage::SetStyle(
 	uint32				inOffset,
 	uint32				inStyle)
 {
-	if (mStyles != nil and mOffsets != nil)
+	if (sStyles != nil and sOffsets != nil)
 	{
-		if (mLastStyleIndex + 1 < kMaxStyles and inStyle != mStyles[mLastStyleIndex])
+		if (sLastStyleIndex + 1 < kMaxStyles and inStyle != sStyles[sLastStyleIndex])
 		{
-			if (inOffset > mOffsets[mLastStyleIndex])
-				++mLastStyleIndex;
+			if (inOffset > sOffsets[sLastStyleIndex])
+				++sLastStyleIndex;
 			
-			mStyles[mLastStyleIndex] = inStyle;
-			mOffsets[mLastStyleIndex] = inOffset;
+			sStyles[sLastStyleIndex] = inStyle;
+			sOffsets[sLastStyleIndex] = inOffset;
 		}
 	}
 }
@@ -600,6 +605,64 @@ MLanguage::IsKeyWord(
 	return result;
 }
 
+// ---------------------------------------------------------------------------
+//	ScanBrackets
+//
+//	Balancing used to start at the beginning of the text each time. Now the
+//	state of the scan is saved in the text buffer every so many bytes, the
+//	next scan continues from the last checkpoint before inEnd.
+
+namespace
+{
+const uint32 kBalanceCheckpointInterval = 16 * 1024;
+}
+
+MTextBuffer::const_iterator
+MLanguage::ScanBrackets(
+	const MTextBuffer&	inText,
+	uint32				inEnd,
+	MSkipFunc			inSkip,
+	MBalanceCheckpoint&	outOpen)
+{
+	if (inEnd > inText.GetSize())
+		inEnd = inText.GetSize();
+	
+	if (not inText.GetBalanceCheckpoint(this, inEnd, outOpen))
+	{
+		outOpen.offset = 0;
+		for (uint32 i = 0; i < 3; ++i)
+			outOpen.open[i].clear();
+	}
+	
+	MTextBuffer::const_iterator txt = inText.begin() + outOpen.offset;
+	uint32 next = (outOpen.offset / kBalanceCheckpointInterval + 1) * kBalanceCheckpointInterval;
+	
+	while (txt.GetOffset() < inEnd)
+	{
+		if (txt.GetOffset() >= next)
+		{
+			outOpen.offset = txt.GetOffset();
+			inText.AddBalanceCheckpoint(this, outOpen);
+			next = (outOpen.offset / kBalanceCheckpointInterval + 1) * kBalanceCheckpointInterval;
+		}
+		
+		switch (*txt)
+		{
+			case '{':	outOpen.open[0].push_back(txt.GetOffset());					break;
+			case '[':	outOpen.open[1].push_back(txt.GetOffset());					break;
+			case '(':	outOpen.open[2].push_back(txt.GetOffset());					break;
+			case '}':	if (not outOpen.open[0].empty()) outOpen.open[0].pop_back();	break;
+			case ']':	if (not outOpen.open[1].empty()) outOpen.open[1].pop_back();	break;
+			case ')':	if (not outOpen.open[2].empty()) outOpen.open[2].pop_back();	break;
+		}
+		txt = inSkip(txt + 1);
+	}
+	
+	outOpen.offset = txt.GetOffset();
+	
+	return txt;
+}
+
 bool
 MLanguage::IsBalanceChar(
 	wchar_t		inChar)
@@ -709,6 +772,7 @@ MLanguage::Parse(
 	outIncludeFiles.clear();
 }
 
+#if not defined(JAPI_HEADLESS)
 void
 MLanguage::GetParsePopupItems(
 	MNamedRange&		inRanges,
@@ -731,6 +795,7 @@ MLanguage::GetParsePopupItems(
 	for (uint32 i = 0; i < inRanges.subrange.size(); ++i)
 		GetParsePopupItems(inRanges.subrange[i], ns, inMenu, ioIndex);
 }
+#endif
 
 bool MLanguage::GetSelectionForParseItem(
 	const MNamedRange&	inRanges,
@@ -12,6 +12,7 @@
 #define LANGUAGE_H
 
 #include <vector>
+#include <stack>
 #include "MTypes.h"
 #include "MTextBuffer.h"
 
@@ -52,10 +53,13 @@ struct MIncludeFile
 {
 	std::string					name;
 	bool						isQuoted;
+	uint32						offset;		// of the include statement
 };
 
 struct MIncludeFileList : public std::vector<MIncludeFile> {};
 
+typedef std::stack<int32,std::vector<int32> >	MBracketStack;
+
 class MLanguage
 {
   public:
@@ -158,6 +162,17 @@ class MLanguage
 						MTextBuffer::const_iterator	inBegin,
 						MTextBuffer::const_iterator inEnd,
 						const char*					inString);
+
+	typedef MTextBuffer::const_iterator (*MSkipFunc)(MTextBuffer::const_iterator);
+
+	// collect the unmatched brackets before inEnd, inSkip moves past
+	// strings and comments. Returns the position where scanning stopped.
+	MTextBuffer::const_iterator
+					ScanBrackets(
+						const MTextBuffer&	inText,
+						uint32				inEnd,
+						MSkipFunc			inSkip,
+						MBalanceCheckpoint&	outOpen);
 	
 	// keyword support
 	
@@ -177,9 +192,11 @@ class MLanguage
 					mRecognizer;
 	uint32			mTag;
 	
-	uint32*			mStyles;
-	uint32*			mOffsets;
-	uint32			mLastStyleIndex;
+	// the style runs collected by StyleLine are kept per thread,
+	// documents are also styled in the threads of MStylePool
+	static __thread uint32*	sStyles;
+	static __thread uint32*	sOffsets;
+	static __thread uint32	sLastStyleIndex;
 };
 
 #endif // LANGUAGE_H
@@ -12,7 +12,7 @@
 
 #include "MLanguageCpp.h"
 #include "MTextBuffer.h"
-#include "MFile.h"
+#include "MFileName.h"
 
 #include <stack>
 
@@ -418,32 +418,13 @@ MLanguageCpp::Balance(
 	uint32&				ioOffset,
 	uint32&				ioLength)
 {
-	MTextPtr txt = inText.begin();
+	MBalanceCheckpoint open;
+	MTextPtr txt = ScanBrackets(inText, ioOffset + ioLength, &skip, open);
 	
-	uint32 size = inText.GetSize();
-	
-	stack<int32> bls, sbls, pls;
-
-	uint32 m = ioOffset + ioLength;
-	if (m > size)
-		m = size;
-	
-	while (txt.GetOffset() < m)
-	{
-		switch (*txt)
-		{
-			case '{':	bls.push(txt.GetOffset());			break;
-			case '[':	sbls.push(txt.GetOffset());			break;
-			case '(':	pls.push(txt.GetOffset());			break;
-			case '}':	if (not bls.empty()) bls.pop();		break;
-			case ']':	if (not sbls.empty()) sbls.pop();	break;
-			case ')':	if (not pls.empty()) pls.pop();		break;
-		}
-		txt = skip(txt + 1);
-	}
+	MBracketStack bls(open.open[0]), sbls(open.open[1]), pls(open.open[2]);
 	
 	char ec = 0, oc = 0;
-	stack<int32> *s = nil;
+	MBracketStack *s = nil;
 	
 	int db, dsb, dp;
 	
@@ -818,6 +799,7 @@ MLanguageCpp::ParsePreProcessor(
 	MIncludeFileList&	outIncludeFiles)
 {
 	string name;
+	uint32 offset = inText.GetOffset();
 
 	while (isspace(*inText))
 		++inText;
@@ -836,7 +818,7 @@ MLanguageCpp::ParsePreProcessor(
 			while (*inText and *inText != '"' and *inText != '\n')
 				name += *inText++;
 			
-			MIncludeFile file = { name, true };
+			MIncludeFile file = { name, true, offset };
 			outIncludeFiles.push_back(file);
 		}
 		else if (*inText == '<')
@@ -846,7 +828,7 @@ MLanguageCpp::ParsePreProcessor(
 			while (*inText and *inText != '>' and *inText != '\n')
 				name += *inText++;
 
-			MIncludeFile file = { name, false };
+			MIncludeFile file = { name, false, offset };
 			outIncludeFiles.push_back(file);
 		}
 	}
@@ -13,7 +13,7 @@
 #include "MLanguageHTML.h"
 #include "MTextBuffer.h"
 #include "MUnicode.h"
-#include "MFile.h"
+#include "MFileName.h"
 #include "MSelection.h"
 
 #include <stack>
@@ -14,7 +14,7 @@
 #include "MTextBuffer.h"
 #include "MSelection.h"
 #include "MUnicode.h"
-#include "MFile.h"
+#include "MFileName.h"
 
 #include <stack>
 #include <cassert>
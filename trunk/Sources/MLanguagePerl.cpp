@@ -14,7 +14,7 @@
 #include "MTextBuffer.h"
 #include "MSelection.h"
 #include "MUnicode.h"
-#include "MFile.h"
+#include "MFileName.h"
 
 #include <stack>
 #include <cassert>
@@ -960,26 +960,13 @@ MLanguagePerl::Balance(
 	uint32&				ioOffset,
 	uint32&				ioLength)
 {
-	MTextBuffer::const_iterator txt = inText.begin();
+	MBalanceCheckpoint open;
+	MTextBuffer::const_iterator txt = ScanBrackets(inText, ioOffset + ioLength, &skip, open);
 	
-	stack<int32> bls, sbls, pls;
-	
-	while (txt.GetOffset() < ioOffset + ioLength)
-	{
-		switch (*txt)
-		{
-			case '{':	bls.push(txt.GetOffset());			break;
-			case '[':	sbls.push(txt.GetOffset());			break;
-			case '(':	pls.push(txt.GetOffset());			break;
-			case '}':	if (not bls.empty()) bls.pop();		break;
-			case ']':	if (not sbls.empty()) sbls.pop();	break;
-			case ')':	if (not pls.empty()) pls.pop();		break;
-		}
-		txt = skip(txt + 1);
-	}
+	MBracketStack bls(open.open[0]), sbls(open.open[1]), pls(open.open[2]);
 	
 	char ec = 0, oc;
-	stack<int32> *s;
+	MBracketStack *s;
 	
 	int db, dsb, dp;
 	
@@ -13,7 +13,7 @@
 #include "MLanguageTeX.h"
 #include "MTextBuffer.h"
 #include "MUnicode.h"
-#include "MFile.h"
+#include "MFileName.h"
 
 #include <stack>
 #include <cassert>
@@ -340,24 +340,13 @@ MLanguageTeX::Balance(
 	uint32&				ioOffset,
 	uint32&				ioLength)
 {
-	MTextBuffer::const_iterator txt = inText.begin();
+	MBalanceCheckpoint open;
+	MTextBuffer::const_iterator txt = ScanBrackets(inText, ioOffset + ioLength, &skip, open);
 	
-	stack<int> bls, sbls;
-	
-	while (txt.GetOffset() < ioOffset + ioLength)
-	{
-		switch (*txt)
-		{
-			case '{':	bls.push(txt.GetOffset());			break;
-			case '[':	sbls.push(txt.GetOffset());			break;
-			case '}':	if (not bls.empty()) bls.pop();		break;
-			case ']':	if (not sbls.empty()) sbls.pop();	break;
-		}
-		txt = skip(txt + 1);
-	}
+	MBracketStack bls(open.open[0]), sbls(open.open[1]);
 	
 	char ec = 0, oc = 0;
-	stack<int> *s = NULL;
+	MBracketStack *s = NULL;
 	
 	int db, dsb;
 	
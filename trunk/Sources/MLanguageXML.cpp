@@ -13,8 +13,7 @@
 #include "MLanguageXML.h"
 #include "MTextBuffer.h"
 #include "MUnicode.h"
-#include "MFile.h"
-#include "MUtils.h"
+#include "MFileName.h"
 
 #include <stack>
 #include <cassert>
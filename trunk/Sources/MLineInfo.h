@@ -15,7 +15,7 @@ struct MLineInfo
 {
                     MLineInfo()
                     {
-                    	start = state = nl = marked = indent = diff = stmt = brkp = 0;
+                    	start = state = nl = marked = indent = diff = stmt = brkp = restyle = 0;
                     };
 
                     MLineInfo(
@@ -30,7 +30,8 @@ struct MLineInfo
                         , marked(false)
                         , diff(false)
                         , stmt(false)
-                        , brkp(false) {};
+                        , brkp(false)
+                        , restyle(false) {};
 
 	uint32			start;
 	uint16			state;
@@ -41,6 +42,7 @@ struct MLineInfo
 	bool			diff	: 1;
 	bool			stmt	: 1;		// can put a breakpoint here
 	bool			brkp	: 1;
+	bool			restyle	: 1;		// state of next line still to be done
 };
 
 typedef std::vector<MLineInfo> MLineInfoArray;
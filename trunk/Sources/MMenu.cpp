@@ -12,6 +12,7 @@
 #include <boost/iostreams/device/array.hpp>
 #include <boost/iostreams/stream.hpp>
 #include <boost/foreach.hpp>
+#include <boost/ptr_container/ptr_map.hpp>
 
 #include <zeep/xml/document.hpp>
 
@@ -35,6 +36,31 @@ namespace io = boost::iostreams;
 namespace
 {
 
+// menu definitions are parsed once, new windows reuse the parsed documents
+
+xml::document& GetMenuDocument(
+	const string&		inResourceName)
+{
+	typedef boost::ptr_map<string,xml::document> MMenuDocumentMap;
+	static MMenuDocumentMap sMenuDocuments;
+	
+	MMenuDocumentMap::iterator d = sMenuDocuments.find(inResourceName);
+	if (d == sMenuDocuments.end())
+	{
+		mrsrc::rsrc rsrc(string("Menus/") + inResourceName + ".xml");
+		
+		if (not rsrc)
+			THROW(("Menu resource not found: %s", inResourceName.c_str()));
+	
+		io::stream<io::array_source> data(rsrc.data(), rsrc.size());
+		
+		string key(inResourceName);
+		d = sMenuDocuments.insert(key, new xml::document(data)).first;
+	}
+	
+	return *d->second;
+}
+
 struct MCommandToString
 {
 	char mCommandString[10];
@@ -238,7 +264,7 @@ void MMenuItem::RecentItemActivated()
 
 		try
 		{
-			gApp->OpenOneDocument(url);
+			gApp->OpenOneDocument(url, true);
 		}
 		catch (exception& e)
 		{
@@ -279,14 +305,7 @@ MMenu* MMenu::CreateFromResource(
 {
 	MMenu* result = nil;
 	
-	mrsrc::rsrc rsrc(
-		string("Menus/") + inResourceName + ".xml");
-	
-	if (not rsrc)
-		THROW(("Menu resource not found: %s", inResourceName));
-
-	io::stream<io::array_source> data(rsrc.data(), rsrc.size());
-	xml::document doc(data);
+	xml::document& doc = GetMenuDocument(inResourceName);
 	
 	// build a menu from the resource XML
 	xml::element* root = doc.find_first("/menu");
@@ -662,13 +681,7 @@ void MMenubar::Initialize(
 	mGtkMenubar = inMBarWidget;
 	mOnButtonPressEvent.Connect(mGtkMenubar, "button-press-event");
 	
-	mrsrc::rsrc rsrc(string("Menus/") + inResourceName + ".xml");
-	
-	if (not rsrc)
-		THROW(("Menu resource not found: %s", inResourceName));
-
-	io::stream<io::array_source> data(rsrc.data(), rsrc.size());
-	xml::document doc(data);
+	xml::document& doc = GetMenuDocument(inResourceName);
 	
 	// build a menubar from the resource XML
 	foreach (xml::element* menu, doc.find("/menubar/menu"))
@@ -5,9 +5,10 @@
 
 #include "MJapi.h"
 
-#include <boost/regex.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string/trim.hpp>
 #include <cmath>
+#include <unordered_map>
 
 #include "MMessageWindow.h"
 #include "MDevice.h"
@@ -19,7 +20,6 @@
 #include "MStrings.h"
 #include "MError.h"
 #include "MJapiApp.h"
-#include "MList.h"
 #include "MTextController.h"
 #include "MTextView.h"
 
@@ -32,9 +32,6 @@ namespace
 const uint32
 	kListViewID = 'tree';
 	
-const double
-	kDelay = 0.333;
-
 const uint32
 	kDotWidth				= 8,
 	kIconColumnOffset		= 4,
@@ -100,6 +97,8 @@ struct MMessageItem
 
 typedef vector<MMessageItem*>	MMessageItemArray;
 typedef std::vector<MFile>		MFileTable;
+typedef unordered_map<string,uint32>
+								MFileIndex;
 
 enum
 {
@@ -111,66 +110,219 @@ enum
 	kColumnCount	
 };
 
-namespace MMsgColumns
-{
-	struct icon {};
-	struct file {};
-	struct line {};
-	struct msg {};
-}
-
-class MMessageRow
-	: public MListRow<
-			MMessageRow,
-			MMsgColumns::icon,			GdkPixbuf*,
-			MMsgColumns::file,			string,
-			MMsgColumns::line,			string,
-			MMsgColumns::msg,			string
-		>
-{
-  public:
-					MMessageRow(
-						MMessageItem*	inItem,
-						const string&	inFile)
-						: mItem(inItem)
-						, mFile(inFile)
-					{
-					}
-				
-	void			GetData(
-						const MMsgColumns::icon&,
-						GdkPixbuf*&		outIcon)
-					{
-						outIcon = GetBadge(mItem->mKind);
-					}
+// --------------------------------------------------------------------
+//	MMessageListModel
+//
+//	A flat GtkTreeModel on top of an MMessageList. Nothing is copied into
+//	the model, the cell contents are created when the view asks for them,
+//	and that is only for the rows that are visible. The iters simply
+//	contain the row number.
 
-	void			GetData(
-						const MMsgColumns::file&,
-						string&			outFile)
-					{
-						outFile = mFile;
-					}
+struct MMessageListModel
+{
+	GObject			parent;
+	MMessageList*	list;
+	uint32			count;		// the number of rows the view knows about
+	gint			stamp;
+};
 
-	void			GetData(
-						const MMsgColumns::line,
-						string&			outLine)
-					{
-						if (mItem->mLineNr > 0)
-							outLine = boost::lexical_cast<string>(mItem->mLineNr);
-					}
+struct MMessageListModelClass
+{
+	GObjectClass	parent_class;
+};
 
-	void			GetData(
-						const MMsgColumns::msg&,
-						string&			outMsg)
-					{
-						outMsg.assign(mItem->mMessage, mItem->mMessageLength);
-					}
+static void m_message_list_model_tree_model_init(
+	GtkTreeModelIface*	inIface);
 
-	virtual bool	RowDropPossible() const		{ return false; }
+G_DEFINE_TYPE_WITH_CODE(MMessageListModel, m_message_list_model, G_TYPE_OBJECT,
+	G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL, m_message_list_model_tree_model_init));
 
-	MMessageItem*	mItem;
-	string			mFile;
-};
+#define M_MESSAGE_LIST_MODEL(obj)	(G_TYPE_CHECK_INSTANCE_CAST((obj), m_message_list_model_get_type(), MMessageListModel))
+
+static void m_message_list_model_init(
+	MMessageListModel*	inModel)
+{
+	inModel->list = nil;
+	inModel->count = 0;
+	inModel->stamp = g_random_int();
+}
+
+static void m_message_list_model_class_init(
+	MMessageListModelClass*	inClass)
+{
+}
+
+static GtkTreeModelFlags m_message_list_model_get_flags(
+	GtkTreeModel*		inModel)
+{
+	return GtkTreeModelFlags(GTK_TREE_MODEL_LIST_ONLY | GTK_TREE_MODEL_ITERS_PERSIST);
+}
+
+static gint m_message_list_model_get_n_columns(
+	GtkTreeModel*		inModel)
+{
+	return kColumnCount;
+}
+
+static GType m_message_list_model_get_column_type(
+	GtkTreeModel*		inModel,
+	gint				inColumn)
+{
+	return inColumn == kIconColumn ? GDK_TYPE_PIXBUF : G_TYPE_STRING;
+}
+
+static gboolean m_message_list_model_get_iter(
+	GtkTreeModel*		inModel,
+	GtkTreeIter*		outIter,
+	GtkTreePath*		inPath)
+{
+	MMessageListModel* model = M_MESSAGE_LIST_MODEL(inModel);
+
+	if (gtk_tree_path_get_depth(inPath) != 1)
+		return false;
+	
+	gint row = gtk_tree_path_get_indices(inPath)[0];
+	if (row < 0 or static_cast<uint32>(row) >= model->count)
+		return false;
+	
+	outIter->stamp = model->stamp;
+	outIter->user_data = GUINT_TO_POINTER(row);
+	return true;
+}
+
+static GtkTreePath* m_message_list_model_get_path(
+	GtkTreeModel*		inModel,
+	GtkTreeIter*		inIter)
+{
+	GtkTreePath* path = gtk_tree_path_new();
+	gtk_tree_path_append_index(path, GPOINTER_TO_UINT(inIter->user_data));
+	return path;
+}
+
+static void m_message_list_model_get_value(
+	GtkTreeModel*		inModel,
+	GtkTreeIter*		inIter,
+	gint				inColumn,
+	GValue*				outValue)
+{
+	MMessageListModel* model = M_MESSAGE_LIST_MODEL(inModel);
+	MMessageItem& item = model->list->GetItem(GPOINTER_TO_UINT(inIter->user_data));
+
+	g_value_init(outValue, m_message_list_model_get_column_type(inModel, inColumn));
+
+	switch (inColumn)
+	{
+		case kIconColumn:
+			g_value_set_object(outValue, GetBadge(item.mKind));
+			break;
+		
+		case kFileColumn:
+			if (item.mFileNr > 0)
+				g_value_set_string(outValue, model->list->GetFile(item.mFileNr - 1).GetFileName().c_str());
+			break;
+		
+		case kLineColumn:
+			if (item.mLineNr > 0)
+				g_value_set_string(outValue, boost::lexical_cast<string>(item.mLineNr).c_str());
+			break;
+		
+		case kMsgColumn:
+			g_value_set_string(outValue, string(item.mMessage, item.mMessageLength).c_str());
+			break;
+	}
+}
+
+static gboolean m_message_list_model_iter_next(
+	GtkTreeModel*		inModel,
+	GtkTreeIter*		ioIter)
+{
+	MMessageListModel* model = M_MESSAGE_LIST_MODEL(inModel);
+	
+	uint32 row = GPOINTER_TO_UINT(ioIter->user_data) + 1;
+	if (row >= model->count)
+		return false;
+	
+	ioIter->user_data = GUINT_TO_POINTER(row);
+	return true;
+}
+
+static gboolean m_message_list_model_iter_nth_child(
+	GtkTreeModel*		inModel,
+	GtkTreeIter*		outIter,
+	GtkTreeIter*		inParent,
+	gint				inN)
+{
+	MMessageListModel* model = M_MESSAGE_LIST_MODEL(inModel);
+	
+	if (inParent != nil or inN < 0 or static_cast<uint32>(inN) >= model->count)
+		return false;
+	
+	outIter->stamp = model->stamp;
+	outIter->user_data = GUINT_TO_POINTER(inN);
+	return true;
+}
+
+static gboolean m_message_list_model_iter_children(
+	GtkTreeModel*		inModel,
+	GtkTreeIter*		outIter,
+	GtkTreeIter*		inParent)
+{
+	return m_message_list_model_iter_nth_child(inModel, outIter, inParent, 0);
+}
+
+static gboolean m_message_list_model_iter_has_child(
+	GtkTreeModel*		inModel,
+	GtkTreeIter*		inIter)
+{
+	return false;
+}
+
+static gint m_message_list_model_iter_n_children(
+	GtkTreeModel*		inModel,
+	GtkTreeIter*		inIter)
+{
+	return inIter == nil ? M_MESSAGE_LIST_MODEL(inModel)->count : 0;
+}
+
+static gboolean m_message_list_model_iter_parent(
+	GtkTreeModel*		inModel,
+	GtkTreeIter*		outIter,
+	GtkTreeIter*		inChild)
+{
+	return false;
+}
+
+static void m_message_list_model_tree_model_init(
+	GtkTreeModelIface*	inIface)
+{
+	inIface->get_flags = m_message_list_model_get_flags;
+	inIface->get_n_columns = m_message_list_model_get_n_columns;
+	inIface->get_column_type = m_message_list_model_get_column_type;
+	inIface->get_iter = m_message_list_model_get_iter;
+	inIface->get_path = m_message_list_model_get_path;
+	inIface->get_value = m_message_list_model_get_value;
+	inIface->iter_next = m_message_list_model_iter_next;
+	inIface->iter_children = m_message_list_model_iter_children;
+	inIface->iter_has_child = m_message_list_model_iter_has_child;
+	inIface->iter_n_children = m_message_list_model_iter_n_children;
+	inIface->iter_nth_child = m_message_list_model_iter_nth_child;
+	inIface->iter_parent = m_message_list_model_iter_parent;
+}
+
+// tell the view there's a new row at the end of the list
+static void m_message_list_model_row_appended(
+	MMessageListModel*	inModel)
+{
+	GtkTreeIter iter;
+	iter.stamp = inModel->stamp;
+	iter.user_data = GUINT_TO_POINTER(inModel->count);
+	
+	++inModel->count;
+	
+	GtkTreePath* path = m_message_list_model_get_path(GTK_TREE_MODEL(inModel), &iter);
+	gtk_tree_model_row_inserted(GTK_TREE_MODEL(inModel), path, &iter);
+	gtk_tree_path_free(path);
+}
 
 // --------------------------------------------------------------------
 
@@ -178,6 +330,7 @@ struct MMessageListImp
 {
 	MMessageItemArray	mArray;
 	MFileTable			mFileTable;
+	MFileIndex			mFileIndex;		// URI to file number, zero for files that do not exist
 	int32				mRefCount;
 };
 
@@ -233,13 +386,21 @@ void MMessageList::AddMessage(
 {
 	uint32 fileNr = 0;
 	
-	if (inFile.IsLocal() == false or fs::exists(inFile.GetPath()))
-	{
-		MFileTable::iterator f = find(mImpl->mFileTable.begin(), mImpl->mFileTable.end(), inFile);
-		if (f == mImpl->mFileTable.end())
-			f = mImpl->mFileTable.insert(f, inFile);
+	// files are interned by URI, so each of them is checked only once
+	string uri = inFile.GetURI();
 
-		fileNr = f - mImpl->mFileTable.begin() + 1;
+	MFileIndex::iterator f = mImpl->mFileIndex.find(uri);
+	if (f != mImpl->mFileIndex.end())
+		fileNr = f->second;
+	else
+	{
+		if (inFile.IsLocal() == false or fs::exists(inFile.GetPath()))
+		{
+			mImpl->mFileTable.push_back(inFile);
+			fileNr = mImpl->mFileTable.size();
+		}
+		
+		mImpl->mFileIndex[uri] = fileNr;
 	}
 	
 	mImpl->mArray.push_back(MMessageItem::Create(inKind, fileNr, inLine,
@@ -272,35 +433,38 @@ MMessageWindow::MMessageWindow(
 	bool			inShowFiles)
 	: MWindow("message-list-window")
 	, eBaseDirChanged(this, &MMessageWindow::SetBaseDirectory)
-	, eSelectMsg(this, &MMessageWindow::SelectMsg)
-	, eInvokeMsg(this, &MMessageWindow::InvokeMsg)
+	, mCursorChanged(this, &MMessageWindow::CursorChanged)
+	, mRowActivated(this, &MMessageWindow::RowActivated)
 	, mBaseDirectory("/")
-	, mLastAddition(0)
-	, mLastWasInFileIncluded(false)
 {
 	SetTitle(inTitle);
 	
-	mListView = new MList<MMessageRow>(GetWidget(kListViewID));
-	mListView->SetExpandColumn(kMsgColumn);
+	mTreeView = GetWidget(kListViewID);
+	
+	mModel = M_MESSAGE_LIST_MODEL(g_object_new(m_message_list_model_get_type(), nil));
+	mModel->list = &mList;
 	
-	AddRoute(static_cast<MList<MMessageRow>*>(mListView)->eRowSelected, eSelectMsg);
-	AddRoute(static_cast<MList<MMessageRow>*>(mListView)->eRowInvoked, eInvokeMsg);
+	gtk_tree_view_set_model(GTK_TREE_VIEW(mTreeView), GTK_TREE_MODEL(mModel));
 
-	mListView->SetReorderable(false);
+	mCursorChanged.Connect(mTreeView, "cursor-changed");
+	mRowActivated.Connect(mTreeView, "row-activated");
+
+	AddColumn(kIconColumn, "", kFileColumnOffset, 0);
 	
 	if (inShowFiles)
 	{
-		mListView->SetHeadersVisible(inShowFiles);
-		mListView->SetColumnTitle(kFileColumn, _("File"));
-		mListView->SetColumnTitle(kLineColumn, _("Line"));
-		mListView->SetColumnAlignment(kLineColumn, 1.0f);
-		mListView->SetColumnTitle(kMsgColumn, _("Message"));
+		gtk_tree_view_set_headers_visible(GTK_TREE_VIEW(mTreeView), true);
+		
+		AddColumn(kFileColumn, _("File"), kLineColumnOffset - kFileColumnOffset, 0);
+		AddColumn(kLineColumn, _("Line"), kMessageColumnOffset - kLineColumnOffset, 1.0f);
+		AddColumn(kMsgColumn, _("Message"), 0, 0);
 	}
 	else
-	{
-		mListView->RemoveColumn(kFileColumn);
-		mListView->RemoveColumn(kLineColumn);
-	}
+		AddColumn(kMsgColumn, "", 0, 0);
+
+	// all rows have the same height, let the view know
+	// so it does not have to measure each of them
+	gtk_tree_view_set_fixed_height_mode(GTK_TREE_VIEW(mTreeView), true);
 
 //	// ----------------------------------------------------------------
 //
@@ -370,6 +534,55 @@ MMessageWindow::MMessageWindow(
 	Show();
 }
 	
+MMessageWindow::~MMessageWindow()
+{
+	g_object_unref(mModel);
+}
+
+void MMessageWindow::AddColumn(
+	uint32				inColumnNr,
+	const char*			inTitle,
+	uint32				inWidth,
+	float				inAlignment)
+{
+	GtkCellRenderer* renderer;
+	GtkTreeViewColumn* column;
+	
+	if (inColumnNr == kIconColumn)
+	{
+		renderer = gtk_cell_renderer_pixbuf_new();
+		column = gtk_tree_view_column_new_with_attributes(inTitle, renderer, "pixbuf", inColumnNr, nil);
+	}
+	else
+	{
+		renderer = gtk_cell_renderer_text_new();
+		column = gtk_tree_view_column_new_with_attributes(inTitle, renderer, "text", inColumnNr, nil);
+	}
+	
+	g_object_set(G_OBJECT(renderer), "xalign", inAlignment, nil);
+	gtk_tree_view_column_set_alignment(column, inAlignment);
+
+	gtk_tree_view_column_set_sizing(column, GTK_TREE_VIEW_COLUMN_FIXED);
+	if (inWidth > 0)
+		gtk_tree_view_column_set_fixed_width(column, inWidth);
+	else
+		g_object_set(G_OBJECT(column), "expand", true, nil);
+
+	gtk_tree_view_append_column(GTK_TREE_VIEW(mTreeView), column);
+}
+
+// the list changed completely, detach the model while updating it
+// to avoid signalling each row to the view
+void MMessageWindow::ResetModel()
+{
+	gtk_tree_view_set_model(GTK_TREE_VIEW(mTreeView), nil);
+	
+	mModel->count = mList.GetCount();
+	++mModel->stamp;
+	
+	gtk_tree_view_set_model(GTK_TREE_VIEW(mTreeView), GTK_TREE_MODEL(mModel));
+}
+
 void MMessageWindow::AddMessage(
 	MMessageKind		inKind,
 	const MFile&		inFile,
@@ -383,17 +596,7 @@ void MMessageWindow::AddMessage(
 	
 	mList.AddMessage(inKind, inFile, inLine, inMinOffset, inMaxOffset, msg);
 
-	AddMessageToList(mList.GetItem(mList.GetCount() - 1));
-}
-
-void MMessageWindow::AddMessageToList(
-	MMessageItem&		inItem)
-{
-	string file;
-	if (inItem.mFileNr > 0)
-		file = mList.GetFile(inItem.mFileNr - 1).GetFileName();
-
-	mListView->AppendRow(new MMessageRow(&inItem, file), nil);
+	m_message_list_model_row_appended(mModel);
 }
 
 void MMessageWindow::SetMessages(
@@ -404,107 +607,41 @@ void MMessageWindow::SetMessages(
 	
 	mList = inItems;
 
-	for (uint32 ix = 0; ix < mList.GetCount(); ++ix)
-		AddMessageToList(mList.GetItem(ix));
+	ResetModel();
 }
 
 void MMessageWindow::SetBaseDirectory(
 	const fs::path&			inBaseDir)
 {
 	mBaseDirectory = inBaseDir;
+	mParser.SetBaseDirectory(inBaseDir);
 }
 
 void MMessageWindow::AddStdErr(
 	const char*			inText,
 	uint32				inSize)
 {
-	static const boost::regex
-		re1("^([^:]+):((\\d+):)?( (note|warning|(fatal )?error|fout):)?(.+)$"),
-		re2("^In file included from (.+?):(\\d+)[,:]$"),
-		re3("^\\s+from (.+?):(\\d+)[,:]$");
-		
-	mText.append(inText, inSize);
+	MDiagnosticList diagnostics;
+	mParser.Feed(inText, inSize, diagnostics);
+	
+	for (MDiagnosticList::iterator d = diagnostics.begin(); d != diagnostics.end(); ++d)
+		AddMessage(d->kind, MFile(d->file), d->line, 0, 0, d->message);
+}
 
-	if (mLastAddition + kDelay < GetLocalTime() or mText.find('\n') != string::npos)
-	{
-		string::size_type n;
-		
-		while ((n = mText.find('\n')) != string::npos)
-		{
-			string line = mText.substr(0, n);
-			mText.erase(0, n + 1);
-			
-			fs::path spec;
-			boost::smatch m;
-
-			if (boost::regex_match(line, m, re1))
-			{
-				string file = m[1];
-				string l_nr = m[3];
-				string warn = m[5];
-				
-				spec = mBaseDirectory / file;
-				
-				if (fs::exists(spec))
-				{
-					MMessageKind kind = kMsgKindNone;
-					if (not warn.empty())
-					{
-						if (warn == "error" or warn == "fout" or warn == "fatal error")
-							kind = kMsgKindError;
-						else if (warn == "warning")
-							kind = kMsgKindWarning;
-						else if (warn == "note")
-							kind = kMsgKindNote;
-					}
-					
-					uint32 lineNr = 0;
-					if (not l_nr.empty())
-						lineNr = boost::lexical_cast<uint32>(l_nr);
-
-					string mesg = spec.leaf() + ':' + m[2] + m[4] + m[7];
-					AddMessage(kind, MFile(spec), lineNr, 0, 0, mesg);
-					mLastWasInFileIncluded = false;
-					continue;
-				}
-			}
-			
-			if (boost::regex_match(line, m, re2) or
-				(mLastWasInFileIncluded and boost::regex_match(line, m, re3)))
-			{
-				mLastWasInFileIncluded = true;
-
-				string file = m[1];
-				string l_nr = m[2];
-
-				if (IsAbsolutePath(file))
-					spec = file;
-				else
-					spec = mBaseDirectory / file;
-
-				if (fs::exists(spec))
-				{
-					MMessageKind kind = kMsgKindNone;
-					uint32 lineNr = 0;
-					if (not l_nr.empty())
-						lineNr = boost::lexical_cast<uint32>(l_nr);
-					AddMessage(kind, MFile(spec), lineNr, 0, 0, line);
-					continue;
-				}
-			}
-
-			mLastWasInFileIncluded = true;
-			AddMessage(kMsgKindNone, MFile(spec), 0, 0, 0, line);
-		}
-		
-		mLastAddition = GetLocalTime();
-	}
+void MMessageWindow::FlushStdErr()
+{
+	MDiagnosticList diagnostics;
+	mParser.Flush(diagnostics);
+	
+	for (MDiagnosticList::iterator d = diagnostics.begin(); d != diagnostics.end(); ++d)
+		AddMessage(d->kind, MFile(d->file), d->line, 0, 0, d->message);
 }
 
 void MMessageWindow::ClearList()
 {
 	mList = MMessageList();
-	mListView->RemoveAll();
+	ResetModel();
+	mParser.Reset();
 }
 
 void MMessageWindow::DocumentChanged(
@@ -518,10 +655,28 @@ bool MMessageWindow::DoClose()
 	return MWindow::DoClose();
 }
 
+void MMessageWindow::CursorChanged()
+{
+	GtkTreePath* path;
+	gtk_tree_view_get_cursor(GTK_TREE_VIEW(mTreeView), &path, nil);
+	if (path != nil)
+	{
+		SelectMsg(mList.GetItem(gtk_tree_path_get_indices(path)[0]));
+		gtk_tree_path_free(path);
+	}
+}
+
+void MMessageWindow::RowActivated(
+	GtkTreePath*		inTreePath,
+	GtkTreeViewColumn*	inColumn)
+{
+	InvokeMsg(mList.GetItem(gtk_tree_path_get_indices(inTreePath)[0]));
+}
+
 void MMessageWindow::SelectMsg(
-	MMessageRow*	inItem)
+	MMessageItem&	inItem)
 {
-//	MMessageItem& item = *inItem->mItem;
+//	MMessageItem& item = inItem;
 //	
 //	if (item.mFileNr > 0)
 //	{
@@ -549,9 +704,9 @@ void MMessageWindow::SelectMsg(
 }
 
 void MMessageWindow::InvokeMsg(
-	MMessageRow*	inItem)
+	MMessageItem&	inItem)
 {
-	MMessageItem& item = *inItem->mItem;
+	MMessageItem& item = inItem;
 	
 	if (item.mFileNr > 0)
 	{
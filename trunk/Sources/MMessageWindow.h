@@ -9,18 +9,10 @@
 #include "MDocWindow.h"
 #include "MFile.h"
 #include "MCallbacks.h"
-
-enum MMessageKind
-{
-	kMsgKindNone,
-	kMsgKindNote,
-	kMsgKindWarning,
-	kMsgKindError
-};
+#include "MDiagnosticsParser.h"
 
 struct MMessageItem;
-struct MMessageRow;
-class MListBase;
+struct MMessageListModel;
 class MTextView;
 
 class MMessageList
@@ -64,12 +56,17 @@ class MMessageWindow : public MWindow
 					MMessageWindow(
 						const std::string&	inTitle,
 						bool				inShowFiles);
+
+	virtual			~MMessageWindow();
 	
 	void			ClearList();
 	
 	void			AddStdErr(
 						const char*			inText,
 						uint32				inSize);
+
+	// the process writing to stderr exited, parse its last line
+	void			FlushStdErr();
 	
 	MEventIn<void(const fs::path&)>
 					eBaseDirChanged;
@@ -98,24 +95,36 @@ class MMessageWindow : public MWindow
 						uint32				inMaxOffset,
 						const std::string&	inMessage);
 
-	void			AddMessageToList(
-						MMessageItem&		inItem);
+	void			AddColumn(
+						uint32				inColumnNr,
+						const char*			inTitle,
+						uint32				inWidth,
+						float				inAlignment);
+
+	void			ResetModel();
+
+	void			CursorChanged();
+	MSlot<void()>	mCursorChanged;
+
+	void			RowActivated(
+						GtkTreePath*		inTreePath,
+						GtkTreeViewColumn*	inColumn);
+	MSlot<void(GtkTreePath*,GtkTreeViewColumn*)>
+					mRowActivated;
 
 	void			SelectMsg(
-						MMessageRow*		inRow);
+						MMessageItem&		inItem);
 
 	void			InvokeMsg(
-						MMessageRow*		inRow);
-
-	MEventIn<void(MMessageRow*)>			eSelectMsg;
-	MEventIn<void(MMessageRow*)>			eInvokeMsg;
+						MMessageItem&		inItem);
 
-	MListBase*		mListView;
+	GtkWidget*		mTreeView;
+	MMessageListModel*
+					mModel;
 	fs::path		mBaseDirectory;
 	MMessageList	mList;
-	std::string		mText;
-	double			mLastAddition;
-	bool			mLastWasInFileIncluded;
+	MDiagnosticsParser
+					mParser;
 //	MTextView*		mTextView;
 //	GtkWidget*		mSelectionPanel;
 };
@@ -11,12 +11,17 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/bind.hpp>
 #include <boost/foreach.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/thread/mutex.hpp>
 #include <sstream>
+#include <map>
+#include <set>
 #include <fcntl.h>
 
 #include "MFile.h"
 #include "MPkgConfig.h"
 #include "MPreferences.h"
+#include "MGlobals.h"
 #include "MError.h"
 
 #define foreach BOOST_FOREACH
@@ -116,7 +121,9 @@ void LocateCommand(
 		THROW(("command not found: %s", outPath.string().c_str()));
 }
 
-static void RunCommand(
+// returns the exit status of the command, or -1 when it did not exit normally
+
+static int RunCommand(
 	const fs::path&		cmd,
 	char*				argv[],
 	string&				outResult,
@@ -195,6 +202,8 @@ static void RunCommand(
 	
 	int status;
 	waitpid(pid, &status, 0);	// avoid zombies
+	
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
 }
 
 void ParseString(
@@ -256,23 +265,332 @@ void ParseString(
 	}
 }
 
+// ---------------------------------------------------------------------------
+//	MPkgConfigCache
+//
+//	Calling pkg-config for each package every time a project is opened or
+//	a target is selected is expensive. The output of pkg-config is stored
+//	in a file in the preferences directory along with a stamp listing the
+//	.pc files involved (the package and everything it requires) and the
+//	search directories, each with its modification time. An entry is only
+//	used when the stamp still matches. Only the output of successful runs
+//	is kept, and the file is written once, when japi quits.
+
+class MPkgConfigCache
+{
+  public:
+	static MPkgConfigCache&
+					Instance();
+
+	void			GetResult(
+						const string&		inPackage,
+						const char*			inInfo,
+						string&				outResult);
+
+  private:
+					MPkgConfigCache();
+					~MPkgConfigCache();
+
+	void			Read();
+	void			Write();
+
+	void			GetSearchPath(
+						vector<fs::path>&	outDirs);
+
+	string			GetStamp(
+						const string&		inPackage);
+
+	void			AddToStamp(
+						const string&		inPackage,
+						const vector<fs::path>&
+											inDirs,
+						set<string>&		ioVisited,
+						ostream&			ioStamp);
+
+	struct MEntry
+	{
+		string			stamp;
+		string			result;
+	};
+
+	typedef map<string,MEntry>	MEntryMap;
+
+	boost::mutex	mMutex;
+	fs::path		mFile;
+	MEntryMap		mEntries;
+	bool			mDirty;
+	bool			mHaveDefaultPath;
+	string			mDefaultPath;
+};
+
+const char kPkgConfigCacheSignature[] = "japi pkg-config cache 2";
+
+MPkgConfigCache::MPkgConfigCache()
+	: mFile(gPrefsDir / "pkg-config.cache")
+	, mDirty(false)
+	, mHaveDefaultPath(false)
+{
+	Read();
 }
 
-void GetPkgConfigResult(
+MPkgConfigCache::~MPkgConfigCache()
+{
+	if (mDirty)
+		Write();
+}
+
+MPkgConfigCache& MPkgConfigCache::Instance()
+{
+	static MPkgConfigCache sInstance;
+	return sInstance;
+}
+
+void MPkgConfigCache::Read()
+{
+	try
+	{
+		fs::ifstream file(mFile);
+		
+		string line;
+		if (file.is_open() and getline(file, line) and line == kPkgConfigCacheSignature)
+		{
+			string key;
+			MEntry entry;
+
+			while (getline(file, key) and getline(file, entry.stamp) and getline(file, entry.result))
+				mEntries[key] = entry;
+		}
+	}
+	catch (exception& e)
+	{
+		cerr << "Exception reading pkg-config cache: " << e.what() << endl;
+		mEntries.clear();
+	}
+}
+
+void MPkgConfigCache::Write()
+{
+	try
+	{
+		if (not fs::exists(gPrefsDir))
+			fs::create_directories(gPrefsDir);
+		
+		fs::path tmp = mFile.string() + ".tmp";
+		
+		{
+			fs::ofstream file(tmp);
+			
+			if (not file.is_open())
+				return;
+			
+			file << kPkgConfigCacheSignature << endl;
+			
+			for (MEntryMap::iterator e = mEntries.begin(); e != mEntries.end(); ++e)
+				file << e->first << endl << e->second.stamp << endl << e->second.result << endl;
+		}
+		
+		fs::rename(tmp, mFile);
+	}
+	catch (exception& e)
+	{
+		cerr << "Exception writing pkg-config cache: " << e.what() << endl;
+	}
+}
+
+void MPkgConfigCache::GetSearchPath(
+	vector<fs::path>&	outDirs)
+{
+	// the built in search path of pkg-config, asked for only once
+	if (not mHaveDefaultPath)
+	{
+		fs::path cmd;
+		LocateCommand("pkg-config", cmd);
+		
+		MArgv args;
+		args.push_back(cmd.filename());
+		args.push_back("--variable=pc_path");
+		args.push_back("pkg-config");
+	
+		RunCommand(cmd, args, mDefaultPath, true);
+		ba::trim(mDefaultPath);
+		mHaveDefaultPath = true;
+	}
+	
+	string path;
+	
+	const char* PKG_CONFIG_PATH = getenv("PKG_CONFIG_PATH");
+	if (PKG_CONFIG_PATH != nil and *PKG_CONFIG_PATH != 0)
+		path = PKG_CONFIG_PATH;
+	
+	// PKG_CONFIG_LIBDIR replaces the built in path
+	string libdir = mDefaultPath;
+
+	const char* PKG_CONFIG_LIBDIR = getenv("PKG_CONFIG_LIBDIR");
+	if (PKG_CONFIG_LIBDIR != nil)
+		libdir = PKG_CONFIG_LIBDIR;
+	
+	if (not libdir.empty())
+	{
+		if (not path.empty())
+			path += ':';
+		path += libdir;
+	}
+	
+	vector<string> dirs;
+	ba::split(dirs, path, ba::is_any_of(":"));
+	
+	foreach (const string& dir, dirs)
+	{
+		if (not dir.empty())
+			outDirs.push_back(dir);
+	}
+}
+
+void MPkgConfigCache::AddToStamp(
+	const string&		inPackage,
+	const vector<fs::path>&
+						inDirs,
+	set<string>&		ioVisited,
+	ostream&			ioStamp)
+{
+	if (ioVisited.count(inPackage))
+		return;
+	
+	ioVisited.insert(inPackage);
+	
+	fs::path pc;
+	foreach (const fs::path& dir, inDirs)
+	{
+		if (fs::exists(dir / (inPackage + ".pc")))
+		{
+			pc = dir / (inPackage + ".pc");
+			break;
+		}
+	}
+	
+	if (pc.empty())
+	{
+		// the search directories are in the stamp too, so we
+		// will notice when this package is installed later on
+		ioStamp << inPackage << ".pc=none\t";
+		return;
+	}
+	
+	ioStamp << pc.string() << '=' << fs::last_write_time(pc) << '\t';
+	
+	// the flags depend on the .pc files of required packages as well
+	fs::ifstream file(pc);
+	string line;
+	
+	while (getline(file, line))
+	{
+		if (not ba::starts_with(line, "Requires:") and not ba::starts_with(line, "Requires.private:"))
+			continue;
+		
+		line.erase(0, line.find(':') + 1);
+		
+		vector<string> words;
+		ba::split(words, line, ba::is_any_of(" \t,"), ba::token_compress_on);
+		
+		foreach (const string& word, words)
+		{
+			// skip version constraints like '>= 2.10'
+			if (word.empty() or not (isalpha(word[0]) or word[0] == '_'))
+				continue;
+			
+			AddToStamp(word, inDirs, ioVisited, ioStamp);
+		}
+	}
+}
+
+string MPkgConfigCache::GetStamp(
+	const string&		inPackage)
+{
+	vector<fs::path> dirs;
+	GetSearchPath(dirs);
+	
+	stringstream stamp;
+
+	foreach (const fs::path& dir, dirs)
+	{
+		if (fs::is_directory(dir))
+			stamp << dir.string() << '=' << fs::last_write_time(dir) << '\t';
+	}
+	
+	set<string> visited;
+	
+	vector<string> packages;
+	ba::split(packages, inPackage, ba::is_any_of(" \t,"), ba::token_compress_on);
+	
+	foreach (const string& package, packages)
+	{
+		if (not package.empty())
+			AddToStamp(package, dirs, visited, stamp);
+	}
+	
+	return stamp.str();
+}
+
+void MPkgConfigCache::GetResult(
 	const string&		inPackage,
 	const char*			inInfo,
-	vector<string>&		outFlags)
+	string&				outResult)
 {
-	fs::path cmd;
-	LocateCommand("pkg-config", cmd);
+	boost::mutex::scoped_lock lock(mMutex);
+	
+	string key = inPackage + '\t' + inInfo;
+
+	// the environment variables that change the outcome of pkg-config
+	const char* kVariables[] = { "PKG_CONFIG_PATH", "PKG_CONFIG_LIBDIR", "PKG_CONFIG_SYSROOT_DIR" };
+	foreach (const char* variable, kVariables)
+	{
+		const char* value = getenv(variable);
+		key = key + '\t' + (value != nil ? value : "");
+	}
+	
+	string stamp = GetStamp(inPackage);
+	
+	MEntryMap::iterator e = mEntries.find(key);
+	if (e != mEntries.end() and e->second.stamp == stamp)
+		outResult = e->second.result;
+	else
+	{
+		fs::path cmd;
+		LocateCommand("pkg-config", cmd);
+		
+		MArgv args;
+		args.push_back(cmd.filename());
+		args.push_back(inInfo);
+		args.push_back(inPackage);
 	
-	MArgv args;
-	args.push_back(cmd.filename());
-	args.push_back(inInfo);
-	args.push_back(inPackage);
+		// errors are not flags, and a failed run is not cached
+		int status = RunCommand(cmd, args, outResult, true);
+		
+		// the cache file is line based
+		ba::replace_all(outResult, "\n", " ");
+		ba::trim(outResult);
+		
+		if (status == 0)
+		{
+			MEntry& entry = mEntries[key];
+			entry.stamp = stamp;
+			entry.result = outResult;
+			mDirty = true;
+		}
+		else if (mEntries.erase(key) > 0)
+			mDirty = true;
+	}
+}
+
+}
 
+void GetPkgConfigResult(
+	const string&		inPackage,
+	const char*			inInfo,
+	vector<string>&		outFlags)
+{
 	string s;
-	RunCommand(cmd, args, s);
+	MPkgConfigCache::Instance().GetResult(inPackage, inInfo, s);
 
 	ParseString(s, outFlags);
 
@@ -16,12 +16,16 @@
 #include <map>
 
 #include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/serialization/serialization.hpp>
+#include <boost/serialization/nvp.hpp>
 #include <cstring>
 
 #include "MTypes.h"
 #include "MPreferences.h"
+
+#if not defined(JAPI_HEADLESS)
 #include "MGlobals.h"
 
 #include <zeep/xml/document.hpp>
@@ -29,8 +33,10 @@
 #include <zeep/xml/serialize.hpp>
 #include <zeep/xml/writer.hpp>
 
-using namespace std;
 namespace xml = zeep::xml;
+#endif
+
+using namespace std;
 namespace fs = boost::filesystem;
 
 namespace Preferences
@@ -80,8 +86,12 @@ class IniFile
 					mPrefs;
 };
 
+// The headless engine library never reads or writes the settings file,
+// every preference there keeps its default value.
+
 IniFile::IniFile()
 {
+#if not defined(JAPI_HEADLESS)
 	try
 	{
 		SOAP_XML_SET_STRUCT_NAME(preference);
@@ -112,10 +122,12 @@ IniFile::IniFile()
 	{
 		cerr << "Exception reading preferences: " << e.what() << endl;		
 	}
+#endif
 }
 
 IniFile::~IniFile()
 {
+#if not defined(JAPI_HEADLESS)
 	try
 	{
 		if (not fs::exists(gPrefsDir))
@@ -153,6 +165,7 @@ IniFile::~IniFile()
 		PRINT(("Exception writing prefs file: %s", e.what()));
 	}
 	catch (...) {}
+#endif
 }
 
 IniFile& IniFile::Instance()
@@ -10,6 +10,7 @@
 #include "MDocument.h"
 #include "MDevice.h"
 #include "MError.h"
+#include "MAlerts.h"
 
 using namespace std;
 
@@ -18,7 +19,8 @@ GtkPageSetup*		MPrinter::sPageSetup;
 
 MPrinter::MPrinter(
 	MView*		inView)
-	: mBeginPrint(this, &MPrinter::OnBeginPrint)
+	: mPaginate(this, &MPrinter::OnPaginate)
+	, mEndPrint(this, &MPrinter::OnEndPrint)
 	, mDrawPage(this, &MPrinter::OnDrawPage)
 	, mPrint(gtk_print_operation_new())
 	, mPrintedView(inView)
@@ -29,7 +31,8 @@ MPrinter::MPrinter(
 //	if (sPageSetup != nil)
 //		gtk_print_operation_set_default_page_setup(mPrint, sPageSetup);
 	
-	mBeginPrint.Connect(G_OBJECT(mPrint), "begin-print");
+	mPaginate.Connect(G_OBJECT(mPrint), "paginate");
+	mEndPrint.Connect(G_OBJECT(mPrint), "end-print");
 	mDrawPage.Connect(G_OBJECT(mPrint), "draw-page");
 }
 
@@ -82,21 +85,55 @@ void MPrinter::DoPrint()
 	}
 }
 
-void MPrinter::OnBeginPrint(
+// paginate is emitted from the main loop until it returns true,
+// the view lays out a part of its contents each time
+
+bool MPrinter::OnPaginate(
 	GtkPrintContext*	inContext)
 {
-	MRect update = GetPrintBounds(inContext);
-	MDevice dev(inContext, update, 0);
-	gtk_print_operation_set_n_pages(mPrint, mPrintedView->CountPages(dev));
+	bool result = true;
+	
+	try
+	{
+		MRect update = GetPrintBounds(inContext);
+		MDevice dev(inContext, update, 0);
+		
+		uint32 pages = 0;
+		result = mPrintedView->Paginate(dev, pages);
+		
+		if (result)
+			gtk_print_operation_set_n_pages(mPrint, pages);
+	}
+	catch (exception& e)
+	{
+		DisplayError(e);
+		gtk_print_operation_cancel(mPrint);
+	}
+	
+	return result;
+}
+
+void MPrinter::OnEndPrint(
+	GtkPrintContext*	inContext)
+{
+	mPrintedView->EndPrint();
 }
 
 void MPrinter::OnDrawPage(
 	GtkPrintContext*	inContext,
 	int32				inPage)
 {
-	MRect update = GetPrintBounds(inContext);
-	MDevice dev(inContext, update, inPage);
-	mPrintedView->Draw(dev, update);
+	try
+	{
+		MRect update = GetPrintBounds(inContext);
+		MDevice dev(inContext, update, inPage);
+		mPrintedView->Draw(dev, update);
+	}
+	catch (exception& e)
+	{
+		DisplayError(e);
+		gtk_print_operation_cancel(mPrint);
+	}
 }
 
 MRect MPrinter::GetPrintBounds(
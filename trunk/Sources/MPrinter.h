@@ -27,9 +27,13 @@ class MPrinter
 	MRect			GetPrintBounds(
 						GtkPrintContext*	inContext);
 
-	void			OnBeginPrint(
+	bool			OnPaginate(
 						GtkPrintContext*	inContext);
-	MSlot<void(GtkPrintContext*)>			mBeginPrint;
+	MSlot<bool(GtkPrintContext*)>			mPaginate;
+
+	void			OnEndPrint(
+						GtkPrintContext*	inContext);
+	MSlot<void(GtkPrintContext*)>			mEndPrint;
 
 	void			OnDrawPage(
 						GtkPrintContext*	inContext,
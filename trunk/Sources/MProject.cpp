@@ -7,6 +7,8 @@
 
 #include <sstream>
 #include <limits>
+#include <map>
+#include <set>
 
 #undef check
 #ifndef BOOST_DISABLE_ASSERTS
@@ -42,6 +44,8 @@
 #include "MError.h"
 #include "MTextDocument.h"
 #include "MJapiApp.h"
+#include "MSymbolIndex.h"
+#include "MTrace.h"
 
 using namespace std;
 namespace xml = zeep::xml;
@@ -78,6 +82,149 @@ MTargetCPU GetNativeCPU()
 
 #pragma mark -
 
+// ---------------------------------------------------------------------------
+//	MSearchPathCache
+//
+//	LocateFile looks for files in quite a few directories. Instead of asking
+//	the file system for each candidate we keep the contents of the
+//	directories searched. A directory is checked again for changes using its
+//	modification time, but not more often than every kRecheckDelay seconds.
+//	Results of LocateFile, including failures, are kept for that long too.
+
+class MSearchPathCache
+{
+  public:
+	bool			Exists(
+						const fs::path&		inPath);
+
+	bool			Lookup(
+						const string&		inFile,
+						bool				inSearchUserPaths,
+						bool&				outFound,
+						fs::path&			outPath);
+
+	void			Store(
+						const string&		inFile,
+						bool				inSearchUserPaths,
+						bool				inFound,
+						const fs::path&		inPath);
+
+	void			Clear();
+
+  private:
+
+	struct MDirectory
+	{
+		time_t			modTime;
+		double			checked;
+		set<string>		entries;
+	};
+
+	struct MResult
+	{
+		bool			found;
+		fs::path		path;
+		double			checked;
+	};
+
+	typedef map<string,MDirectory>				MDirectoryMap;
+	typedef map<pair<string,bool>,MResult>		MResultMap;
+
+	static const double	kRecheckDelay;
+
+	MDirectoryMap	mDirectories;
+	MResultMap		mResults;
+};
+
+const double MSearchPathCache::kRecheckDelay = 2.0;
+
+bool MSearchPathCache::Exists(
+	const fs::path&		inPath)
+{
+	string dir = inPath.parent_path().string();
+	double now = GetLocalTime();
+
+	MDirectoryMap::iterator d = mDirectories.find(dir);
+	
+	if (d == mDirectories.end() or d->second.checked + kRecheckDelay < now)
+	{
+		time_t modTime = -1;
+		
+		try
+		{
+			if (fs::is_directory(dir))
+				modTime = fs::last_write_time(dir);
+		}
+		catch (...) {}
+		
+		if (d == mDirectories.end() or d->second.modTime != modTime)
+		{
+			if (d != mDirectories.end())
+				mResults.clear();	// contents changed, results may be wrong now
+			
+			MDirectory& directory = mDirectories[dir];
+			directory.modTime = modTime;
+			directory.entries.clear();
+			
+			try
+			{
+				if (modTime != -1)
+				{
+					for (fs::directory_iterator e(dir); e != fs::directory_iterator(); ++e)
+						directory.entries.insert(e->path().filename());
+				}
+			}
+			catch (...) {}
+			
+			d = mDirectories.find(dir);
+		}
+		
+		d->second.checked = now;
+	}
+	
+	return d->second.entries.count(inPath.filename()) > 0;
+}
+
+bool MSearchPathCache::Lookup(
+	const string&		inFile,
+	bool				inSearchUserPaths,
+	bool&				outFound,
+	fs::path&			outPath)
+{
+	bool result = false;
+	
+	MResultMap::iterator r = mResults.find(make_pair(inFile, inSearchUserPaths));
+	if (r != mResults.end() and r->second.checked + kRecheckDelay >= GetLocalTime())
+	{
+		outFound = r->second.found;
+		if (outFound)
+			outPath = r->second.path;
+		result = true;
+	}
+	
+	return result;
+}
+
+void MSearchPathCache::Store(
+	const string&		inFile,
+	bool				inSearchUserPaths,
+	bool				inFound,
+	const fs::path&		inPath)
+{
+	MResult& result = mResults[make_pair(inFile, inSearchUserPaths)];
+	result.found = inFound;
+	result.path = inPath;
+	result.checked = GetLocalTime();
+}
+
+void MSearchPathCache::Clear()
+{
+	mDirectories.clear();
+	mResults.clear();
+}
+
+#pragma mark -
+
 // ---------------------------------------------------------------------------
 //	MProject
 
@@ -105,6 +252,7 @@ MProject::MProject(
 	, mAllowWindows(true)
 	, mCurrentTarget(numeric_limits<uint32>::max())	// force an update at first 
 	, mCurrentJob(nil)
+	, mSearchPathCache(new MSearchPathCache)
 {
 	if (gApp != nil)
 		AddRoute(gApp->eIdle, ePoll);
@@ -173,6 +321,28 @@ void MProject::RecheckFiles()
 	}
 }
 
+// ---------------------------------------------------------------------------
+//	MProject::FileSaved
+
+void MProject::FileSaved(
+	const fs::path&		inFile)
+{
+	MDocument* doc = GetFirstDocument();
+	
+	while (doc != nil)
+	{
+		MProject* project = dynamic_cast<MProject*>(doc);
+
+		if (project != nil and project->mSymbolIndex.get() != nil and
+			(project->IsFileInProject(inFile) or project->mSymbolIndex->Contains(inFile)))
+		{
+			project->mSymbolIndex->Update(inFile);
+		}
+		
+		doc = doc->GetNextDocument();
+	}
+}
+
 // ---------------------------------------------------------------------------
 //	MProject::ReadPaths
 
@@ -767,12 +937,20 @@ void MProject::WriteFile(
 void MProject::Poll(
 	double		inSystemTime)
 {
+	MTraceScope trace("project", "Poll");
+
+	if (mSymbolIndex.get() != nil)
+		mSymbolIndex->Poll();
+
 	if (mCurrentJob.get() != nil)
 	{
 		try
 		{
 			if (mCurrentJob->IsDone())
 			{
+				if (mStdErrWindow != nil)
+					mStdErrWindow->FlushStdErr();
+
 				if (mCurrentJob->mStatus == 0)
 					PlaySound("success");
 				else
@@ -840,6 +1018,9 @@ bool MProject::LocateFile(
 {
 	bool found = false;
 
+	if (mSearchPathCache->Lookup(inFile, inSearchUserPaths, found, outPath))
+		return found;
+
 	// search library files in libpath	
 	if (FileNameMatches("*.a;*.so;*.dylib", inFile))
 	{
@@ -852,7 +1033,7 @@ bool MProject::LocateFile(
 			else
 				outPath = mProjectDir / *p / inFile;
 
-			found = exists(outPath);
+			found = mSearchPathCache->Exists(outPath);
 		}
 		
 		if (not found)
@@ -862,7 +1043,7 @@ bool MProject::LocateFile(
 				 ++p)
 			{
 				outPath = *p / inFile;
-				found = exists(outPath);
+				found = mSearchPathCache->Exists(outPath);
 			}
 		}
 
@@ -883,7 +1064,7 @@ bool MProject::LocateFile(
 				 ++p)
 			{
 				outPath = *p / file;
-				found = exists(outPath);
+				found = mSearchPathCache->Exists(outPath);
 			}
 		}
 	}
@@ -900,7 +1081,7 @@ bool MProject::LocateFile(
 				else
 					outPath = mProjectDir / *p / inFile;
 
-				found = exists(outPath);
+				found = mSearchPathCache->Exists(outPath);
 			}
 		}
 
@@ -909,7 +1090,7 @@ bool MProject::LocateFile(
 			 ++p)
 		{
 			outPath = *p / inFile;
-			found = exists(outPath);
+			found = mSearchPathCache->Exists(outPath);
 		}
 		
 		for (vector<string>::const_iterator f = mPkgConfigCFlags.begin();
@@ -919,26 +1100,28 @@ bool MProject::LocateFile(
 			if (f->length() > 2 and f->substr(0, 2) == "-I")
 			{
 				outPath = fs::path(f->substr(2)) / inFile;
-				found = exists(outPath);
+				found = mSearchPathCache->Exists(outPath);
 			}
 		}
 		
-		if (not found and fs::exists(mCppIncludeDir))
+		if (not found and not mCppIncludeDir.empty())
 		{
 			outPath = fs::path(mCppIncludeDir) / inFile;
-			found = fs::exists(outPath);
+			found = mSearchPathCache->Exists(outPath);
 		}
 
-		if (not found and fs::exists(mSysIncludeDir))
+		if (not found and not mSysIncludeDir.empty())
 		{
 			outPath = fs::path(mSysIncludeDir) / inFile;
-			found = fs::exists(outPath);
+			found = mSearchPathCache->Exists(outPath);
 		}
 	}
 	
 	if (found)
 		NormalizePath(outPath);
 	
+	mSearchPathCache->Store(inFile, inSearchUserPaths, found, outPath);
+	
 	return found;
 }
 
@@ -969,6 +1152,43 @@ void MProject::GetIncludePaths(
 	}
 }
 
+// ---------------------------------------------------------------------------
+//	MProject::UpdateSymbolIndex
+
+void MProject::UpdateSymbolIndex()
+{
+	if (mSymbolIndex.get() == nil)
+		mSymbolIndex.reset(new MSymbolIndex(mProjectDataDir / "Symbols.idx"));
+	
+	vector<fs::path> includePaths;
+	GetIncludePaths(includePaths);
+	mSymbolIndex->SetIncludePaths(includePaths);
+	
+	vector<MProjectItem*> items;
+	mProjectItems.Flatten(items);
+	
+	vector<fs::path> files;
+	for (vector<MProjectItem*>::iterator item = items.begin(); item != items.end(); ++item)
+	{
+		MProjectFile* file = dynamic_cast<MProjectFile*>(*item);
+		if (file != nil)
+			files.push_back(file->GetPath());
+	}
+	
+	mSymbolIndex->Update(files);
+}
+
+// ---------------------------------------------------------------------------
+//	MProject::FindSymbol
+
+void MProject::FindSymbol(
+	const string&				inName,
+	vector<MSymbolLocation>&	outLocations) const
+{
+	if (mSymbolIndex.get() != nil)
+		mSymbolIndex->Find(inName, outLocations);
+}
+
 // ---------------------------------------------------------------------------
 //	MProject::CheckDataDir
 
@@ -1612,6 +1832,8 @@ void MProject::SelectTarget(
 		}
 	}
 	
+	mSearchPathCache->Clear();
+	
 	ResearchForFiles();
 	
 	SetStatus("", false);
@@ -1663,6 +1885,7 @@ void MProject::ResearchForFiles()
 	mProjectItems.UpdatePaths(mObjectDir);
 	
 	CheckIsOutOfDate();
+	UpdateSymbolIndex();
 }
 
 // ---------------------------------------------------------------------------
@@ -16,6 +16,9 @@
 class MWindow;
 class MMessageWindow;
 class MProjectJob;
+class MSymbolIndex;
+class MSearchPathCache;
+struct MSymbolLocation;
 
 enum MProjectListPanel
 {
@@ -133,6 +136,9 @@ class MProject : public MDocument
 
 	static void			RecheckFiles();
 
+	static void			FileSaved(
+							const fs::path&		inFile);
+
 	MMessageWindow*		GetMessageWindow();
 
 	void				StopBuilding();
@@ -169,6 +175,15 @@ class MProject : public MDocument
 							std::vector<fs::path>&
 												outPaths) const;
 
+	void				UpdateSymbolIndex();
+
+	MSymbolIndex*		GetSymbolIndex() const			{ return mSymbolIndex.get(); }
+
+	void				FindSymbol(
+							const std::string&	inName,
+							std::vector<MSymbolLocation>&
+												outLocations) const;
+
 	void				SetStatus(
 							const std::string&	inStatus,
 							bool				inBusy);
@@ -322,6 +337,10 @@ class MProject : public MDocument
 	uint32						mCurrentTarget;
 	std::unique_ptr<MProjectJob>
 								mCurrentJob;
+	std::unique_ptr<MSymbolIndex>
+								mSymbolIndex;
+	std::unique_ptr<MSearchPathCache>
+								mSearchPathCache;
 	
 	// version, used when importing older versions of project files
 	float						mVersion;
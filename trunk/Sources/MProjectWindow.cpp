@@ -489,7 +489,7 @@ void MProjectWindow::InvokeFileRow(
 	if (file != nil)
 	{
 		fs::path p = file->GetPath();
-		gApp->OpenOneDocument(MFile(p));
+		gApp->OpenOneDocument(MFile(p), true);
 	}
 	else
 	{
@@ -576,7 +576,7 @@ void MProjectWindow::InvokeRsrcRow(
 		}
 
 		if (openSelf)
-			gApp->OpenOneDocument(MFile(p));
+			gApp->OpenOneDocument(MFile(p), true);
 	}
 }
 
@@ -24,6 +24,8 @@ using namespace std;
 const mrsrc::rsrc_imp gResourceIndex[0] = {};
 const char gResourceData[] = "\0\0\0\0";
 const char gResourceName[] = "\0\0\0\0";
+const mrsrc::rsrc_hash_imp gResourceHash[1] = {};
+const unsigned int gResourceHashSize = 0;
 #endif
 
 // --------------------------------------------------------------------
@@ -38,6 +40,17 @@ struct MResourceFileImp
 					fs::path	inPath,
 					const char*	inData,
 					uint32		inSize);
+
+	void		AddHashEntries(
+					uint32		inNode,
+					const string&
+								inPath,
+					vector<mrsrc::rsrc_hash_imp>&
+								ioHash);
+	
+	void		BuildHash(
+					vector<mrsrc::rsrc_hash_imp>&
+								outHash);
 };
 
 MResourceFile::MResourceFile(
@@ -128,6 +141,58 @@ void MResourceFileImp::AddEntry(
 		m_data.push_back('\0');
 }
 
+// --------------------------------------------------------------------
+//	AddHashEntries, add the children of inNode to the hash table,
+//	the full paths are appended to the name table.
+
+void MResourceFileImp::AddHashEntries(
+	uint32			inNode,
+	const string&	inPath,
+	vector<mrsrc::rsrc_hash_imp>&
+					ioHash)
+{
+	uint32 mask = ioHash.size() - 1;
+	
+	for (uint32 node = m_index[inNode].m_child; node != 0; node = m_index[node].m_next)
+	{
+		string path = inPath + (&m_name[0] + m_index[node].m_name);
+		
+		mrsrc::rsrc_hash_imp e;
+		e.m_hash = mrsrc::rsrc_hash(path.c_str());
+		e.m_path = m_name.size();
+		e.m_node = node;
+		
+		copy(path.begin(), path.end(), back_inserter(m_name));
+		m_name.push_back(0);
+		
+		uint32 slot = e.m_hash & mask;
+		while (ioHash[slot].m_node != 0)
+			slot = (slot + 1) & mask;
+		ioHash[slot] = e;
+		
+		AddHashEntries(node, path + '/', ioHash);
+	}
+}
+
+// --------------------------------------------------------------------
+//	BuildHash, an open addressing table at most half full
+
+void MResourceFileImp::BuildHash(
+	vector<mrsrc::rsrc_hash_imp>&
+					outHash)
+{
+	uint32 size = 1;
+	while (size < 2 * m_index.size())
+		size <<= 1;
+	
+	mrsrc::rsrc_hash_imp empty = {};
+	outHash.assign(size, empty);
+	
+	AddHashEntries(0, "", outHash);
+}
+
+// --------------------------------------------------------------------
+
 void MResourceFile::Add(
 	const string&	inPath,
 	const void*		inData,
@@ -165,6 +230,10 @@ void MResourceFile::Write(
 {
 	MObjectFile obj(mImpl->mTarget);
 
+	vector<mrsrc::rsrc_hash_imp> hash;
+	mImpl->BuildHash(hash);
+	uint32 hashSize = hash.size();
+
 	obj.AddGlobal("gResourceIndex",
 		&mImpl->m_index[0], mImpl->m_index.size() * sizeof(mrsrc::rsrc_imp));
 
@@ -174,6 +243,12 @@ void MResourceFile::Write(
 	obj.AddGlobal("gResourceName",
 		&mImpl->m_name[0], mImpl->m_name.size());
 	
+	obj.AddGlobal("gResourceHash",
+		&hash[0], hash.size() * sizeof(mrsrc::rsrc_hash_imp));
+	
+	obj.AddGlobal("gResourceHashSize",
+		&hashSize, sizeof(hashSize));
+	
 	obj.Write(inFile);
 }
 
@@ -13,9 +13,34 @@
 #include <cassert>
 
 #include "MSelection.h"
-#include "MTextDocument.h"
 #include "MError.h"
 
+#if defined(JAPI_HEADLESS)
+
+// The engine library has no documents, the selections it uses are plain
+// offsets into a text buffer. Anything that needs line information fails.
+
+class MTextDocument
+{
+  public:
+	uint32			OffsetToColumn(
+						uint32			inOffset) const		{ THROW(("Selection has no document")); }
+
+	uint32			LineAndColumnToOffset(
+						uint32			inLine,
+						uint32			inColumn) const		{ THROW(("Selection has no document")); }
+
+	uint32			OffsetToLine(
+						uint32			inOffset) const		{ THROW(("Selection has no document")); }
+
+	uint32			LineStart(
+						uint32			inLine) const		{ THROW(("Selection has no document")); }
+};
+
+#else
+#include "MTextDocument.h"
+#endif
+
 using namespace std;
 
 inline
@@ -0,0 +1,1067 @@
+//          Copyright Maarten L. Hekkelman 2006-2008
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "MJapi.h"
+
+#include <set>
+#include <map>
+#include <deque>
+#include <cstdio>
+#include <cstring>
+
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include "MSymbolIndex.h"
+#include "MTextBuffer.h"
+#include "MGlobals.h"
+#include "MError.h"
+
+using namespace std;
+namespace io = boost::iostreams;
+
+namespace
+{
+
+const uint32
+	kSymbolIndexMagic = 'SymX',
+	kSymbolIndexVersion = 1,
+	kNoString = ~0U;
+
+// The layout of the index file is:
+//
+//	header
+//	file records, sorted by path
+//	symbol records, grouped per file
+//	symbol numbers, sorted by symbol name
+//	include records, grouped per file
+//	string pool, zero terminated strings
+//
+// Everything is stored in native byte order, the magic number
+// takes care of detecting files written on another machine.
+
+struct MSymbolIndexHeader
+{
+	uint32			magic;
+	uint32			version;
+	uint32			fileCount;
+	uint32			symbolCount;
+	uint32			includeCount;
+	uint32			stringSize;
+};
+
+struct MSymbolFileRec
+{
+	int64			modTime;
+	uint32			path;
+	uint32			firstSymbol;
+	uint32			symbolCount;
+	uint32			firstInclude;
+	uint32			includeCount;
+	uint32			unused;
+};
+
+struct MSymbolRec
+{
+	uint32			name;
+	uint32			scope;
+	uint32			file;
+	uint32			offset;
+	uint32			length;
+	uint32			line;
+};
+
+struct MIncludeRec
+{
+	uint32			name;
+	uint32			resolved;
+	uint32			offset;
+	uint32			quoted;
+};
+
+// the in memory version of the data for one file
+
+struct MSymbolData
+{
+	string			name;
+	string			scope;
+	uint32			offset;
+	uint32			length;
+	uint32			line;
+};
+
+struct MIncludeData
+{
+	string			name;
+	string			resolved;
+	uint32			offset;
+	bool			quoted;
+};
+
+struct MSymbolFileData
+{
+	string					path;
+	int64					modTime;
+	vector<MSymbolData>		symbols;
+	vector<MIncludeData>	includes;
+};
+
+struct MSymbolTask
+{
+	fs::path		file;
+	MLanguage*		language;
+};
+
+string QualifiedName(
+	const string&		inScope,
+	const string&		inName)
+{
+	string result(inName);
+	if (not inScope.empty())
+		result = inScope + "::" + inName;
+	return result;
+}
+
+void AddSymbols(
+	const vector<MNamedRange>&	inRanges,
+	const string&				inScope,
+	const vector<uint32>&		inLineStarts,
+	vector<MSymbolData>&		outSymbols)
+{
+	for (vector<MNamedRange>::const_iterator r = inRanges.begin(); r != inRanges.end(); ++r)
+	{
+		string name(r->name), scope(inScope);
+
+		// methods defined outside their class carry the class name
+		string::size_type p = name.rfind("::");
+		if (p != string::npos)
+		{
+			scope = QualifiedName(scope, name.substr(0, p));
+			name.erase(0, p + 2);
+		}
+
+		if (not name.empty() and name != "-")
+		{
+			MSymbolData symbol;
+			symbol.name = name;
+			symbol.scope = scope;
+			symbol.offset = r->selectFrom;
+			symbol.length = r->selectTo > r->selectFrom ? r->selectTo - r->selectFrom : 0;
+			symbol.line = upper_bound(inLineStarts.begin(), inLineStarts.end(), r->selectFrom) -
+				inLineStarts.begin() - 1;
+			outSymbols.push_back(symbol);
+		}
+
+		if (not r->subrange.empty())
+		{
+			AddSymbols(r->subrange, r->name.empty() ? inScope : QualifiedName(inScope, r->name),
+				inLineStarts, outSymbols);
+		}
+	}
+}
+
+class MStringPool
+{
+  public:
+	uint32			Add(
+						const string&	inString);
+
+	string			mData;
+	map<string,uint32>
+					mIndex;
+};
+
+uint32 MStringPool::Add(
+	const string&	inString)
+{
+	map<string,uint32>::iterator i = mIndex.find(inString);
+	if (i == mIndex.end())
+	{
+		i = mIndex.insert(make_pair(inString, static_cast<uint32>(mData.length()))).first;
+		mData.append(inString.c_str(), inString.length() + 1);
+	}
+	return i->second;
+}
+
+struct MCompareSymbolNames
+{
+					MCompareSymbolNames(
+						const char*					inStrings,
+						const vector<MSymbolRec>&	inSymbols)
+						: mStrings(inStrings), mSymbols(inSymbols) {}
+
+	bool			operator()(
+						uint32						inA,
+						uint32						inB) const
+					{
+						return strcmp(mStrings + mSymbols[inA].name, mStrings + mSymbols[inB].name) < 0;
+					}
+
+	const char*					mStrings;
+	const vector<MSymbolRec>&	mSymbols;
+};
+
+bool CompareFileData(
+	const MSymbolFileData*		inA,
+	const MSymbolFileData*		inB)
+{
+	return inA->path < inB->path;
+}
+
+}
+
+// ---------------------------------------------------------------------------
+//	MSymbolIndexImp
+
+struct MSymbolIndexImp
+{
+					MSymbolIndexImp(
+						const fs::path&			inIndexFile);
+
+					~MSymbolIndexImp();
+
+	void			Map();
+
+	void			Write();
+
+	void			Start(
+						const vector<MSymbolTask>&
+												inTasks,
+						bool					inForce);
+
+	void			Work();
+
+	MSymbolFileData*
+					Parse(
+						const MSymbolTask&		inTask,
+						const vector<fs::path>&	inIncludePaths);
+
+	bool			Resolve(
+						const fs::path&			inDir,
+						const MIncludeFile&		inInclude,
+						const vector<fs::path>&	inIncludePaths,
+						fs::path&				outPath);
+
+	const char*		String(
+						uint32					inOffset) const
+					{
+						return inOffset < mHeader->stringSize ? mStrings + inOffset : "";
+					}
+
+	const MSymbolFileRec*
+					FindFile(
+						const string&			inPath) const;
+
+	bool			GetFileData(
+						const string&			inPath,
+						MSymbolFileData&		outData) const;
+
+	void			Decode(
+						const MSymbolFileRec&	inFile,
+						MSymbolFileData&		outData) const;
+
+	int64			StoredModTime(
+						const string&			inPath) const;
+
+	fs::path					mIndexFile;
+	io::mapped_file_source		mMap;
+	const MSymbolIndexHeader*	mHeader;
+	const MSymbolFileRec*		mFiles;
+	const MSymbolRec*			mSymbols;
+	const uint32*				mByName;
+	const MIncludeRec*			mIncludes;
+	const char*					mStrings;
+
+	// files parsed since the index was written. Only changed when
+	// no worker threads run, so the workers can read it freely.
+	map<string,MSymbolFileData*>
+								mUpdated;
+
+	boost::mutex				mMutex;
+	boost::condition_variable	mCondition;
+	vector<fs::path>			mIncludePaths;
+	deque<MSymbolTask>			mQueue;
+	set<string>					mQueued;
+	vector<MSymbolFileData*>	mResults;
+	vector<boost::thread*>		mThreads;
+	uint32						mRunning;
+	uint32						mBusy;
+	bool						mStop;
+};
+
+MSymbolIndexImp::MSymbolIndexImp(
+	const fs::path&			inIndexFile)
+	: mIndexFile(inIndexFile)
+	, mHeader(nil)
+	, mFiles(nil)
+	, mSymbols(nil)
+	, mByName(nil)
+	, mIncludes(nil)
+	, mStrings(nil)
+	, mRunning(0)
+	, mBusy(0)
+	, mStop(false)
+{
+	Map();
+}
+
+MSymbolIndexImp::~MSymbolIndexImp()
+{
+	{
+		boost::mutex::scoped_lock lock(mMutex);
+		mStop = true;
+		mQueue.clear();
+		mCondition.notify_all();
+	}
+
+	for (vector<boost::thread*>::iterator t = mThreads.begin(); t != mThreads.end(); ++t)
+	{
+		(*t)->join();
+		delete *t;
+	}
+
+	for (vector<MSymbolFileData*>::iterator r = mResults.begin(); r != mResults.end(); ++r)
+		delete *r;
+
+	for (map<string,MSymbolFileData*>::iterator u = mUpdated.begin(); u != mUpdated.end(); ++u)
+		delete u->second;
+}
+
+// ---------------------------------------------------------------------------
+//	Map, (re)open the index file and check it is valid
+
+void MSymbolIndexImp::Map()
+{
+	mHeader = nil;
+	mFiles = nil;
+	mSymbols = nil;
+	mByName = nil;
+	mIncludes = nil;
+	mStrings = nil;
+
+	if (mMap.is_open())
+		mMap.close();
+
+	try
+	{
+		if (not fs::exists(mIndexFile) or fs::file_size(mIndexFile) < sizeof(MSymbolIndexHeader))
+			return;
+
+		mMap.open(mIndexFile.string());
+
+		const char* data = mMap.data();
+		const MSymbolIndexHeader* header = reinterpret_cast<const MSymbolIndexHeader*>(data);
+
+		uint64 size = sizeof(MSymbolIndexHeader) +
+			uint64(header->fileCount) * sizeof(MSymbolFileRec) +
+			uint64(header->symbolCount) * (sizeof(MSymbolRec) + sizeof(uint32)) +
+			uint64(header->includeCount) * sizeof(MIncludeRec) +
+			header->stringSize;
+
+		if (header->magic != kSymbolIndexMagic or header->version != kSymbolIndexVersion or
+			size != mMap.size() or (header->stringSize > 0 and data[size - 1] != 0))
+		{
+			PRINT(("Symbol index %s is not valid, rebuilding", mIndexFile.string().c_str()));
+			mMap.close();
+			return;
+		}
+
+		data += sizeof(MSymbolIndexHeader);
+		const MSymbolFileRec* files = reinterpret_cast<const MSymbolFileRec*>(data);
+		data += header->fileCount * sizeof(MSymbolFileRec);
+		const MSymbolRec* symbols = reinterpret_cast<const MSymbolRec*>(data);
+		data += header->symbolCount * sizeof(MSymbolRec);
+		const uint32* byName = reinterpret_cast<const uint32*>(data);
+		data += header->symbolCount * sizeof(uint32);
+		const MIncludeRec* includes = reinterpret_cast<const MIncludeRec*>(data);
+		data += header->includeCount * sizeof(MIncludeRec);
+
+		for (uint32 f = 0; f < header->fileCount; ++f)
+		{
+			if (uint64(files[f].firstSymbol) + files[f].symbolCount > header->symbolCount or
+				uint64(files[f].firstInclude) + files[f].includeCount > header->includeCount)
+			{
+				PRINT(("Symbol index %s is not valid, rebuilding", mIndexFile.string().c_str()));
+				mMap.close();
+				return;
+			}
+		}
+
+		mHeader = header;
+		mFiles = files;
+		mSymbols = symbols;
+		mByName = byName;
+		mIncludes = includes;
+		mStrings = data;
+	}
+	catch (exception& e)
+	{
+		PRINT(("Error opening symbol index: %s", e.what()));
+
+		if (mMap.is_open())
+			mMap.close();
+	}
+}
+
+// ---------------------------------------------------------------------------
+//	Write, merge the updated files with the ones in the index and write
+//	the lot to a new index file.
+
+void MSymbolIndexImp::Write()
+{
+	vector<MSymbolFileData> stored;
+	vector<const MSymbolFileData*> files;
+
+	if (mHeader != nil)
+	{
+		stored.reserve(mHeader->fileCount);
+
+		for (uint32 f = 0; f < mHeader->fileCount; ++f)
+		{
+			if (mUpdated.find(String(mFiles[f].path)) != mUpdated.end())
+				continue;
+
+			stored.push_back(MSymbolFileData());
+			Decode(mFiles[f], stored.back());
+		}
+	}
+
+	for (vector<MSymbolFileData>::iterator f = stored.begin(); f != stored.end(); ++f)
+		files.push_back(&*f);
+
+	for (map<string,MSymbolFileData*>::iterator u = mUpdated.begin(); u != mUpdated.end(); ++u)
+		files.push_back(u->second);
+
+	sort(files.begin(), files.end(), &CompareFileData);
+
+	MStringPool strings;
+	vector<MSymbolFileRec> fileRecs;
+	vector<MSymbolRec> symbols;
+	vector<MIncludeRec> includes;
+
+	for (vector<const MSymbolFileData*>::iterator f = files.begin(); f != files.end(); ++f)
+	{
+		MSymbolFileRec fileRec = {
+			(*f)->modTime,
+			strings.Add((*f)->path),
+			static_cast<uint32>(symbols.size()),
+			static_cast<uint32>((*f)->symbols.size()),
+			static_cast<uint32>(includes.size()),
+			static_cast<uint32>((*f)->includes.size())
+		};
+
+		for (vector<MSymbolData>::const_iterator s = (*f)->symbols.begin(); s != (*f)->symbols.end(); ++s)
+		{
+			MSymbolRec symbol = {
+				strings.Add(s->name), strings.Add(s->scope),
+				static_cast<uint32>(fileRecs.size()), s->offset, s->length, s->line
+			};
+			symbols.push_back(symbol);
+		}
+
+		for (vector<MIncludeData>::const_iterator i = (*f)->includes.begin(); i != (*f)->includes.end(); ++i)
+		{
+			MIncludeRec include = {
+				strings.Add(i->name),
+				i->resolved.empty() ? kNoString : strings.Add(i->resolved),
+				i->offset, i->quoted
+			};
+			includes.push_back(include);
+		}
+
+		fileRecs.push_back(fileRec);
+	}
+
+	vector<uint32> byName(symbols.size());
+	for (uint32 i = 0; i < byName.size(); ++i)
+		byName[i] = i;
+
+	stable_sort(byName.begin(), byName.end(), MCompareSymbolNames(strings.mData.c_str(), symbols));
+
+	MSymbolIndexHeader header = {
+		kSymbolIndexMagic, kSymbolIndexVersion,
+		static_cast<uint32>(fileRecs.size()),
+		static_cast<uint32>(symbols.size()),
+		static_cast<uint32>(includes.size()),
+		static_cast<uint32>(strings.mData.length())
+	};
+
+	fs::path tmpFile(mIndexFile.string() + ".tmp");
+
+	{
+		fs::ofstream file(tmpFile, ios::binary | ios::trunc);
+		if (not file.is_open())
+			THROW(("Could not create symbol index %s", tmpFile.string().c_str()));
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		if (not fileRecs.empty())
+			file.write(reinterpret_cast<const char*>(&fileRecs[0]), fileRecs.size() * sizeof(MSymbolFileRec));
+		if (not symbols.empty())
+		{
+			file.write(reinterpret_cast<const char*>(&symbols[0]), symbols.size() * sizeof(MSymbolRec));
+			file.write(reinterpret_cast<const char*>(&byName[0]), byName.size() * sizeof(uint32));
+		}
+		if (not includes.empty())
+			file.write(reinterpret_cast<const char*>(&includes[0]), includes.size() * sizeof(MIncludeRec));
+		file.write(strings.mData.c_str(), strings.mData.length());
+
+		if (not file)
+			THROW(("Error writing symbol index %s", tmpFile.string().c_str()));
+	}
+
+	if (mMap.is_open())
+		mMap.close();
+	mHeader = nil;
+
+	if (rename(tmpFile.string().c_str(), mIndexFile.string().c_str()) < 0)
+		THROW(("Error writing symbol index %s: %s", mIndexFile.string().c_str(), strerror(errno)));
+
+	for (map<string,MSymbolFileData*>::iterator u = mUpdated.begin(); u != mUpdated.end(); ++u)
+		delete u->second;
+	mUpdated.clear();
+
+	Map();
+}
+
+// ---------------------------------------------------------------------------
+//	Start, add tasks to the queue and start workers if needed
+
+void MSymbolIndexImp::Start(
+	const vector<MSymbolTask>&	inTasks,
+	bool						inForce)
+{
+	boost::mutex::scoped_lock lock(mMutex);
+
+	if (mRunning == 0)
+	{
+		// these have all finished by now
+		for (vector<boost::thread*>::iterator t = mThreads.begin(); t != mThreads.end(); ++t)
+		{
+			(*t)->join();
+			delete *t;
+		}
+
+		mThreads.clear();
+		mQueued.clear();
+	}
+
+	for (vector<MSymbolTask>::const_iterator t = inTasks.begin(); t != inTasks.end(); ++t)
+	{
+		if (mQueued.insert(t->file.string()).second or inForce)
+			mQueue.push_back(*t);
+	}
+
+	uint32 threadCount = max(gConcurrentJobs, 1U);
+	while (mRunning < threadCount and mRunning < mQueue.size())
+	{
+		mThreads.push_back(new boost::thread(boost::bind(&MSymbolIndexImp::Work, this)));
+		++mRunning;
+	}
+
+	mCondition.notify_all();
+}
+
+// ---------------------------------------------------------------------------
+//	Work, the worker thread main loop
+
+void MSymbolIndexImp::Work()
+{
+	for (;;)
+	{
+		MSymbolTask task;
+		vector<fs::path> includePaths;
+
+		{
+			boost::mutex::scoped_lock lock(mMutex);
+
+			while (mQueue.empty() and mBusy > 0 and not mStop)
+				mCondition.wait(lock);
+
+			if (mQueue.empty() or mStop)
+			{
+				--mRunning;
+				mCondition.notify_all();
+				break;
+			}
+
+			task = mQueue.front();
+			mQueue.pop_front();
+			includePaths = mIncludePaths;
+			++mBusy;
+		}
+
+		MSymbolFileData* data = nil;
+
+		try
+		{
+			data = Parse(task, includePaths);
+		}
+		catch (exception& e)
+		{
+			PRINT(("Error indexing %s: %s", task.file.string().c_str(), e.what()));
+		}
+
+		// the headers included by this file that we did not see yet
+		vector<string> headers;
+
+		if (data != nil)
+		{
+			boost::mutex::scoped_lock lock(mMutex);
+
+			for (vector<MIncludeData>::iterator i = data->includes.begin(); i != data->includes.end(); ++i)
+			{
+				if (not i->resolved.empty() and mQueued.insert(i->resolved).second)
+					headers.push_back(i->resolved);
+			}
+		}
+
+		vector<MSymbolTask> next;
+
+		for (vector<string>::iterator h = headers.begin(); h != headers.end(); ++h)
+		{
+			try
+			{
+				fs::path file(*h);
+				if (StoredModTime(*h) != fs::last_write_time(file))
+				{
+					MSymbolTask header = { file, task.language };
+					next.push_back(header);
+				}
+			}
+			catch (...) {}
+		}
+
+		boost::mutex::scoped_lock lock(mMutex);
+
+		if (data != nil)
+			mResults.push_back(data);
+
+		if (not mStop)
+			copy(next.begin(), next.end(), back_inserter(mQueue));
+
+		--mBusy;
+		mCondition.notify_all();
+	}
+}
+
+// ---------------------------------------------------------------------------
+//	Parse, runs in a worker thread
+
+MSymbolFileData* MSymbolIndexImp::Parse(
+	const MSymbolTask&			inTask,
+	const vector<fs::path>&		inIncludePaths)
+{
+	unique_ptr<MSymbolFileData> data(new MSymbolFileData);
+
+	data->path = inTask.file.string();
+	data->modTime = fs::last_write_time(inTask.file);
+
+	MTextBuffer text;
+
+	fs::ifstream file(inTask.file, ios::binary);
+	if (not file.is_open())
+		THROW(("Could not open file"));
+
+	text.ReadFromFile(file);
+
+	MNamedRange range;
+	MIncludeFileList includes;
+
+	inTask.language->Parse(text, range, includes);
+
+	vector<uint32> lineStarts(1, 0);
+
+	string s;
+	text.GetText(0, text.GetSize(), s);
+	for (string::size_type p = s.find('\n'); p != string::npos; p = s.find('\n', p + 1))
+		lineStarts.push_back(p + 1);
+
+	AddSymbols(range.subrange, "", lineStarts, data->symbols);
+
+	fs::path dir = inTask.file.parent_path();
+
+	for (MIncludeFileList::iterator i = includes.begin(); i != includes.end(); ++i)
+	{
+		MIncludeData include;
+		include.name = i->name;
+		include.offset = i->offset;
+		include.quoted = i->isQuoted;
+
+		fs::path path;
+		if (Resolve(dir, *i, inIncludePaths, path))
+			include.resolved = path.string();
+
+		data->includes.push_back(include);
+	}
+
+	return data.release();
+}
+
+// ---------------------------------------------------------------------------
+//	Resolve, locate an include file in the include paths
+
+bool MSymbolIndexImp::Resolve(
+	const fs::path&			inDir,
+	const MIncludeFile&		inInclude,
+	const vector<fs::path>&	inIncludePaths,
+	fs::path&				outPath)
+{
+	bool found = false;
+
+	if (inInclude.name.empty())
+		return false;
+
+	if (inInclude.isQuoted)
+	{
+		outPath = inDir / inInclude.name;
+		found = fs::exists(outPath) and not fs::is_directory(outPath);
+	}
+
+	for (vector<fs::path>::const_iterator p = inIncludePaths.begin();
+		 not found and p != inIncludePaths.end();
+		 ++p)
+	{
+		outPath = *p / inInclude.name;
+		found = fs::exists(outPath) and not fs::is_directory(outPath);
+	}
+
+	if (found)
+		NormalizePath(outPath);
+
+	return found;
+}
+
+// ---------------------------------------------------------------------------
+//	Lookup in the mapped index
+
+const MSymbolFileRec* MSymbolIndexImp::FindFile(
+	const string&			inPath) const
+{
+	const MSymbolFileRec* result = nil;
+
+	if (mHeader != nil)
+	{
+		uint32 L = 0, R = mHeader->fileCount;
+
+		while (L < R)
+		{
+			uint32 i = (L + R) / 2;
+
+			int d = strcmp(String(mFiles[i].path), inPath.c_str());
+			if (d == 0)
+			{
+				result = mFiles + i;
+				break;
+			}
+
+			if (d < 0)
+				L = i + 1;
+			else
+				R = i;
+		}
+	}
+
+	return result;
+}
+
+void MSymbolIndexImp::Decode(
+	const MSymbolFileRec&	inFile,
+	MSymbolFileData&		outData) const
+{
+	outData.path = String(inFile.path);
+	outData.modTime = inFile.modTime;
+
+	outData.symbols.clear();
+	outData.symbols.reserve(inFile.symbolCount);
+
+	for (uint32 s = inFile.firstSymbol; s < inFile.firstSymbol + inFile.symbolCount; ++s)
+	{
+		MSymbolData symbol;
+		symbol.name = String(mSymbols[s].name);
+		symbol.scope = String(mSymbols[s].scope);
+		symbol.offset = mSymbols[s].offset;
+		symbol.length = mSymbols[s].length;
+		symbol.line = mSymbols[s].line;
+		outData.symbols.push_back(symbol);
+	}
+
+	outData.includes.clear();
+	outData.includes.reserve(inFile.includeCount);
+
+	for (uint32 i = inFile.firstInclude; i < inFile.firstInclude + inFile.includeCount; ++i)
+	{
+		MIncludeData include;
+		include.name = String(mIncludes[i].name);
+		include.resolved = String(mIncludes[i].resolved);
+		include.offset = mIncludes[i].offset;
+		include.quoted = mIncludes[i].quoted != 0;
+		outData.includes.push_back(include);
+	}
+}
+
+bool MSymbolIndexImp::GetFileData(
+	const string&			inPath,
+	MSymbolFileData&		outData) const
+{
+	bool result = false;
+
+	map<string,MSymbolFileData*>::const_iterator u = mUpdated.find(inPath);
+	if (u != mUpdated.end())
+	{
+		outData = *u->second;
+		result = true;
+	}
+	else
+	{
+		const MSymbolFileRec* file = FindFile(inPath);
+		if (file != nil)
+		{
+			Decode(*file, outData);
+			result = true;
+		}
+	}
+
+	return result;
+}
+
+int64 MSymbolIndexImp::StoredModTime(
+	const string&			inPath) const
+{
+	int64 result = -1;
+
+	map<string,MSymbolFileData*>::const_iterator u = mUpdated.find(inPath);
+	if (u != mUpdated.end())
+		result = u->second->modTime;
+	else
+	{
+		const MSymbolFileRec* file = FindFile(inPath);
+		if (file != nil)
+			result = file->modTime;
+	}
+
+	return result;
+}
+
+// ---------------------------------------------------------------------------
+//	MSymbolIndex
+
+MSymbolIndex::MSymbolIndex(
+	const fs::path&		inIndexFile)
+	: mImpl(new MSymbolIndexImp(inIndexFile))
+{
+}
+
+MSymbolIndex::~MSymbolIndex()
+{
+	delete mImpl;
+}
+
+void MSymbolIndex::SetIncludePaths(
+	const vector<fs::path>&	inIncludePaths)
+{
+	boost::mutex::scoped_lock lock(mImpl->mMutex);
+	mImpl->mIncludePaths = inIncludePaths;
+}
+
+void MSymbolIndex::Update(
+	const vector<fs::path>&	inFiles)
+{
+	// MTextBuffer reads its defaults from the preferences, creating one
+	// here makes sure the workers find them instead of adding them.
+	MTextBuffer text;
+
+	vector<MSymbolTask> tasks;
+
+	for (vector<fs::path>::const_iterator f = inFiles.begin(); f != inFiles.end(); ++f)
+	{
+		if (not fs::exists(*f) or mImpl->StoredModTime(f->string()) == fs::last_write_time(*f))
+			continue;
+
+		MSymbolTask task = { *f, MLanguage::GetLanguageForDocument(f->filename(), text) };
+		if (task.language != nil)
+			tasks.push_back(task);
+	}
+
+	if (not tasks.empty())
+		mImpl->Start(tasks, false);
+}
+
+void MSymbolIndex::Update(
+	const fs::path&		inFile)
+{
+	MTextBuffer text;
+
+	if (fs::exists(inFile))
+	{
+		MSymbolTask task = { inFile, MLanguage::GetLanguageForDocument(inFile.filename(), text) };
+		if (task.language != nil)
+			mImpl->Start(vector<MSymbolTask>(1, task), true);
+	}
+}
+
+void MSymbolIndex::Poll()
+{
+	vector<MSymbolFileData*> results;
+
+	{
+		boost::mutex::scoped_lock lock(mImpl->mMutex);
+
+		if (mImpl->mRunning > 0 or mImpl->mResults.empty())
+			return;
+
+		swap(results, mImpl->mResults);
+	}
+
+	for (vector<MSymbolFileData*>::iterator r = results.begin(); r != results.end(); ++r)
+	{
+		MSymbolFileData*& data = mImpl->mUpdated[(*r)->path];
+		delete data;
+		data = *r;
+	}
+
+	try
+	{
+		mImpl->Write();
+	}
+	catch (exception& e)
+	{
+		PRINT(("Error writing symbol index: %s", e.what()));
+	}
+}
+
+bool MSymbolIndex::IsBusy() const
+{
+	boost::mutex::scoped_lock lock(mImpl->mMutex);
+	return mImpl->mRunning > 0 or not mImpl->mResults.empty();
+}
+
+bool MSymbolIndex::Contains(
+	const fs::path&		inFile) const
+{
+	return mImpl->StoredModTime(inFile.string()) >= 0;
+}
+
+void MSymbolIndex::Find(
+	const string&		inName,
+	vector<MSymbolLocation>&
+						outLocations) const
+{
+	vector<MSymbolLocation> partial;
+
+	if (mImpl->mHeader != nil)
+	{
+		const uint32* b = mImpl->mByName;
+		const uint32* e = b + mImpl->mHeader->symbolCount;
+
+		// binary search for the first name not less than inName
+		while (b < e)
+		{
+			const uint32* m = b + (e - b) / 2;
+			if (strcmp(mImpl->String(mImpl->mSymbols[*m].name), inName.c_str()) < 0)
+				b = m + 1;
+			else
+				e = m;
+		}
+
+		for (e = mImpl->mByName + mImpl->mHeader->symbolCount; b != e; ++b)
+		{
+			const MSymbolRec& symbol = mImpl->mSymbols[*b];
+			const char* name = mImpl->String(symbol.name);
+
+			if (strncmp(name, inName.c_str(), inName.length()) != 0)
+				break;
+
+			const char* path = mImpl->String(mImpl->mFiles[symbol.file].path);
+			if (mImpl->mUpdated.find(path) != mImpl->mUpdated.end())
+				continue;
+
+			MSymbolLocation location;
+			location.name = QualifiedName(mImpl->String(symbol.scope), name);
+			location.file = path;
+			location.line = symbol.line;
+			location.offset = symbol.offset;
+			location.length = symbol.length;
+
+			if (inName.length() == strlen(name))
+				outLocations.push_back(location);
+			else
+				partial.push_back(location);
+		}
+	}
+
+	for (map<string,MSymbolFileData*>::const_iterator u = mImpl->mUpdated.begin(); u != mImpl->mUpdated.end(); ++u)
+	{
+		const vector<MSymbolData>& symbols = u->second->symbols;
+
+		for (vector<MSymbolData>::const_iterator s = symbols.begin(); s != symbols.end(); ++s)
+		{
+			if (s->name.compare(0, inName.length(), inName) != 0)
+				continue;
+
+			MSymbolLocation location;
+			location.name = QualifiedName(s->scope, s->name);
+			location.file = u->first;
+			location.line = s->line;
+			location.offset = s->offset;
+			location.length = s->length;
+
+			if (inName.length() == s->name.length())
+				outLocations.push_back(location);
+			else
+				partial.push_back(location);
+		}
+	}
+
+	copy(partial.begin(), partial.end(), back_inserter(outLocations));
+}
+
+bool MSymbolIndex::GetIncludes(
+	const fs::path&		inFile,
+	MIncludeFileList&	outIncludes) const
+{
+	MSymbolFileData data;
+
+	bool result = mImpl->GetFileData(inFile.string(), data) and
+		fs::exists(inFile) and data.modTime == fs::last_write_time(inFile);
+
+	if (result)
+	{
+		outIncludes.clear();
+
+		for (vector<MIncludeData>::iterator i = data.includes.begin(); i != data.includes.end(); ++i)
+		{
+			MIncludeFile include = { i->name, i->quoted, i->offset };
+			outIncludes.push_back(include);
+		}
+	}
+
+	return result;
+}
+
+bool MSymbolIndex::LocateInclude(
+	const fs::path&		inFile,
+	const string&		inInclude,
+	fs::path&			outPath) const
+{
+	bool result = false;
+	MSymbolFileData data;
+
+	if (mImpl->GetFileData(inFile.string(), data))
+	{
+		for (vector<MIncludeData>::iterator i = data.includes.begin(); i != data.includes.end(); ++i)
+		{
+			if (i->name == inInclude and not i->resolved.empty() and fs::exists(i->resolved))
+			{
+				outPath = i->resolved;
+				result = true;
+				break;
+			}
+		}
+	}
+
+	return result;
+}
@@ -0,0 +1,83 @@
+//          Copyright Maarten L. Hekkelman 2006-2008
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+/*
+	MSymbolIndex is a project wide database of the symbols found by
+	MLanguage::Parse in the project files and the headers they include.
+
+	The index is built by a pool of worker threads and is stored on disk
+	in a format that can be used memory mapped. Files parsed after the
+	index was last written are kept in memory until the workers are idle
+	and the index is written out again.
+*/
+
+#ifndef MSYMBOLINDEX_H
+#define MSYMBOLINDEX_H
+
+#include "MFile.h"
+#include "MLanguage.h"
+
+struct MSymbolLocation
+{
+	std::string		name;		// including scope
+	fs::path		file;
+	uint32			line;		// zero based
+	uint32			offset;
+	uint32			length;
+};
+
+class MSymbolIndex
+{
+  public:
+					MSymbolIndex(
+						const fs::path&		inIndexFile);
+
+					~MSymbolIndex();
+
+	void			SetIncludePaths(
+						const std::vector<fs::path>&
+											inIncludePaths);
+
+	// reparse the files in inFiles that changed since they were last indexed
+	void			Update(
+						const std::vector<fs::path>&
+											inFiles);
+
+	// reparse one file, regardless of its modification date
+	void			Update(
+						const fs::path&		inFile);
+
+	// call at idle time, writes the index when the workers are done
+	void			Poll();
+
+	bool			IsBusy() const;
+
+	bool			Contains(
+						const fs::path&		inFile) const;
+
+	// find all symbols whose name starts with inName, exact matches first
+	void			Find(
+						const std::string&	inName,
+						std::vector<MSymbolLocation>&
+											outLocations) const;
+
+	// returns the includes for inFile, if the index is up to date for it
+	bool			GetIncludes(
+						const fs::path&		inFile,
+						MIncludeFileList&	outIncludes) const;
+
+	bool			LocateInclude(
+						const fs::path&		inFile,
+						const std::string&	inInclude,
+						fs::path&			outPath) const;
+
+  private:
+					MSymbolIndex(const MSymbolIndex&);
+	MSymbolIndex&	operator=(const MSymbolIndex&);
+
+	struct MSymbolIndexImp*	mImpl;
+};
+
+#endif
@@ -15,6 +15,11 @@
 #include <limits>
 #include <sstream>
 #include <unistd.h>
+#include <zlib.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 // for some weird reason the BOOST_ASSERT's wreak havoc here...
 #if DEBUG
@@ -29,6 +34,7 @@
 #include "MSelection.h"
 #include "MError.h"
 #include "MPreferences.h"
+#include "MTrace.h"
 
 using namespace std;
 namespace ba = boost::algorithm;
@@ -102,6 +108,9 @@ const char* kPCRE_ERR_STR[] = {
 
 const uint32 kBlockSize = 10240;
 
+// saved text shorter than this is not worth compressing
+const uint32 kMinCompressSize = 256;
+
 class wc_iterator : public boost::iterator_facade<wc_iterator, const wchar_t,
 	boost::bidirectional_traversal_tag, const wchar_t>
 {
@@ -166,6 +175,11 @@ class MicroAction
 							uint32&			ioChangeLength,	// Total length of area touched by Undo
 							int32&			ioDelta);		// The cumulative amount of characters deleted/inserted
 
+	uint32			GetMemoryUsage() const			{ return mSavedText.length(); }
+
+	void			Compress(
+							MTextBuffer&	inBuffer);
+
   private:
 
 	void			Delete(	MTextBuffer&	inBuffer,
@@ -180,7 +194,8 @@ class MicroAction
 
 	MicroAction&	operator=(const MicroAction&);
 
-	char*			mSavedText;
+	std::string		mSavedText;
+	bool			mCompressed;	// mSavedText is deflated
 	uint32			mOffset;
 	int32			mLength;
 };
@@ -193,6 +208,8 @@ class Action
 					Action(
 						MTextBuffer&		inBuffer,
 						const string&		inTitle);
+
+					~Action();
 	
 	void			Insert(
 						uint32				inOffset,
@@ -226,6 +243,8 @@ class Action
 						uint32&				outChangeLength,	// Total length of area touched by Undo
 						int32&				outDelta);			// The cumulative amount of characters deleted/inserted
 
+	void			Compress();
+
   private:
 	MTextBuffer&	mBuffer;
 	string			mTitle;
@@ -237,7 +256,7 @@ class Action
 // -----------------------------------------------------------------------------
 
 MicroAction::MicroAction()
-	: mSavedText(nil)
+	: mCompressed(false)
 	, mOffset(0)
 	, mLength(0)
 {
@@ -245,16 +264,15 @@ MicroAction::MicroAction()
 
 MicroAction::MicroAction(
 	const MicroAction& inOther)
-	: mSavedText(inOther.mSavedText)
+	: mCompressed(false)
 	, mOffset(inOther.mOffset)
 	, mLength(inOther.mLength)
 {
-	assert(inOther.mSavedText == nil);
+	assert(inOther.mSavedText.empty());
 }
 
 MicroAction::~MicroAction()
 {
-	delete[] mSavedText;
 }
 
 void
@@ -263,12 +281,14 @@ MicroAction::DoDelete(
 	uint32			inOffset,
 	uint32			inLength)
 {
-	mSavedText = new char[inLength];
+	mSavedText.resize(inLength);
+	mCompressed = false;
 	mOffset = inOffset;
 	mLength = -inLength;
 
-	inBuffer.GetText(mOffset, mSavedText, inLength);
+	inBuffer.GetText(mOffset, &mSavedText[0], inLength);
 	inBuffer.DeleteSelf(mOffset, inLength);
+	inBuffer.mUndoMemory += inLength;
 }
 
 void
@@ -336,10 +356,12 @@ MicroAction::Delete(
 	int32&			ioDelta)		// The cumulative amount of characters deleted/inserted
 {
 	uint32 length = abs(mLength);
-	mSavedText = new char[length];
+	mSavedText.resize(length);
+	mCompressed = false;
 	
-	inBuffer.GetText(mOffset, mSavedText, length);
+	inBuffer.GetText(mOffset, &mSavedText[0], length);
 	inBuffer.DeleteSelf(mOffset, length);
+	inBuffer.mUndoMemory += length;
 	
 	if (mOffset < ioChangeOffset)
 	{
@@ -362,9 +384,28 @@ MicroAction::Insert(
 {
 	uint32 length = abs(mLength);
 	
-	inBuffer.InsertSelf(mOffset, mSavedText, length);
-	delete[] mSavedText;
-	mSavedText = nil;
+	if (mCompressed)
+	{
+		string text(length, 0);
+		
+		uLongf size = length;
+		if (uncompress(reinterpret_cast<Bytef*>(&text[0]), &size,
+				reinterpret_cast<const Bytef*>(mSavedText.c_str()), mSavedText.length()) != Z_OK or
+			size != length)
+		{
+			THROW(("Undo history is damaged"));
+		}
+		
+		inBuffer.mUndoMemory -= mSavedText.length();
+		swap(mSavedText, text);
+		mCompressed = false;
+		inBuffer.mUndoMemory += mSavedText.length();
+	}
+	
+	inBuffer.InsertSelf(mOffset, mSavedText.c_str(), length);
+	
+	inBuffer.mUndoMemory -= mSavedText.length();
+	string().swap(mSavedText);
 
 	if (mOffset < ioChangeOffset)
 	{
@@ -378,6 +419,29 @@ MicroAction::Insert(
 	ioDelta += length;
 }
 
+void
+MicroAction::Compress(
+	MTextBuffer&	inBuffer)
+{
+	if (not mCompressed and mSavedText.length() >= kMinCompressSize)
+	{
+		uLongf size = compressBound(mSavedText.length());
+		string data(size, 0);
+		
+		if (compress2(reinterpret_cast<Bytef*>(&data[0]), &size,
+				reinterpret_cast<const Bytef*>(mSavedText.c_str()), mSavedText.length(),
+				Z_BEST_SPEED) == Z_OK and size < mSavedText.length())
+		{
+			data.resize(size);
+			
+			inBuffer.mUndoMemory -= mSavedText.length();
+			string(data).swap(mSavedText);
+			mCompressed = true;
+			inBuffer.mUndoMemory += mSavedText.length();
+		}
+	}
+}
+
 // -----------------------------------------------------------------------------
 
 Action::Action(
@@ -390,6 +454,19 @@ Action::Action(
 {
 }
 
+Action::~Action()
+{
+	for (MicroActionList::iterator m = mMicroActions.begin(); m != mMicroActions.end(); ++m)
+		mBuffer.mUndoMemory -= m->GetMemoryUsage();
+}
+
+void
+Action::Compress()
+{
+	for (MicroActionList::iterator m = mMicroActions.begin(); m != mMicroActions.end(); ++m)
+		m->Compress(mBuffer);
+}
+
 void
 Action::SetSelectionBefore(
 	const MSelection&	inSelection)
@@ -498,6 +575,10 @@ MTextBuffer::MTextBuffer()
 	, mLogicalLength(0)
 	, mGapOffset(0)
 	, mActionFinished(true)
+	, mBalanceOwner(nil)
+	, mUndoMemory(0)
+	, mCompressedActions(0)
+	, mChangeCount(0)
 {
 	string s = Preferences::GetString("default encoding", "utf-8");
 	if (s == "utf-16 be")
@@ -528,6 +609,10 @@ MTextBuffer::MTextBuffer(
 	, mPhysicalLength(0)
 	, mLogicalLength(0)
 	, mGapOffset(0)
+	, mBalanceOwner(nil)
+	, mUndoMemory(0)
+	, mCompressedActions(0)
+	, mChangeCount(0)
 {
 	mEncoding = kEncodingUTF8;
 	mBOM = Preferences::GetInteger("add bom", 0);
@@ -552,39 +637,21 @@ MTextBuffer::~MTextBuffer()
 
 	while (mUndoneActions.size())
 	{
-		delete mUndoneActions.top();
-		mUndoneActions.pop();
+		delete mUndoneActions.back();
+		mUndoneActions.pop_back();
 	}
 
 	while (mDoneActions.size())
 	{
-		delete mDoneActions.top();
-		mDoneActions.pop();
+		delete mDoneActions.back();
+		mDoneActions.pop_back();
 	}
 }
 
 void MTextBuffer::ReadFromFile(
-	istream&		inFile)
+	istream&		inFile,
+	vector<uint32>*	outLineStarts)
 {
-	// first reset the data
-	while (mUndoneActions.size())
-	{
-		delete mUndoneActions.top();
-		mUndoneActions.pop();
-	}
-
-	while (mDoneActions.size())
-	{
-		delete mDoneActions.top();
-		mDoneActions.pop();
-	}
-
-	mLogicalLength = 0;
-	mPhysicalLength = 0;
-	mGapOffset = 0;
-	delete[] mData;
-	mData = nil;
-	
 	// First read the data into a buffer
 	streambuf* b = inFile.rdbuf();
 	
@@ -600,6 +667,39 @@ void MTextBuffer::ReadFromFile(
 	auto_array<char> data(new char[len]);
 	b->sgetn(data.get(), len);
 
+	ReadFromData(data.release(), len, outLineStarts);
+}
+
+void MTextBuffer::ReadFromData(
+	char*			inData,
+	uint32			inLength,
+	vector<uint32>*	outLineStarts)
+{
+	auto_array<char> data(inData);
+	uint32 len = inLength;
+
+	InvalidateBalanceCheckpoints(0);
+	++mChangeCount;
+
+	// first reset the data
+	while (mUndoneActions.size())
+	{
+		delete mUndoneActions.back();
+		mUndoneActions.pop_back();
+	}
+
+	while (mDoneActions.size())
+	{
+		delete mDoneActions.back();
+		mDoneActions.pop_back();
+	}
+
+	mLogicalLength = 0;
+	mPhysicalLength = 0;
+	mGapOffset = 0;
+	delete[] mData;
+	mData = nil;
+	
 	// Now find out what this data contains.
 	
 	mEncoding = kEncodingUnknown;
@@ -619,24 +719,62 @@ void MTextBuffer::ReadFromFile(
 		mGapOffset = 0;
 	}
 	
-	GuessLineEndCharacter();
+	GuessLineEndCharacter(outLineStarts);
+}
+
+// the undo history refers to the buffer it belongs to and is not
+// taken over, ours is discarded just like when reading a file.
+
+void MTextBuffer::TakeText(
+	MTextBuffer&	ioText)
+{
+	InvalidateBalanceCheckpoints(0);
+	++mChangeCount;
+
+	while (mUndoneActions.size())
+	{
+		delete mUndoneActions.back();
+		mUndoneActions.pop_back();
+	}
+
+	while (mDoneActions.size())
+	{
+		delete mDoneActions.back();
+		mDoneActions.pop_back();
+	}
+
+	delete[] mData;
+
+	mData = ioText.mData;
+	mPhysicalLength = ioText.mPhysicalLength;
+	mLogicalLength = ioText.mLogicalLength;
+	mGapOffset = ioText.mGapOffset;
+	mEncoding = ioText.mEncoding;
+	mEOLNKind = ioText.mEOLNKind;
+	mBOM = ioText.mBOM;
+	
+	ioText.mData = nil;
+	ioText.mPhysicalLength = ioText.mLogicalLength = ioText.mGapOffset = 0;
 }
 
 void MTextBuffer::SetText(
 	const char*		inText,
 	uint32			inLength)
 {
+	InvalidateBalanceCheckpoints(0);
+	++mChangeCount;
+
 	// first reset the data
 	while (mUndoneActions.size())
 	{
-		delete mUndoneActions.top();
-		mUndoneActions.pop();
+		delete mUndoneActions.back();
+		mUndoneActions.pop_back();
 	}
 
 	while (mDoneActions.size())
 	{
-		delete mDoneActions.top();
-		mDoneActions.pop();
+		delete mDoneActions.back();
+		mDoneActions.pop_back();
 	}
 
 	mLogicalLength = 0;
@@ -719,41 +857,7 @@ bool MTextBuffer::GuessEncodingAndCopyData(
 	
 	if (mEncoding == kEncodingUnknown)
 	{
-		bool validUtf8 = true;
-
-		for (uint32 i = 0; i < inLength and validUtf8; ++i)
-		{
-			unsigned char c = static_cast<unsigned char>(txt[i]);
-
-			if (c & 0x0080)
-			{
-				int cLen = 0;
-			 
-				if ((c & 0x00E0) == 0x00C0)
-					cLen = 2;
-				else if ((c & 0x00F0) == 0x00E0)
-					cLen = 3;
-				else if ((c & 0x00F8) == 0x00F0)
-					cLen = 4;
-				else if ((c & 0x00FC) == 0x00F8)
-					cLen = 5;
-
-				if (cLen == 0)
-					validUtf8 = false;
-				else
-				{
-					while (cLen-- > 1)
-					{
-						++i;
-						c = static_cast<unsigned char>(txt[i]);
-						if ((c & 0x00C0) != 0x0080)
-							validUtf8 = false;
-					}
-				}
-			}
-		}
-		
-		if (validUtf8)
+		if (IsValidUTF8(txt, inLength))
 			mEncoding = kEncodingUTF8;
 		else
 		{
@@ -788,29 +892,18 @@ bool MTextBuffer::GuessEncodingAndCopyData(
 		result = true;
 	else
 	{
-		auto_ptr<MDecoder> decoder(MDecoder::GetDecoder(mEncoding, txt, inLength));
-		
-		// preserve some memory
-		switch (mEncoding)
-		{
-			case kEncodingUTF16LE:
-			case kEncodingUTF16BE:
-				reserve(inLength / 2 + kBlockSize);
-				break;
-			default:
-				reserve(inLength + kBlockSize);
-				break;
-		}	
-	
-		wchar_t uc;
-		while (decoder->ReadUnicode(uc))
-			push_back(uc);
+		// convert the whole block at once, in a buffer of exactly the right size
+		reserve(GetUTF8Length(mEncoding, txt, inLength) + kBlockSize);
+
+		mLogicalLength = ConvertToUTF8(mEncoding, txt, inLength, mData);
+		mGapOffset = mLogicalLength;
 	}
 	
 	return result;
 }
 
-void MTextBuffer::GuessLineEndCharacter()
+void MTextBuffer::GuessLineEndCharacter(
+	vector<uint32>*	outLineStarts)
 {
 	// now convert the line end character
 	
@@ -838,34 +931,80 @@ void MTextBuffer::GuessLineEndCharacter()
 			break;
 	}
 	
+	// Convert the line ends and collect the line starts in one pass. Blocks
+	// of sixteen bytes without a CR are moved as a whole and the positions of
+	// their LF's are taken from a bit mask. Other blocks are done by hand.
+	
 	bool inconsistent = false;
 	
-	for (src = dst = mData; src < end; ++src, ++dst)
+	if (outLineStarts != nil)
+		outLineStarts->clear();
+	
+	src = dst = mData;
+
+	while (src < end)
 	{
-		*dst = *src;
+		char* blockEnd = end;
 
-		if (*src == '\r')
+#if defined(__SSE2__)
+		if (end - src >= 16)
 		{
-			*dst = '\n';
-
-			switch (mEOLNKind)
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+			
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))) == 0)
 			{
-				case eEOLN_MAC:
-					break;
+				if (outLineStarts != nil)
+				{
+					uint32 lf = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+					while (lf != 0)
+					{
+						outLineStarts->push_back(dst - mData + __builtin_ctz(lf) + 1);
+						lf &= lf - 1;
+					}
+				}
+
+				if (dst != src)
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), v);
 				
-				case eEOLN_DOS:
-					if (src < end - 1 and *(src + 1) == '\n')
-						++src;
-					else
+				src += 16;
+				dst += 16;
+				continue;
+			}
+			
+			blockEnd = src + 16;
+		}
+#endif
+
+		for (; src < blockEnd; ++src, ++dst)
+		{
+			*dst = *src;
+	
+			if (*src == '\r')
+			{
+				*dst = '\n';
+	
+				switch (mEOLNKind)
+				{
+					case eEOLN_MAC:
+						break;
+					
+					case eEOLN_DOS:
+						if (src < end - 1 and *(src + 1) == '\n')
+							++src;
+						else
+							inconsistent = true;
+						break;
+					
+					case eEOLN_UNIX:
 						inconsistent = true;
-					break;
-				
-				case eEOLN_UNIX:
-					inconsistent = true;
-					if (src < end - 1 and *(src + 1) == '\n')
-						++src;
-					break;
+						if (src < end - 1 and *(src + 1) == '\n')
+							++src;
+						break;
+				}
 			}
+			
+			if (*dst == '\n' and outLineStarts != nil)
+				outLineStarts->push_back(dst - mData + 1);
 		}
 	}
 
@@ -905,8 +1044,6 @@ string MTextBuffer::GetText()
 void MTextBuffer::WriteToFile(
 	ostream&		inFile)
 {
-	MoveGapTo(mLogicalLength);
-
 	if (mBOM)			// must be a unicode encoding
 	{
 		switch (mEncoding)
@@ -938,28 +1075,65 @@ void MTextBuffer::WriteToFile(
 	}
 
 	if (mEncoding == kEncodingUTF8)
-		inFile.write(mData, mLogicalLength);
+	{
+		// no need to close the gap, write the text before and after it
+		inFile.write(mData, mGapOffset);
+		inFile.write(mData + mGapOffset + mPhysicalLength - mLogicalLength,
+			mLogicalLength - mGapOffset);
+	}
 	else
 	{
-		wc_iterator txt(this, 0);
-		unique_ptr<MEncoder> encoder(MEncoder::GetEncoder(mEncoding));
+		MoveGapTo(mLogicalLength);
+
+		// convert blocks of text at a time, each block ends at a character boundary
+		const uint32 kConvertBlockSize = 1024 * 1024;
 		
-		while (txt.GetOffset() < mLogicalLength)
-		{
-			wchar_t uc = *txt++;
+		const char* eoln = mEOLNKind == eEOLN_DOS ? "\r\n" : "\r";
+		uint32 eolnLength = strlen(eoln);
+		
+		// a line end may take two characters
+		vector<char> buffer(2 * kMaxEncodedBytesPerUTF8Byte * kConvertBlockSize);
+		uint32 offset = 0;
 		
-			if (uc == '\n' and mEOLNKind != eEOLN_UNIX)
+		while (offset < mLogicalLength)
+		{
+			uint32 size = mLogicalLength - offset;
+			if (size > kConvertBlockSize)
 			{
-				encoder->WriteUnicode('\r');
-				if (mEOLNKind == eEOLN_DOS)
-					encoder->WriteUnicode('\n');
+				size = kConvertBlockSize;
+				while (size > kConvertBlockSize - 4 and (mData[offset + size] & 0x0C0) == 0x080)
+					--size;
 			}
+			
+			const char* text = mData + offset;
+			const char* end = text + size;
+			char* out = &buffer[0];
+
+			if (mEOLNKind == eEOLN_UNIX)
+				out += ConvertFromUTF8(mEncoding, text, size, out);
 			else
-				encoder->WriteUnicode(uc);
+			{
+				while (text < end)
+				{
+					const char* eol = static_cast<const char*>(memchr(text, '\n', end - text));
+					if (eol == nil)
+						eol = end;
+					
+					out += ConvertFromUTF8(mEncoding, text, eol - text, out);
+					
+					if (eol < end)
+					{
+						out += ConvertFromUTF8(mEncoding, eoln, eolnLength, out);
+						++eol;
+					}
+					
+					text = eol;
+				}
+			}
+			
+			inFile.write(&buffer[0], out - &buffer[0]);
+			offset += size;
 		}
-		
-		if (encoder->GetBufferSize())
-			inFile.write(static_cast<const char*>(encoder->Peek()), encoder->GetBufferSize());
 	}
 }
 
@@ -974,7 +1148,7 @@ void MTextBuffer::Insert(
 		if (mDoneActions.size() == 0)
 			THROW(("No Action defined"));
 
-		Action* a = mDoneActions.top();
+		Action* a = mDoneActions.back();
 		a->Insert(inPosition, inText, inLength);
 	}
 }
@@ -1002,11 +1176,13 @@ void MTextBuffer::InsertSelf(
 
 	assert(mPhysicalLength - mLogicalLength >= inLength);
 	MoveGapTo(inPosition);
+	InvalidateBalanceCheckpoints(inPosition);
 	
 	memcpy(mData + inPosition, inText, inLength);
 	
 	mLogicalLength += inLength;
 	mGapOffset += inLength;
+	++mChangeCount;
 }
 
 void MTextBuffer::Delete(
@@ -1019,7 +1195,7 @@ void MTextBuffer::Delete(
 		if (mDoneActions.size() == 0)
 			THROW(("No Action defined"));
 		
-		Action* a = mDoneActions.top();
+		Action* a = mDoneActions.back();
 		a->Delete(inPosition, inLength);
 	}
 }
@@ -1033,9 +1209,11 @@ void MTextBuffer::DeleteSelf(
 		THROW(("Logic error"));
 
 	MoveGapTo(inPosition + inLength);
+	InvalidateBalanceCheckpoints(inPosition);
 
 	mGapOffset -= inLength;
 	mLogicalLength -= inLength;
+	++mChangeCount;
 }
 
 void MTextBuffer::Replace(
@@ -1047,6 +1225,67 @@ void MTextBuffer::Replace(
 	Insert(inPosition, inText, inLength);
 }	
 
+// ---------------------------------------------------------------------------
+//	Balance checkpoints
+//
+//	Scanning for brackets may look a few characters ahead, e.g. to see if
+//	a slash starts a comment. Checkpoints just before a change are dropped
+//	as well to be safe.
+
+namespace
+{
+const uint32 kBalanceCheckpointLookAhead = 16;
+}
+
+bool MTextBuffer::GetBalanceCheckpoint(
+	const void*			inOwner,
+	uint32				inOffset,
+	MBalanceCheckpoint&	outCheckpoint) const
+{
+	bool result = false;
+	
+	if (inOwner == mBalanceOwner)
+	{
+		for (vector<MBalanceCheckpoint>::const_reverse_iterator c = mBalanceCheckpoints.rbegin();
+			c != mBalanceCheckpoints.rend(); ++c)
+		{
+			if (c->offset <= inOffset)
+			{
+				outCheckpoint = *c;
+				result = true;
+				break;
+			}
+		}
+	}
+	
+	return result;
+}
+
+void MTextBuffer::AddBalanceCheckpoint(
+	const void*			inOwner,
+	const MBalanceCheckpoint&
+						inCheckpoint) const
+{
+	if (inOwner != mBalanceOwner)
+	{
+		mBalanceCheckpoints.clear();
+		mBalanceOwner = inOwner;
+	}
+	
+	if (mBalanceCheckpoints.empty() or mBalanceCheckpoints.back().offset < inCheckpoint.offset)
+		mBalanceCheckpoints.push_back(inCheckpoint);
+}
+
+void MTextBuffer::InvalidateBalanceCheckpoints(
+	uint32				inOffset)
+{
+	while (not mBalanceCheckpoints.empty() and
+		mBalanceCheckpoints.back().offset + kBalanceCheckpointLookAhead > inOffset)
+	{
+		mBalanceCheckpoints.pop_back();
+	}
+}
+
 void MTextBuffer::MoveGapTo(
 	uint32			inPosition)
 {
@@ -1343,13 +1582,13 @@ MTextBuffer::StartAction(
 	const string&		inAction,
 	const MSelection&	inSelection)
 {
-	mDoneActions.push(new Action(*this, inAction));
-	mDoneActions.top()->SetSelectionBefore(inSelection);
+	mDoneActions.push_back(new Action(*this, inAction));
+	mDoneActions.back()->SetSelectionBefore(inSelection);
 	
 	while (mUndoneActions.size())
 	{
-		delete mUndoneActions.top();
-		mUndoneActions.pop();
+		delete mUndoneActions.back();
+		mUndoneActions.pop_back();
 	}
 
 	mActionFinished = false;
@@ -1358,6 +1597,36 @@ MTextBuffer::StartAction(
 void MTextBuffer::ActionFinished()
 {
 	mActionFinished = true;
+	
+	LimitUndoMemory();
+}
+
+// -----------------------------------------------------------------------------
+//	LimitUndoMemory
+//
+//	The undo history is kept within "undo memory limit" megabytes. Text
+//	saved by older actions is compressed first, if that is not enough the
+//	oldest actions are forgotten. The last action is always kept as is.
+
+void MTextBuffer::LimitUndoMemory()
+{
+	int32 megabytes = Preferences::GetInteger("undo memory limit", 64);
+	if (megabytes < 1)
+		megabytes = 1;
+	
+	uint64 limit = static_cast<uint64>(megabytes) * 1024 * 1024;
+	
+	while (mUndoMemory > limit and mCompressedActions + 1 < mDoneActions.size())
+		mDoneActions[mCompressedActions++]->Compress();
+	
+	while (mUndoMemory > limit and mDoneActions.size() > 1)
+	{
+		delete mDoneActions.front();
+		mDoneActions.pop_front();
+		
+		if (mCompressedActions > 0)
+			--mCompressedActions;
+	}
 }
 
 void
@@ -1366,7 +1635,7 @@ MTextBuffer::SetSelectionBefore(
 {
 	if (mDoneActions.size() == 0)
 		THROW(("No Action defined"));
-	mDoneActions.top()->SetSelectionBefore(inSelection);
+	mDoneActions.back()->SetSelectionBefore(inSelection);
 }
 
 MSelection
@@ -1374,7 +1643,7 @@ MTextBuffer::GetSelectionBefore() const
 {
 	if (mDoneActions.size() == 0)
 		THROW(("No Action defined"));
-	return mDoneActions.top()->GetSelectionBefore();
+	return mDoneActions.back()->GetSelectionBefore();
 }
 
 void
@@ -1382,7 +1651,7 @@ MTextBuffer::SetSelectionAfter(
 	const MSelection&	inSelection)
 {
 	if (not mActionFinished and mDoneActions.size() > 0 and mUndoneActions.size() == 0)
-		mDoneActions.top()->SetSelectionAfter(inSelection);
+		mDoneActions.back()->SetSelectionAfter(inSelection);
 }
 
 MSelection
@@ -1390,7 +1659,7 @@ MTextBuffer::GetSelectionAfter() const
 {
 	if (mDoneActions.size() == 0)
 		THROW(("No Action defined"));
-	return mDoneActions.top()->GetSelectionAfter();
+	return mDoneActions.back()->GetSelectionAfter();
 }
 
 bool
@@ -1401,7 +1670,7 @@ MTextBuffer::CanUndo(
 	if (mDoneActions.size())
 	{
 		result = true;
-		outAction = mDoneActions.top()->GetTitle();
+		outAction = mDoneActions.back()->GetTitle();
 	}
 	return result;
 }
@@ -1414,7 +1683,7 @@ MTextBuffer::CanRedo(
 	if (mUndoneActions.size())
 	{
 		result = true;
-		outAction = mUndoneActions.top()->GetTitle();
+		outAction = mUndoneActions.back()->GetTitle();
 	}
 	return result;
 }
@@ -1429,10 +1698,14 @@ MTextBuffer::Undo(
 	if (mDoneActions.size() == 0)
 		THROW(("No Action defined"));
 
-	Action* a = mDoneActions.top();
+	Action* a = mDoneActions.back();
 	a->Undo(outSelection, outChangeOffset, outChangeLength, outDelta);
-	mDoneActions.pop();
-	mUndoneActions.push(a);
+	mDoneActions.pop_back();
+	mUndoneActions.push_back(a);
+	
+	// the undone action may have been one of the compressed ones
+	if (mCompressedActions > mDoneActions.size())
+		mCompressedActions = mDoneActions.size();
 	
 	mActionFinished = true;
 }
@@ -1447,10 +1720,12 @@ MTextBuffer::Redo(
 	if (mUndoneActions.size() == 0)
 		THROW(("No Action defined"));
 
-	Action* a = mUndoneActions.top();
+	Action* a = mUndoneActions.back();
 	a->Redo(outSelection, outChangeOffset, outChangeLength, outDelta);
-	mUndoneActions.pop();
-	mDoneActions.push(a);
+	mUndoneActions.pop_back();
+	mDoneActions.push_back(a);
+	
+	LimitUndoMemory();
 }
 
 // -----------------------------------------------------------------------------
@@ -1600,6 +1875,8 @@ bool MTextBuffer::Find(
 	bool			inRegex,
 	MSelection&		outFound)
 {
+	MTraceScope trace("text", "Find");
+
 	bool result = false;
 	
 	if (inRegex)
@@ -16,6 +16,7 @@
 #include "MError.h"
 
 #include <stack>
+#include <deque>
 #include <boost/iterator/iterator_facade.hpp>
 #include <boost/thread.hpp>
 
@@ -37,7 +38,14 @@ class MSelection;
 class Action;
 class MMessageList;
 
-typedef std::stack<Action*>	ActionStack;
+typedef std::deque<Action*>	ActionStack;
+
+// the brackets that are still open at offset, see MLanguage::ScanBrackets
+struct MBalanceCheckpoint
+{
+	uint32				offset;
+	std::vector<int32>	open[3];	// offsets of unmatched '{', '[' and '('
+};
 
 class MTextBuffer
 {
@@ -49,8 +57,24 @@ class MTextBuffer
 
 	virtual		~MTextBuffer();
 
+	// when outLineStarts is not nil it receives the offsets
+	// of the lines after the first
 	void		ReadFromFile(
-					std::istream&	inFile);
+					std::istream&	inFile,
+					std::vector<uint32>*
+									outLineStarts = nil);
+
+	// same, but for data that was read already, the buffer takes
+	// ownership of inData which must be allocated with new[]
+	void		ReadFromData(
+					char*			inData,
+					uint32			inLength,
+					std::vector<uint32>*
+									outLineStarts = nil);
+
+	// take over the text of ioText, leaving it empty
+	void		TakeText(
+					MTextBuffer&	ioText);
 
 	void		WriteToFile(
 					std::ostream&	inFile);
@@ -168,6 +192,9 @@ class MTextBuffer
 	
 	uint32		GetSize() const										{ return mLogicalLength; }
 
+	// changes each time the text is changed
+	uint32		GetChangeCount() const								{ return mChangeCount; }
+
 	void		Insert(
 					uint32			inPosition,
 					const char*		inText,
@@ -246,6 +273,19 @@ class MTextBuffer
 					std::string		inPattern,
 					std::vector<std::string>&
 									ioStrings);
+
+	// checkpoints for bracket balancing, they belong to the language
+	// that made them and are dropped when the text before them changes
+	bool		GetBalanceCheckpoint(
+					const void*		inOwner,
+					uint32			inOffset,
+					MBalanceCheckpoint&
+									outCheckpoint) const;
+
+	void		AddBalanceCheckpoint(
+					const void*		inOwner,
+					const MBalanceCheckpoint&
+									inCheckpoint) const;
 	
 	// Undo support
 	void		StartAction(
@@ -276,6 +316,9 @@ class MTextBuffer
 	bool		CanRedo(
 					std::string&	outAction);
 
+	// bytes of text kept for undo and redo
+	uint64		GetUndoMemoryUsage() const						{ return mUndoMemory; }
+
 	void		Redo(
 					MSelection&		outSelection,		// The selection to use after this Redo
 					uint32&			outChangeOffset,	// The minimal offset of text touched by this Redo
@@ -292,7 +335,9 @@ class MTextBuffer
 						const char*	inText,
 						uint32		inLength);
 	
-	void			GuessLineEndCharacter();
+	void			GuessLineEndCharacter(
+						std::vector<uint32>*
+									outLineStarts = nil);
 	
 	void			InsertSelf(
 						uint32		inPosition,
@@ -309,6 +354,11 @@ class MTextBuffer
 	void			MoveGapTo(
 						uint32		inPosition);
 
+	void			InvalidateBalanceCheckpoints(
+						uint32		inOffset);
+
+	void			LimitUndoMemory();
+
 	typedef char	Skip[256];
 
 	void			InitSkip(
@@ -345,6 +395,13 @@ class MTextBuffer
 	MEncoding		mEncoding;
 	EOLNKind		mEOLNKind;
 	bool			mBOM;
+	mutable std::vector<MBalanceCheckpoint>
+					mBalanceCheckpoints;
+	mutable const void*
+					mBalanceOwner;
+	uint64			mUndoMemory;
+	uint32			mCompressedActions;	// at the start of mDoneActions
+	uint32			mChangeCount;
 };
 
 // inlines
@@ -7,6 +7,7 @@
 
 #include <limits>
 #include <cmath>
+#include <deque>
 #include <fcntl.h>
 #include <iostream>
 
@@ -38,6 +39,7 @@
 #include "MCommands.h"
 #include "MDocWindow.h"
 #include "MUtils.h"
+#include "MTrace.h"
 #include "MMenu.h"
 #include "MProject.h"
 #include "MDevice.h"
@@ -51,6 +53,7 @@
 #include "MPrinter.h"
 #include "MePubDocument.h"
 #include "MXHTMLTools.h"
+#include "MSymbolIndex.h"
 
 using namespace std;
 namespace io = boost::iostreams;
@@ -78,6 +81,9 @@ const char
 const uint32
 	kMDocStateSize = 36;	// sizeof(MDocState)
 
+const int32
+	kPlainViewEdit = 1;		// button in plain-view-alert
+
 }
 
 // ---------------------------------------------------------------------------
@@ -100,6 +106,315 @@ void MDocState::Swap()
 	mSwapHelper = swap(mSwapHelper);
 }
 
+// ---------------------------------------------------------------------------
+//	MParseJob, a parse of part of the text running in a background thread
+
+struct MParseJob
+{
+						MParseJob(
+							MLanguage*			inLanguage,
+							MTextBuffer*		inText,
+							uint32				inFrom,
+							uint32				inTo,
+							uint32				inGeneration)
+							: language(inLanguage)
+							, text(inText)
+							, from(inFrom)
+							, to(inTo)
+							, generation(inGeneration)
+							, done(false)
+							, failed(false) {}
+
+						~MParseJob()
+						{
+							delete text;
+						}
+
+	void				Run();
+
+	bool				IsDone()
+						{
+							boost::mutex::scoped_lock lock(mutex);
+							return done;
+						}
+
+	MLanguage*			language;
+	MTextBuffer*		text;
+	uint32				from, to;
+	uint32				generation;
+	MNamedRange			range;
+	MIncludeFileList	includes;
+	boost::mutex		mutex;
+	bool				done;
+	bool				failed;
+};
+
+void MParseJob::Run()
+{
+	MTraceScope trace("language", "Parse");
+
+	try
+	{
+		language->Parse(*text, range, includes);
+	}
+	catch (...)
+	{
+		failed = true;
+	}
+	
+	boost::mutex::scoped_lock lock(mutex);
+	done = true;
+}
+
+// ---------------------------------------------------------------------------
+//	MStyleJob, the states for all lines of a file that was just read. The
+//	text is a copy, the states are merged back in Idle.
+
+struct MStyleJob
+{
+						MStyleJob(
+							MLanguage*			inLanguage,
+							MTextBuffer*		inText,
+							uint32				inGeneration)
+							: language(inLanguage)
+							, text(inText)
+							, generation(inGeneration)
+							, done(false)
+							, failed(false) {}
+
+						~MStyleJob()
+						{
+							delete text;
+						}
+
+	void				Run();
+
+	bool				IsDone()
+						{
+							boost::mutex::scoped_lock lock(mutex);
+							return done;
+						}
+
+	MLanguage*			language;
+	MTextBuffer*		text;
+	vector<uint32>		starts;
+	vector<uint16>		states;		// states[0] is the initial state
+	uint32				generation;
+	boost::mutex		mutex;
+	bool				done;
+	bool				failed;
+};
+
+void MStyleJob::Run()
+{
+	MTraceScope trace("language", "StyleJob");
+
+	try
+	{
+		uint16 state = states.front();
+		
+		for (uint32 line = 1; line < starts.size(); ++line)
+		{
+			language->StyleLine(*text, starts[line - 1],
+				starts[line] - starts[line - 1], state);
+			states.push_back(state);
+		}
+	}
+	catch (...)
+	{
+		failed = true;
+	}
+	
+	boost::mutex::scoped_lock lock(mutex);
+	done = true;
+}
+
+// ---------------------------------------------------------------------------
+//	MStylePool, worker threads shared by all documents. Reopening a lot of
+//	documents at once then takes as long as styling the largest one.
+
+class MStylePool
+{
+  public:
+	static MStylePool&	Instance();
+
+	void				Submit(
+							MStyleJob*			inJob);
+
+	// take back a job that is not done yet, waits if it is running
+	void				Withdraw(
+							MStyleJob*			inJob);
+
+  private:
+						MStylePool();
+						~MStylePool();
+
+	void				Work();
+
+	boost::mutex				mMutex;
+	boost::condition_variable	mCondition;
+	deque<MStyleJob*>			mQueue;
+	vector<boost::thread*>		mThreads;
+	uint32						mRunning;
+};
+
+MStylePool::MStylePool()
+	: mRunning(0)
+{
+}
+
+MStylePool::~MStylePool()
+{
+	{
+		boost::mutex::scoped_lock lock(mMutex);
+		mQueue.clear();
+	}
+	
+	for (vector<boost::thread*>::iterator t = mThreads.begin(); t != mThreads.end(); ++t)
+	{
+		(*t)->join();
+		delete *t;
+	}
+}
+
+MStylePool& MStylePool::Instance()
+{
+	static MStylePool sInstance;
+	return sInstance;
+}
+
+void MStylePool::Submit(
+	MStyleJob*			inJob)
+{
+	boost::mutex::scoped_lock lock(mMutex);
+
+	if (mRunning == 0)
+	{
+		// these have all finished by now
+		for (vector<boost::thread*>::iterator t = mThreads.begin(); t != mThreads.end(); ++t)
+		{
+			(*t)->join();
+			delete *t;
+		}
+
+		mThreads.clear();
+	}
+	
+	mQueue.push_back(inJob);
+	
+	uint32 threadCount = max(gConcurrentJobs, 1U);
+	if (mRunning < threadCount)
+	{
+		mThreads.push_back(new boost::thread(boost::bind(&MStylePool::Work, this)));
+		++mRunning;
+	}
+}
+
+void MStylePool::Withdraw(
+	MStyleJob*			inJob)
+{
+	boost::mutex::scoped_lock lock(mMutex);
+
+	deque<MStyleJob*>::iterator i = find(mQueue.begin(), mQueue.end(), inJob);
+	if (i != mQueue.end())
+		mQueue.erase(i);
+	else
+	{
+		while (not inJob->IsDone())
+			mCondition.wait(lock);
+	}
+}
+
+void MStylePool::Work()
+{
+	for (;;)
+	{
+		MStyleJob* job;
+
+		{
+			boost::mutex::scoped_lock lock(mMutex);
+
+			if (mQueue.empty())
+			{
+				--mRunning;
+				break;
+			}
+
+			job = mQueue.front();
+			mQueue.pop_front();
+		}
+
+		// the job may be deleted as soon as it is done
+		job->Run();
+
+		boost::mutex::scoped_lock lock(mMutex);
+		mCondition.notify_all();
+	}
+}
+
+namespace
+{
+
+// The offsets in the named ranges and include file list are kept up
+// to date while editing. Offsets that fall inside a replaced area
+// are clamped to it, they will be reparsed anyway.
+
+inline
+uint32 ShiftOffset(
+	uint32				inOffset,
+	uint32				inAt,
+	uint32				inOldLength,
+	uint32				inNewLength)
+{
+	if (inOffset >= inAt + inOldLength)
+		inOffset = inOffset - inOldLength + inNewLength;
+	else if (inOffset > inAt + inNewLength)
+		inOffset = inAt + inNewLength;
+	return inOffset;
+}
+
+void ShiftNamedRange(
+	MNamedRange&		ioRange,
+	uint32				inAt,
+	uint32				inOldLength,
+	uint32				inNewLength)
+{
+	if (ioRange.end >= inAt)
+	{
+		ioRange.begin = ShiftOffset(ioRange.begin, inAt, inOldLength, inNewLength);
+		ioRange.end = ShiftOffset(ioRange.end, inAt, inOldLength, inNewLength);
+		ioRange.selectFrom = ShiftOffset(ioRange.selectFrom, inAt, inOldLength, inNewLength);
+		ioRange.selectTo = ShiftOffset(ioRange.selectTo, inAt, inOldLength, inNewLength);
+	
+		for (vector<MNamedRange>::iterator r = ioRange.subrange.begin(); r != ioRange.subrange.end(); ++r)
+			ShiftNamedRange(*r, inAt, inOldLength, inNewLength);
+	}
+}
+
+void OffsetNamedRange(
+	MNamedRange&		ioRange,
+	uint32				inDelta)
+{
+	ioRange.begin += inDelta;
+	ioRange.end += inDelta;
+	ioRange.selectFrom += inDelta;
+	ioRange.selectTo += inDelta;
+
+	for (vector<MNamedRange>::iterator r = ioRange.subrange.begin(); r != ioRange.subrange.end(); ++r)
+		OffsetNamedRange(*r, inDelta);
+}
+
+// some parsers start a range one character before the name, use
+// the lowest of the two to determine where a range starts.
+inline
+uint32 RangeStart(
+	const MNamedRange&	inRange)
+{
+	return min(inRange.begin, inRange.selectFrom);
+}
+
+}
+
 // ---------------------------------------------------------------------------
 //	MTextDocument
 
@@ -142,12 +457,21 @@ void MTextDocument::Init()
 	mNamedRange = nil;
 	mIncludeFiles = nil;
 	mNeedReparse = false;
+	mParseDirtyFrom = numeric_limits<uint32>::max();
+	mParseDirtyTo = 0;
+	mParseGeneration = 0;
+	mParseJob = nil;
+	mParseThread = nil;
+	mStyleJob = nil;
 	mSoftwrap = false;
 	mShowWhiteSpace = false;
+	mPlainView = false;
+	mViewOnly = false;
 	mFastFindMode = false;
 	mCompletionIndex = -1;
 	mStdErrWindow = nil;
 	mPCLine = numeric_limits<uint32>::max();
+	mStylePendingFrom = numeric_limits<uint32>::max();
 	mDataFD = -1;
  
 	mCharsPerTab = gCharsPerTab;
@@ -163,6 +487,20 @@ MTextDocument::~MTextDocument()
 	if (sWorksheet == this)
 		sWorksheet = nil;
 	
+	if (mParseThread != nil)
+	{
+		mParseThread->join();
+		delete mParseThread;
+	}
+	
+	delete mParseJob;
+
+	if (mStyleJob != nil)
+	{
+		MStylePool::Instance().Withdraw(mStyleJob);
+		delete mStyleJob;
+	}
+
 	delete mNamedRange;
 	delete mIncludeFiles;
 	
@@ -197,6 +535,7 @@ void MTextDocument::SetFileNameHint(
 		mIncludeFiles = new MIncludeFileList;
 	}
 	
+	InvalidateParse();
 	Rewrap();
 }
 
@@ -204,6 +543,8 @@ bool MTextDocument::DoSave()
 {
 	bool result = MDocument::DoSave();
 	MProject::RecheckFiles();
+	if (result and mFile.IsLocal())
+		MProject::FileSaved(mFile.GetPath());
 	return result;
 }
 
@@ -214,7 +555,7 @@ bool MTextDocument::DoSaveAs(
 
 	if (MDocument::DoSaveAs(inFile))
 	{
-		if (mLanguage == nil)
+		if (mLanguage == nil and not mPlainView)
 		{
 			mLanguage = MLanguage::GetLanguageForDocument(
 							mFile.GetFileName(), mText);
@@ -227,6 +568,7 @@ bool MTextDocument::DoSaveAs(
 				if (mIncludeFiles == nil)
 					mIncludeFiles = new MIncludeFileList;
 
+				InvalidateParse();
 				TouchAllLines();
 				UpdateDirtyLines();
 			}
@@ -238,6 +580,11 @@ bool MTextDocument::DoSaveAs(
 	return result;
 }
 
+bool MTextDocument::IsReadOnly() const
+{
+	return mViewOnly or MDocument::IsReadOnly();
+}
+
 void MTextDocument::AddNotifier(
 	MDocClosedNotifier&		inNotifier,
 	bool					inRead)
@@ -284,9 +631,44 @@ void MTextDocument::SetModified(bool inModified)
 void MTextDocument::ReadFile(
 	istream&		inFile)
 {
-	mText.ReadFromFile(inFile);
+	vector<uint32> lineStarts;
+	mText.ReadFromFile(inFile, &lineStarts);
 	
-	mLanguage = MLanguage::GetLanguageForDocument(mFile.GetFileName(), mText);
+	TextRead(lineStarts);
+}
+
+// ---------------------------------------------------------------------------
+//	ReadText, the text was read and decoded in a background thread
+
+void MTextDocument::ReadText(
+	MTextBuffer&			ioText,
+	const vector<uint32>&	inLineStarts)
+{
+	mText.TakeText(ioText);
+	
+	TextRead(inLineStarts);
+}
+
+// ---------------------------------------------------------------------------
+//	TextRead
+
+void MTextDocument::TextRead(
+	const vector<uint32>&	inLineStarts)
+{
+	// files larger than this are shown in plain view, without styling,
+	// softwrap or parsing. The line starts collected while reading are
+	// all that is needed then.
+	uint32 plainViewSize = Preferences::GetInteger("plain view size", 64);
+	mPlainView = plainViewSize > 0 and mText.GetSize() / (1024 * 1024) >= plainViewSize;
+	mViewOnly = mPlainView;
+	
+	if (mPlainView)
+	{
+		mLanguage = nil;
+		mSoftwrap = false;
+	}
+	else
+		mLanguage = MLanguage::GetLanguageForDocument(mFile.GetFileName(), mText);
 	
 	if (mLanguage != nil)
 	{
@@ -299,11 +681,13 @@ void MTextDocument::ReadFile(
 			mIncludeFiles = new MIncludeFileList;
 	}
 
-	mNeedReparse = true;
+	InvalidateParse();
 
 	ReInit();
-	Rewrap();
-	UpdateDirtyLines();
+	Rewrap(inLineStarts);
+
+	if (not StartStyling())
+		UpdateDirtyLines();
 }
 
 // ---------------------------------------------------------------------------
@@ -314,7 +698,9 @@ void MTextDocument::WriteFile(
 {
 	try
 	{
-		if (Preferences::GetInteger("force newline at eof", 1) == 1 and
+		// a plain view that was not edited is written as it was read
+		if (not mViewOnly and
+			Preferences::GetInteger("force newline at eof", 1) == 1 and
 			mText.GetChar(mText.GetSize() - 1) != '\n')
 		{
 			StartAction(kTypeAction);
@@ -403,6 +789,7 @@ void MTextDocument::SetText(
 		mIncludeFiles = new MIncludeFileList;
 	}
 
+	InvalidateParse();
 	Rewrap();
 }
 
@@ -534,6 +921,12 @@ void MTextDocument::SetLanguage(
 	const string&		inLanguage)
 {
 	mLanguage = MLanguage::GetLanguage(inLanguage);
+	if (mLanguage != nil and mPlainView)
+	{
+		mPlainView = mViewOnly = false;
+		eFileSpecChanged(this, mFile);
+	}
+	InvalidateParse();
 
 	ReInit();
 	Rewrap();
@@ -549,7 +942,7 @@ void MTextDocument::SetCharsPerTab(
 	mCharsPerTab = inCharsPerTab;
 	
 	ReInit();
-	Rewrap();
+	RewrapForLayout();
 	UpdateDirtyLines();
 }
 
@@ -597,14 +990,14 @@ bool MTextDocument::ReadDocState(
 			else
 				mSelection.Set(ioDocState.mSelection[0], ioDocState.mSelection[1]);
 		
-			mSoftwrap = ioDocState.mFlags.mSoftwrap;
+			mSoftwrap = ioDocState.mFlags.mSoftwrap and not mPlainView;
 			
 			if (mCharsPerTab != ioDocState.mFlags.mTabWidth and
 				ioDocState.mFlags.mTabWidth != 0)
 			{
 				mCharsPerTab = ioDocState.mFlags.mTabWidth;
 				ReInit();
-				Rewrap();
+				RewrapForLayout();
 			}
 
 			result = true;
@@ -666,7 +1059,8 @@ void MTextDocument::FindWord(uint32 inOffset, uint32& outMinAnchor, uint32& outM
 void MTextDocument::HandleDeleteKey(MDirection inDirection)
 {
 //	FinishAction();
-	StartAction(kTypeAction);
+	if (not StartAction(kTypeAction))
+		return;
 	
 	if (mSelection.IsEmpty())
 	{
@@ -912,7 +1306,8 @@ void MTextDocument::Type(
 	if (mTargetTextView != nil)
 		mTargetTextView->ObscureCursor();
 	
-	StartAction(kTypeAction);
+	if (not StartAction(kTypeAction))
+		return;
 	
 	if (not mSelection.IsEmpty())
 		DeleteSelectedText();
@@ -1045,7 +1440,11 @@ void MTextDocument::Drop(
 	uint32			inSize,
 	bool			inDragMove)
 {
-	StartAction(kDropAction);
+	if (IsLoading())
+		return;
+
+	if (not StartAction(kDropAction))
+		return;
 	
 	if (inDragMove)
 	{
@@ -1236,7 +1635,8 @@ void MTextDocument::CCCMarkedLines(bool inCopy, bool inClear)
 	
 	if (inClear)
 	{
-		StartAction(kCutAction);
+		if (not StartAction(kCutAction))
+			return;
 		
 		uint32 offset = mSelection.GetMinOffset();
 		
@@ -1418,12 +1818,17 @@ bool MTextDocument::GetSoftwrap() const
 }
 
 uint32 MTextDocument::GetIndent(uint32 inOffset) const
+{
+	return GetIndent(inOffset, mWrapWidth);
+}
+
+uint32 MTextDocument::GetIndent(uint32 inOffset, uint32 inWrapWidth) const
 {
 	uint32 indent = 0;
 	
 	uint32 maxWidth = numeric_limits<uint32>::max();
-	if (mWrapWidth > 0)
-		maxWidth = mWrapWidth;
+	if (inWrapWidth > 0)
+		maxWidth = inWrapWidth;
 
 	for (MTextBuffer::const_iterator i(&mText, inOffset); i != mText.end(); ++i)
 	{
@@ -1475,6 +1880,7 @@ void MTextDocument::FindLineBreaks(
 	uint32				inToOffset,
 	uint16				inState,
 	uint32				inIndent,
+	uint32				inWrapWidth,
 	vector<uint32>&		outBreaks) const
 {
 	assert(inFromOffset < mText.GetSize());
@@ -1508,9 +1914,9 @@ void MTextDocument::FindLineBreaks(
 	// if we're not softwrapping, the next line break is now known
 	uint32 lastBreak = t.GetOffset() + 1;
 	
-	if (GetSoftwrap() and mWrapWidth > 0 and lastBreak > inFromOffset + 1)
+	if (inWrapWidth > 0 and lastBreak > inFromOffset + 1)
 	{
-		if (mWrapWidth < inIndent * mCharWidth)
+		if (inWrapWidth < inIndent * mCharWidth)
 		{
 			// overflow of leading whitespace, force a line break
 			lastBreak = s.GetOffset();
@@ -1519,7 +1925,7 @@ void MTextDocument::FindLineBreaks(
 		{
 			// compensate for leading tabs
 			inFromOffset = s.GetOffset();
-			uint32 width = mWrapWidth - inIndent * mCharWidth;
+			uint32 width = inWrapWidth - inIndent * mCharWidth;
 			
 			// length of the text to examine
 			uint32 length = lastBreak - inFromOffset;
@@ -1558,6 +1964,8 @@ int32 MTextDocument::RewrapLines(
 	uint32		inFrom,
 	uint32		inTo)
 {
+	MTraceScope trace("text", "RewrapLines");
+
 	// save the mark offsets
 	vector<uint32> markOffsets;
 	
@@ -1634,10 +2042,12 @@ int32 MTextDocument::RewrapLines(
 	{
 		vector<uint32> breaks;
 		
+		uint32 wrapWidth = GetSoftwrap() ? mWrapWidth : 0;
+		
 		if (isHardBreak)
-			FindLineBreaks(start, inTo, state, 0, breaks);
+			FindLineBreaks(start, inTo, state, 0, wrapWidth, breaks);
 		else
-			FindLineBreaks(start, inTo, state, indent, breaks);
+			FindLineBreaks(start, inTo, state, indent, wrapWidth, breaks);
 		
 		assert(not breaks.empty());
 		
@@ -1683,6 +2093,81 @@ int32 MTextDocument::RewrapLines(
 	return cnt;
 }
 
+// ---------------------------------------------------------------------------
+//	LayoutForPrinting
+//
+//	Printing uses its own wrap width. Instead of rewrapping the document
+//	twice, the lines are laid out in a separate table. The hard line starts
+//	and their states are taken from mLineInfo, only the soft breaks are
+//	computed. This is done a number of lines at a time, the print operation
+//	calls it from its paginate signal. The document can still be changed
+//	in between, the layout keeps text offsets only, so a rewrap does not
+//	matter, but a change of the text makes it useless and printing stops.
+
+bool MTextDocument::LayoutForPrinting(
+	MPrintLayout&		ioLayout,
+	uint32				inMaxLines)
+{
+	if (ioLayout.changes != mText.GetChangeCount())
+		THROW(("The document was changed while printing"));
+
+	uint32 size = mText.GetSize();
+	
+	if (size == 0)
+	{
+		MPrintLine line = { 0, 0, mLineInfo.empty() ? 0 : mLineInfo[0].state };
+		ioLayout.lines.assign(1, line);
+		ioLayout.next = size;
+		return true;
+	}
+	
+	uint32 lineNr = OffsetToLine(ioLayout.next);
+	
+	for (uint32 n = 0; n < inMaxLines and ioLayout.next < size; ++n)
+	{
+		uint32 start = ioLayout.next;
+		uint16 state = mLineInfo[lineNr].state;
+		
+		// the restyle in Idle did not get here yet, carry the state over
+		if (lineNr > 0 and IsStylePending(lineNr))
+			state = ioLayout.state;
+		
+		vector<uint32> breaks;
+		FindLineBreaks(start, size, state, 0, ioLayout.width, breaks);
+		
+		uint32 indent = 0;
+		if (breaks.size() > 1)
+			indent = GetIndent(start, ioLayout.width);
+		
+		for (vector<uint32>::iterator b = breaks.begin(); b != breaks.end(); ++b)
+		{
+			MPrintLine line = { start, b == breaks.begin() ? 0 : indent, state };
+			ioLayout.lines.push_back(line);
+
+			if (mLanguage != nil and b + 1 != breaks.end())
+				mLanguage->StyleLine(mText, start, *b - start, state);
+			
+			start = *b;
+		}
+		
+		ioLayout.next = start;
+		
+		// skip the soft wrapped lines on screen
+		do
+			++lineNr;
+		while (lineNr < mLineInfo.size() and mLineInfo[lineNr].start < start);
+		
+		if (mLanguage != nil and lineNr < mLineInfo.size() and IsStylePending(lineNr))
+		{
+			MPrintLine& last = ioLayout.lines.back();
+			mLanguage->StyleLine(mText, last.start, start - last.start, state);
+			ioLayout.state = state;
+		}
+	}
+	
+	return ioLayout.next >= size;
+}
+
 void MTextDocument::BoundsChanged()
 {
 	mWrapWidth = mTargetTextView->GetWrapWidth();	
@@ -1710,17 +2195,85 @@ void MTextDocument::Rewrap()
 	eLineCountChanged();
 }
 
+// ---------------------------------------------------------------------------
+//	RewrapForLayout
+//
+//	Without softwrap and styling the lines only change when the text does,
+//	a plain view of a huge file is not scanned again.
+
+void MTextDocument::RewrapForLayout()
+{
+	if (not mPlainView or GetSoftwrap() or mLanguage != nil)
+		Rewrap();
+}
+
+// ---------------------------------------------------------------------------
+//	Rewrap
+//
+//	Variant used after reading a file, the line starts were collected while
+//	the line ends were converted. Without softwrap these are all the lines
+//	there are. The lines are left dirty, RestyleDirtyLines will style them.
+
+void MTextDocument::Rewrap(
+	const vector<uint32>&	inLineStarts)
+{
+	if (GetSoftwrap())
+		Rewrap();
+	else
+	{
+		vector<uint32> markOffsets;
+
+		for (MLineInfoArray::iterator i = mLineInfo.begin(); i != mLineInfo.end(); ++i)
+		{
+			if (i->marked)
+				markOffsets.push_back(i->start);
+		}
+		
+		uint16 state = 0;
+		if (mLanguage != nil)
+			state = mLanguage->GetInitialState(mFile.GetFileName(), mText);
+		
+		mLineInfo.clear();
+		mLineInfo.reserve(inLineStarts.size() + 1);
+		mLineInfo.push_back(MLineInfo(0, state));
+		
+		for (vector<uint32>::const_iterator start = inLineStarts.begin(); start != inLineStarts.end(); ++start)
+			mLineInfo.push_back(MLineInfo(*start, 0));
+
+		for (vector<uint32>::iterator i = markOffsets.begin(); i != markOffsets.end(); ++i)
+			MarkLine(OffsetToLine(*i));
+		
+		mNeedReparse = true;
+		eLineCountChanged();
+	}
+}
+
 // ---------------------------------------------------------------------------
 //  RestyleDirtyLines
+//
+//	A change in state runs on to the next line, opening a comment at the top
+//	restyles the entire file. Lines up to inToLine are always done, after
+//	that the restyle stops at inDeadline. The line where it stopped gets the
+//	restyle flag and Idle continues from there. Returns true when done.
 
-void MTextDocument::RestyleDirtyLines(
-	uint32	inFrom)
+bool MTextDocument::RestyleDirtyLines(
+	uint32	inFrom,
+	uint32	inToLine,
+	double	inDeadline)
 {
+	const uint32 kLinesPerTimeCheck = 256;
+
+	MTraceScope trace("text", "RestyleDirtyLines");
+
 	assert(mLanguage != nil);
 
+	mStylePendingFrom = numeric_limits<uint32>::max();
+
+	uint32 count = 0;
+
 	for (uint32 line = inFrom; line < mLineInfo.size(); ++line)
 	{
-		if (mLineInfo[line].dirty)
+		if (mLineInfo[line].dirty or mLineInfo[line].restyle)
 		{
 			uint16 state;
 			if (line == 0)
@@ -1728,9 +2281,29 @@ void MTextDocument::RestyleDirtyLines(
 			else
 				state = mLineInfo[line].state;
 			
-			while (mLineInfo[line].dirty and
-				++line < mLineInfo.size())
+			while ((mLineInfo[line].dirty or mLineInfo[line].restyle) and
+				line + 1 < mLineInfo.size())
 			{
+				if (line >= inToLine and
+					++count % kLinesPerTimeCheck == 0 and
+					GetLocalTime() > inDeadline)
+				{
+					// out of time, remember what is left for Idle
+					mLineInfo[line].restyle = true;
+					mStylePendingFrom = line + 1;
+
+					for (++line; line < mLineInfo.size(); ++line)
+					{
+						if (mLineInfo[line].dirty)
+							mLineInfo[line].restyle = true;
+					}
+					
+					return false;
+				}
+				
+				mLineInfo[line].restyle = false;
+				++line;
+
 				mLanguage->StyleLine(mText, LineStart(line - 1),
 					LineStart(line) - LineStart(line - 1), state);
 
@@ -1740,8 +2313,12 @@ void MTextDocument::RestyleDirtyLines(
 					mLineInfo[line].state = state;
 				}
 			}
+			
+			mLineInfo[line].restyle = false;
 		}
 	}
+	
+	return true;
 }
 
 // ---------------------------------------------------------------------------
@@ -1769,8 +2346,19 @@ void MTextDocument::GetLine(
 
 void MTextDocument::UpdateDirtyLines()
 {
+	const double kRestyleTime = 0.01;
+
 	if (mLanguage != nil)
-		RestyleDirtyLines(0);
+	{
+		uint32 firstLine = 0, lastLine = numeric_limits<uint32>::max();
+		if (mTargetTextView != nil)
+		{
+			mTargetTextView->GetVisibleLineSpan(firstLine, lastLine);
+			lastLine += 2;
+		}
+		
+		RestyleDirtyLines(0, lastLine, GetLocalTime() + kRestyleTime);
+	}
 
 	eInvalidateDirtyLines();
 	
@@ -2251,9 +2839,23 @@ uint32 MTextDocument::GuessMaxWidth() const
 // -----------------------------------------------------------------------------
 // StartAction
 
-void MTextDocument::StartAction(
+bool MTextDocument::StartAction(
 	const char*		inTitle)
 {
+	// edits would be lost when the text that is being read arrives
+	if (IsLoading())
+		THROW(("The document is still being loaded"));
+
+	// a plain view stays read only until the user agrees to edit it
+	if (mViewOnly)
+	{
+		if (DisplayAlert("plain-view-alert") != kPlainViewEdit)
+			return false;
+		
+		mViewOnly = false;
+		eFileSpecChanged(this, mFile);
+	}
+
 	mFastFindMode = false;
 
 	if (mCurrentAction != inTitle)
@@ -2262,6 +2864,8 @@ void MTextDocument::StartAction(
 		mCurrentAction = inTitle;
 		mLastAction = kNoAction;
 	}
+	
+	return true;
 }
 
 void MTextDocument::FinishAction()
@@ -2298,6 +2902,8 @@ void MTextDocument::Insert(
 		mText.Insert(inOffset, inText, inLength);
 		if (not mDirty)
 			SetModified(true);
+		
+		ShiftParseRanges(inOffset, 0, inLength);
 	
 		uint32 line = OffsetToLine(inOffset);
 		mLineInfo[line].dirty = true;
@@ -2342,6 +2948,8 @@ void MTextDocument::Delete(
 		if (not mDirty)
 			SetModified(true);
 
+		ShiftParseRanges(inOffset, inLength, 0);
+
 		uint32 anchor = mSelection.GetAnchor();
 		if (inOffset + inLength <= anchor)
 			anchor -= inLength;
@@ -2384,6 +2992,141 @@ void MTextDocument::Delete(
 	}
 }
 
+// ---------------------------------------------------------------------------
+//	Replace
+//
+//	The edits are applied to the text back to front, so the offsets of the
+//	earlier ones stay valid and undo only stores the changed regions, all in
+//	the current action. The line starts are then updated and rewrapped once,
+//	as if the range from the first to the last edit was deleted and inserted.
+//	Marks and breakpoints in that range are kept by offset, the way the
+//	individual edits would have moved them.
+
+namespace
+{
+
+// map sorted offsets through sorted edits, like Delete and Insert would
+void MapOffsets(
+	const MTextEditList&	inEdits,
+	vector<uint32>&			ioOffsets)
+{
+	MTextEditList::const_iterator e = inEdits.begin();
+	int32 delta = 0;
+	
+	for (vector<uint32>::iterator o = ioOffsets.begin(); o != ioOffsets.end(); ++o)
+	{
+		while (e != inEdits.end() and e->offset + e->length <= *o)
+		{
+			delta += static_cast<int32>(e->text.length()) - static_cast<int32>(e->length);
+			++e;
+		}
+		
+		if (e != inEdits.end() and e->offset < *o)
+			*o = e->offset + delta;
+		else
+			*o += delta;
+	}
+}
+
+}
+
+void MTextDocument::Replace(
+	const MTextEditList&	inEdits)
+{
+	if (inEdits.empty())
+		return;
+	
+	if (mFile.ReadOnly() and not mWarnedReadOnly)
+	{
+		DisplayAlert("read-only-alert");
+		mWarnedReadOnly = true;
+	}
+	
+	uint32 start = inEdits.front().offset;
+	uint32 end = inEdits.back().offset + inEdits.back().length;
+	
+	assert(end <= mText.GetSize());
+
+	uint32 firstLine = OffsetToLine(start);
+	uint32 lastLine = OffsetToLine(end);
+	
+	vector<uint32> marks, breakpoints;
+	for (uint32 line = firstLine; line <= lastLine and line < mLineInfo.size(); ++line)
+	{
+		if (mLineInfo[line].marked)
+			marks.push_back(mLineInfo[line].start);
+		if (mLineInfo[line].brkp)
+			breakpoints.push_back(mLineInfo[line].start);
+	}
+
+	MapOffsets(inEdits, marks);
+	MapOffsets(inEdits, breakpoints);
+	
+	vector<uint32> selection;
+	selection.push_back(mSelection.GetAnchor());
+	selection.push_back(mSelection.GetCaret());
+	
+	bool swapped = selection[0] > selection[1];
+	if (swapped)
+		swap(selection[0], selection[1]);
+	
+	MapOffsets(inEdits, selection);
+	
+	if (swapped)
+		swap(selection[0], selection[1]);
+	
+	int32 delta = 0;
+	
+	for (MTextEditList::const_reverse_iterator e = inEdits.rbegin(); e != inEdits.rend(); ++e)
+	{
+		assert(e + 1 == inEdits.rend() or (e + 1)->offset + (e + 1)->length <= e->offset);
+
+		if (e->length > 0)
+			mText.Delete(e->offset, e->length);
+		
+		if (not e->text.empty())
+			mText.Insert(e->offset, e->text.c_str(), e->text.length());
+		
+		delta += static_cast<int32>(e->text.length()) - static_cast<int32>(e->length);
+	}
+	
+	uint32 length = end - start + delta;
+	
+	if (not mDirty)
+		SetModified(true);
+	
+	ShiftParseRanges(start, end - start, length);
+	
+	mLineInfo[firstLine].dirty = true;
+	for (uint32 line = lastLine + 1; line < mLineInfo.size(); ++line)
+		mLineInfo[line].start += delta;
+	
+	if (firstLine != lastLine)
+		mLineInfo.erase(mLineInfo.begin() + firstLine + 1, mLineInfo.begin() + lastLine + 1);
+	
+	int32 shift = RewrapLines(start, start + length) - static_cast<int32>(lastLine - firstLine);
+	
+	// RewrapLines keeps marks by offset too, but only those it saw itself
+	uint32 line = firstLine, endLine = OffsetToLine(start + length);
+	for (; line <= endLine and line < mLineInfo.size(); ++line)
+		mLineInfo[line].marked = mLineInfo[line].brkp = false;
+	
+	for (vector<uint32>::iterator m = marks.begin(); m != marks.end(); ++m)
+		mLineInfo[OffsetToLine(*m)].marked = true;
+	
+	for (vector<uint32>::iterator b = breakpoints.begin(); b != breakpoints.end(); ++b)
+		mLineInfo[OffsetToLine(*b)].brkp = true;
+	
+	mSelection.Set(selection[0], selection[1]);
+	mText.SetSelectionAfter(mSelection);
+	
+	if (shift != 0)
+	{
+		eLineCountChanged();
+		eShiftLines(firstLine, shift);
+	}
+}
+
 bool MTextDocument::CanUndo(string& outAction)
 {
 	return mText.CanUndo(outAction);
@@ -2450,6 +3193,9 @@ void MTextDocument::RepairAfterUndo(
 	lineDelta += RewrapLines(inOffset, inOffset + inLength);
 	
 	eShiftLines(OffsetToLine(inOffset), lineDelta);
+	
+	// an undo may touch text all over the document
+	InvalidateParse();
 }
 
 // -----------------------------------------------------------------------------
@@ -2485,11 +3231,14 @@ void MTextDocument::DoShiftLeft()
 {
 	Select(mSelection.SelectLines());
 	
-	StartAction("Shift left");
+	if (not StartAction("Shift left"))
+		return;
 	
 	uint32 minLine = mSelection.GetMinLine();
 	uint32 maxLine = mSelection.GetMaxLine();
 	
+	MTextEditList edits;
+	
 	for (uint32 line = minLine; line <= maxLine; ++line)
 	{
 		uint32 offset = LineStart(line);
@@ -2507,9 +3256,14 @@ void MTextDocument::DoShiftLeft()
 			++n;
 		
 		if (n > 0)
-			Delete(offset, n);
+		{
+			MTextEdit edit = { offset, n };
+			edits.push_back(edit);
+		}
 	}
 	
+	Replace(edits);
+	
 	FinishAction();
 }
 
@@ -2517,7 +3271,8 @@ void MTextDocument::DoShiftRight()
 {
 	Select(mSelection.SelectLines());
 	
-	StartAction("Shift right");
+	if (not StartAction("Shift right"))
+		return;
 	
 	uint32 anchor = mSelection.GetAnchor();
 	uint32 caret = mSelection.GetCaret();
@@ -2525,12 +3280,17 @@ void MTextDocument::DoShiftRight()
 	uint32 minLine = mSelection.GetMinLine();
 	uint32 maxLine = mSelection.GetMaxLine();
 	
+	MTextEditList edits;
+	
 	for (uint32 line = minLine; line <= maxLine; ++line)
 	{
-		Insert(LineStart(line), "\t", 1);
+		MTextEdit edit = { LineStart(line), 0, "\t" };
+		edits.push_back(edit);
 		caret += 1;
 	}
 	
+	Replace(edits);
+	
 	mSelection.Set(anchor, caret);
 	FinishAction();
 }
@@ -2546,11 +3306,14 @@ void MTextDocument::DoComment()
 		selectionStart = mSelection.GetMinOffset();
 		selectionEnd = mSelection.GetMaxOffset();
 		
-		StartAction("Comment");
+		if (not StartAction("Comment"))
+			return;
 
 		uint32 minLine = mSelection.GetMinLine();
 		uint32 maxLine = mSelection.GetMaxLine();
 		
+		MTextEditList edits;
+		
 		for (uint32 line = minLine; line <= maxLine; ++line)
 		{
 			uint32 offset;
@@ -2576,12 +3339,14 @@ void MTextDocument::DoComment()
 			
 			mLanguage->CommentLine(text);
 			
-			Delete(offset, length);
-			Insert(offset, text.c_str(), text.length());
-			
 			selectionEnd += text.length() - length;
+			
+			MTextEdit edit = { offset, length, text };
+			edits.push_back(edit);
 		}
 		
+		Replace(edits);
+		
 		Select(selectionStart, selectionEnd);
 		mText.SetSelectionAfter(mSelection);
 
@@ -2600,11 +3365,14 @@ void MTextDocument::DoUncomment()
 		selectionStart = mSelection.GetMinOffset();
 		selectionEnd = mSelection.GetMaxOffset();
 		
-		StartAction("Uncomment");
+		if (not StartAction("Uncomment"))
+			return;
 
 		uint32 minLine = mSelection.GetMinLine();
 		uint32 maxLine = mSelection.GetMaxLine();
 		
+		MTextEditList edits;
+		
 		for (uint32 line = minLine; line <= maxLine; ++line)
 		{
 			uint32 offset;
@@ -2630,12 +3398,14 @@ void MTextDocument::DoUncomment()
 			
 			mLanguage->UncommentLine(text);
 			
-			Delete(offset, length);
-			Insert(offset, text.c_str(), text.length());
-			
 			selectionEnd += text.length() - length;
+			
+			MTextEdit edit = { offset, length, text };
+			edits.push_back(edit);
 		}
 		
+		Replace(edits);
+		
 		Select(selectionStart, selectionEnd);
 		mText.SetSelectionAfter(mSelection);
 		
@@ -2645,7 +3415,8 @@ void MTextDocument::DoUncomment()
 								
 void MTextDocument::DoEntab()
 {
-	StartAction("Entab");
+	if (not StartAction("Entab"))
+		return;
 	
 	if (mSelection.IsEmpty())
 		Select(0, mText.GetSize());
@@ -2661,6 +3432,11 @@ void MTextDocument::DoEntab()
 	int column = startColumn;
 	string::iterator i = text.begin();
 	
+	// build the result in a new string, erasing and inserting
+	// in text itself would be quadratic
+	string result;
+	result.reserve(text.length());
+	
 	while (i != text.end())
 	{
 		switch (*i)
@@ -2677,25 +3453,26 @@ void MTextDocument::DoEntab()
 				while (i != text.end() and *i == ' ' and (column % mCharsPerTab) != 0);
 				
 				if (i - s > 1 and (column % mCharsPerTab) == 0)
+					result += '\t';
+				else if (i != text.end() and *i == '\t')
 				{
-					text.erase(s, i);
-					i = text.insert(s, '\t') + 1;
-				}
-				else if (*i == '\t')
-				{
-					text.erase(s, i);
-					i = s + 1;
+					result += '\t';
+					++i;
 					column = mCharsPerTab * ((column / mCharsPerTab) + 1);
 				}
+				else
+					result.append(s, i);
 				break;
 			}
 
 			case '\t':
+				result += '\t';
 				column = mCharsPerTab * ((column / mCharsPerTab) + 1);
 				++i;
 				break;
 
 			case '\n':
+				result += '\n';
 				if (block)
 					column = startColumn;
 				else
@@ -2704,9 +3481,13 @@ void MTextDocument::DoEntab()
 				break;
 
 			default:
-				i = next_cursor_position(i, text.end());
+			{
+				string::iterator n = next_cursor_position(i, text.end());
+				result.append(i, n);
+				i = n;
 				++column;
 				break;
+			}
 		}
 	}
 	
@@ -2715,8 +3496,8 @@ void MTextDocument::DoEntab()
 	}
 	else
 	{
-		Insert(offset, text);
-		Select(offset, offset + text.length());
+		Insert(offset, result);
+		Select(offset, offset + result.length());
 	}
 	
 	FinishAction();
@@ -2724,7 +3505,8 @@ void MTextDocument::DoEntab()
 								
 void MTextDocument::DoDetab()
 {
-	StartAction("Detab");
+	if (not StartAction("Detab"))
+		return;
 
 	if (mSelection.IsEmpty())
 		Select(0, mText.GetSize());
@@ -2739,6 +3521,9 @@ void MTextDocument::DoDetab()
     string::iterator i = text.begin();
 	int startColumn = OffsetToColumn(offset);
 	int column = startColumn;
+	
+	string result;
+	result.reserve(text.length());
     
     while (i != text.end())
     {
@@ -2749,13 +3534,12 @@ void MTextDocument::DoDetab()
 				int toInsert = mCharsPerTab - (column % mCharsPerTab);
 
 				column += toInsert;
-			
-				text.erase(i);
-				while (toInsert-- > 0)
-					i = text.insert(i, ' ') + 1;
+				result.append(toInsert, ' ');
+				++i;
 				break;
 			}
 			case '\n':
+				result += '\n';
 				if (block)
 					column = startColumn;
 				else
@@ -2764,9 +3548,13 @@ void MTextDocument::DoDetab()
 				break;
 			
 			default:
-				i = next_cursor_position(i, text.end());
+			{
+				string::iterator n = next_cursor_position(i, text.end());
+				result.append(i, n);
+				i = n;
 				++column;
 				break;
+			}
 		}
 	}
 	
@@ -2775,8 +3563,8 @@ void MTextDocument::DoDetab()
 	}
 	else
 	{
-		Insert(offset, text);
-		Select(offset, offset + text.length());
+		Insert(offset, result);
+		Select(offset, offset + result.length());
 	}
 	
 	FinishAction();
@@ -2784,7 +3572,8 @@ void MTextDocument::DoDetab()
 								
 void MTextDocument::DoCut(bool inAppend)
 {
-	StartAction("Cut");
+	if (not StartAction("Cut"))
+		return;
 	
 	string text;
 	GetSelectedText(text);
@@ -2817,7 +3606,8 @@ void MTextDocument::DoPaste()
 		
 		MClipboard::Instance().GetData(text, isBlock);
 		
-		StartAction(kPasteAction);
+		if (not StartAction(kPasteAction))
+			return;
 		ReplaceSelectedText(text, isBlock, true);
 		FinishAction();
 		
@@ -2829,7 +3619,8 @@ void MTextDocument::DoPaste()
 
 void MTextDocument::DoClear()
 {
-	StartAction("Clear");
+	if (not StartAction("Clear"))
+		return;
 	
 	DeleteSelectedText();
 
@@ -3052,7 +3843,8 @@ bool MTextDocument::DoReplace(bool inFindNext, MDirection inDirection)
 	
 	if (CanReplace())
 	{
-		StartAction(kReplaceAction);
+		if (not StartAction(kReplaceAction))
+			return false;
 		
 		string what = MFindDialog::Instance().GetFindString();
 		string replace = MFindDialog::Instance().GetReplaceString();
@@ -3098,9 +3890,10 @@ void MTextDocument::DoReplaceAll()
 	string what = MFindDialog::Instance().GetFindString();
 	string replace;
 	bool ignoreCase = MFindDialog::Instance().GetIgnoreCase();
-	bool replacedAny = false;
 	bool regex = MFindDialog::Instance().GetRegex();
 	MSelection found(this);
+	MTextEditList edits;
+	int32 delta = 0;
 
 	if (MFindDialog::Instance().GetInSelection())
 	{
@@ -3108,17 +3901,13 @@ void MTextDocument::DoReplaceAll()
 		lastOffset = mSelection.GetMaxOffset();
 	}
 	
-	while (mText.Find(offset, what, kDirectionForward, ignoreCase, regex, found)
-		and found.GetMaxOffset() <= lastOffset)
+	// the matches are collected first and replaced in one go afterwards,
+	// so the search runs over the original text
+	while (offset <= lastOffset and
+		mText.Find(offset, what, kDirectionForward, ignoreCase, regex, found) and
+		found.GetMaxOffset() <= lastOffset)
 	{
-		if (not replacedAny)
-		{
-			StartAction(kReplaceAction);
-			replacedAny = true;
-		}
-		
-		offset = found.GetMinOffset();
-		int32 lengthOfSelection = found.GetMaxOffset() - offset;
+		MTextEdit edit = { found.GetMinOffset(), found.GetMaxOffset() - found.GetMinOffset() };
 		
 		replace = MFindDialog::Instance().GetReplaceString();
 		
@@ -3128,16 +3917,28 @@ void MTextDocument::DoReplaceAll()
 				replace, replace);
 		}
 		
-		Delete(offset, found.GetMaxOffset() - offset);
-		Insert(offset, replace);
+		edit.text = replace;
+		edits.push_back(edit);
+		
+		lastMatch = edit.offset + delta;
+		delta += replace.length() - edit.length;
 		
-		lastMatch = offset;
-		offset += replace.length();
-		lastOffset += replace.length() - lengthOfSelection;
+		offset = edit.offset + edit.length;
+		if (edit.length == 0)
+		{
+			if (offset >= mText.GetSize())
+				break;
+			offset = mText.NextCursorPosition(offset, eMoveOneCharacter);
+		}
 	}
 	
-	if (replacedAny)
+	if (not edits.empty())
+	{
+		if (not StartAction(kReplaceAction))
+			return;
+		Replace(edits);
 		Select(lastMatch, lastMatch + replace.length(), kScrollToSelection);
+	}
 	else
 		PlaySound("warning");
 }
@@ -3226,7 +4027,8 @@ void MTextDocument::QuotedRewrap(
 	string text;
 	GetSelectedText(text);
 	
-	StartAction(_("Quoted Rewrap"));
+	if (not StartAction(_("Quoted Rewrap")))
+		return;
 	
 	string::iterator ch = text.begin();
 	string quote, line, result;
@@ -3340,8 +4142,10 @@ void MTextDocument::DoApplyScript(const std::string& inScript)
 	string text;
 	GetSelectedText(text);
 	
+	if (not StartAction(inScript.c_str()))
+		return;
+
 	mPreparedForStdOut = true;
-	StartAction(inScript.c_str());
 	mShell->ExecuteScript((gScriptsDir / inScript).string(), text);
 }
 
@@ -3465,6 +4269,9 @@ void MTextDocument::HashLines(vector<uint32>& outHashes) const
 void MTextDocument::OnKeyPressEvent(
 	GdkEventKey*		inEvent)
 {
+	if (IsLoading())
+		return;
+
 	bool handled = false;
 
     uint32 modifiers = inEvent->state & kValidModifiersMask;
@@ -3493,6 +4300,9 @@ void MTextDocument::OnCommit(
 	const char*			inText,
 	uint32				inLength)
 {
+	if (IsLoading())
+		return;
+
 	if (mFastFindMode)
 		FastFindType(inText, inLength);
 	else
@@ -3854,7 +4664,8 @@ bool MTextDocument::HandleKeyCommand(MKeyCommand inKeyCommand)
 				
 				minLine = mSelection.GetMinLine();
 
-				StartAction("Shift lines up");
+				if (not StartAction("Shift lines up"))
+					return true;
 			
 				string txt;
 				mText.GetText(LineStart(minLine - 1), LineStart(minLine) - LineStart(minLine - 1), txt);
@@ -3885,7 +4696,8 @@ bool MTextDocument::HandleKeyCommand(MKeyCommand inKeyCommand)
 				
 				maxLine = mSelection.GetMaxLine();
 
-				StartAction("Shift lines down");
+				if (not StartAction("Shift lines down"))
+					return true;
 			
 				string txt;
 				mText.GetText(LineStart(maxLine + 1), LineStart(maxLine + 2) - LineStart(maxLine + 1), txt);
@@ -4108,7 +4920,7 @@ bool MTextDocument::HandleRawKeydown(
 void MTextDocument::PrefsChanged()
 {
 	ReInit();
-	Rewrap();
+	RewrapForLayout();
 	UpdateDirtyLines();
 }
 
@@ -4118,6 +4930,9 @@ void MTextDocument::ShellStatusIn(bool inActive)
 	
 	if (not inActive)
 	{
+		if (mStdErrWindow != nil)
+			mStdErrWindow->FlushStdErr();
+
 		string cwd = mShell->GetCWD();
 		eBaseDirChanged(fs::path(cwd));
 	}
@@ -4129,7 +4944,8 @@ void MTextDocument::StdOut(const char* inText, uint32 inSize)
 	
 	if (not mPreparedForStdOut)
 	{
-		StartAction(kTypeAction);
+		if (not StartAction(kTypeAction))
+			return;
 		
 		uint32 line = mSelection.GetMaxLine();
 		ChangeSelection(LineEnd(line), LineEnd(line));
@@ -4152,6 +4968,7 @@ void MTextDocument::StdOut(const char* inText, uint32 inSize)
 			mIncludeFiles = new MIncludeFileList;
 		}
 
+		InvalidateParse();
 		Rewrap();
 		UpdateDirtyLines();
 	}
@@ -4225,16 +5042,26 @@ void MTextDocument::Execute()
 void MTextDocument::Idle(
 	double		inSystemTime)
 {
-	if (mNeedReparse)
+	const double kRestyleTime = 0.02;
+
+	if (mStyleJob != nil and mStyleJob->IsDone())
+		FinishStyling();
+
+	if (mStyleJob == nil and mLanguage != nil and mStylePendingFrom < mLineInfo.size())
 	{
-		if (mLanguage and mNamedRange)
-		{
-			mLanguage->Parse(mText, *mNamedRange, *mIncludeFiles);
-			SendSelectionChangedEvent();
-		}
+		RestyleDirtyLines(mStylePendingFrom - 1, 0, GetLocalTime() + kRestyleTime);
+
+		eInvalidateDirtyLines();
 		
-		mNeedReparse = false;
+		for (uint32 line = 0; line < mLineInfo.size(); ++line)
+			mLineInfo[line].dirty = false;
 	}
+
+	if (mParseJob != nil and mParseJob->IsDone())
+		FinishParse();
+	
+	if (mNeedReparse and mParseJob == nil)
+		StartParse(true);
 	
 	if (mDataFD >= 0)
 	{
@@ -4247,6 +5074,324 @@ void MTextDocument::Idle(
 	}
 }
 
+// ---------------------------------------------------------------------------
+//	ShiftParseRanges
+
+void MTextDocument::ShiftParseRanges(
+	uint32		inOffset,
+	uint32		inOldLength,
+	uint32		inNewLength)
+{
+	if (mNamedRange != nil)
+		ShiftNamedRange(*mNamedRange, inOffset, inOldLength, inNewLength);
+	
+	if (mIncludeFiles != nil)
+	{
+		for (MIncludeFileList::iterator i = mIncludeFiles->begin(); i != mIncludeFiles->end(); ++i)
+			i->offset = ShiftOffset(i->offset, inOffset, inOldLength, inNewLength);
+	}
+	
+	if (mParseDirtyFrom > mParseDirtyTo)
+	{
+		mParseDirtyFrom = inOffset;
+		mParseDirtyTo = inOffset + inNewLength;
+	}
+	else
+	{
+		mParseDirtyTo = ShiftOffset(mParseDirtyTo, inOffset, inOldLength, inNewLength);
+
+		if (mParseDirtyFrom > inOffset)
+			mParseDirtyFrom = inOffset;
+		if (mParseDirtyTo < inOffset + inNewLength)
+			mParseDirtyTo = inOffset + inNewLength;
+	}
+	
+	++mParseGeneration;
+	mNeedReparse = true;
+}
+
+// ---------------------------------------------------------------------------
+//	InvalidateParse
+
+void MTextDocument::InvalidateParse()
+{
+	mParseDirtyFrom = 0;
+	mParseDirtyTo = mText.GetSize();
+
+	++mParseGeneration;
+	mNeedReparse = true;
+}
+
+// ---------------------------------------------------------------------------
+//	StartParse
+//
+//	Only the top level ranges touched by edits since the last parse are
+//	reparsed. The parse starts at the end of the preceding untouched range
+//	and stops at the start of the following, the text in between is copied
+//	so the parser can run in a thread of its own.
+
+void MTextDocument::StartParse(
+	bool		inBackground)
+{
+	mNeedReparse = false;
+
+	if (mLanguage == nil or mNamedRange == nil or mIncludeFiles == nil or
+		mParseDirtyFrom > mParseDirtyTo)
+	{
+		return;
+	}
+	
+	uint32 size = mText.GetSize();
+	uint32 from = min(mParseDirtyFrom, size);
+	uint32 to = min(mParseDirtyTo, size);
+	
+	const vector<MNamedRange>& ranges = mNamedRange->subrange;
+	
+	bool grown = true;
+	while (grown)
+	{
+		grown = false;
+		
+		for (vector<MNamedRange>::const_iterator r = ranges.begin(); r != ranges.end(); ++r)
+		{
+			uint32 b = RangeStart(*r);
+			
+			if (b < to and r->end > from)
+			{
+				if (b < from)
+				{
+					from = b;
+					grown = true;
+				}
+				
+				if (r->end > to)
+				{
+					to = r->end;
+					grown = true;
+				}
+			}
+		}
+	}
+	
+	if (to > size)
+		to = size;
+	
+	uint32 prevEnd = 0, nextBegin = size;
+	for (vector<MNamedRange>::const_iterator r = ranges.begin(); r != ranges.end(); ++r)
+	{
+		uint32 b = RangeStart(*r);
+
+		if (r->end <= from and r->end > prevEnd)
+			prevEnd = r->end;
+		
+		if (b >= to and b < nextBegin)
+			nextBegin = b;
+	}
+	
+	from = prevEnd;
+	to = nextBegin;
+	
+	string text;
+	mText.GetText(from, to - from, text);
+	
+	mParseJob = new MParseJob(mLanguage, new MTextBuffer(text), from, to, mParseGeneration);
+	
+	if (inBackground)
+		mParseThread = new boost::thread(boost::bind(&MParseJob::Run, mParseJob));
+	else
+		mParseJob->Run();
+}
+
+// ---------------------------------------------------------------------------
+//	StartStyling
+//
+//	Rewrap left all lines of the file that was read dirty. Instead of
+//	styling them here, a copy of the text is styled in the MStylePool.
+//	Until that is done the lines are pending, as if a restyle ran out
+//	of time at the first line.
+
+bool MTextDocument::StartStyling()
+{
+	const uint32 kMinStyleJobLines = 1000;
+
+	if (mStyleJob != nil)
+	{
+		MStylePool::Instance().Withdraw(mStyleJob);
+		delete mStyleJob;
+		mStyleJob = nil;
+	}
+	
+	if (mLanguage == nil or GetSoftwrap() or mLineInfo.size() < kMinStyleJobLines)
+		return false;
+	
+	string text;
+	mText.GetText(0, mText.GetSize(), text);
+	
+	mStyleJob = new MStyleJob(mLanguage, new MTextBuffer(text), mParseGeneration);
+	
+	mStyleJob->starts.reserve(mLineInfo.size());
+	mStyleJob->states.reserve(mLineInfo.size());
+	mStyleJob->states.push_back(mLineInfo[0].state);
+	
+	for (MLineInfoArray::iterator i = mLineInfo.begin(); i != mLineInfo.end(); ++i)
+	{
+		mStyleJob->starts.push_back(i->start);
+		i->dirty = false;
+		i->restyle = true;
+	}
+	
+	mStylePendingFrom = 1;
+	
+	MStylePool::Instance().Submit(mStyleJob);
+	
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+//	FinishStyling
+
+void MTextDocument::FinishStyling()
+{
+	unique_ptr<MStyleJob> job(mStyleJob);
+	mStyleJob = nil;
+	
+	// edited in the mean time, the restyle in Idle takes over
+	if (job->failed or job->generation != mParseGeneration or
+		job->language != mLanguage or job->states.size() != mLineInfo.size())
+	{
+		return;
+	}
+	
+	for (uint32 line = 0; line < mLineInfo.size(); ++line)
+	{
+		if (mLineInfo[line].state != job->states[line])
+		{
+			mLineInfo[line].state = job->states[line];
+			mLineInfo[line].dirty = true;
+		}
+		
+		mLineInfo[line].restyle = false;
+	}
+	
+	mStylePendingFrom = numeric_limits<uint32>::max();
+	
+	eInvalidateDirtyLines();
+	
+	for (uint32 line = 0; line < mLineInfo.size(); ++line)
+		mLineInfo[line].dirty = false;
+}
+
+// ---------------------------------------------------------------------------
+//	FinishParse
+
+void MTextDocument::FinishParse()
+{
+	if (mParseThread != nil)
+	{
+		mParseThread->join();
+		delete mParseThread;
+		mParseThread = nil;
+	}
+	
+	unique_ptr<MParseJob> job(mParseJob);
+	mParseJob = nil;
+	
+	if (job.get() == nil)
+		return;
+	
+	// text or language changed while we were parsing, try again
+	if (job->generation != mParseGeneration or job->language != mLanguage or
+		mNamedRange == nil or mIncludeFiles == nil)
+	{
+		mNeedReparse = true;
+		return;
+	}
+
+	mParseDirtyFrom = numeric_limits<uint32>::max();
+	mParseDirtyTo = 0;
+
+	if (job->failed)
+		return;
+
+	uint32 from = job->from, to = job->to;
+	
+	if (from == 0 and to == mText.GetSize())
+	{
+		std::swap(*mNamedRange, job->range);
+		mIncludeFiles->swap(job->includes);
+	}
+	else
+	{
+		// splice the new ranges in between the untouched ones
+		vector<MNamedRange> ranges, tail;
+
+		for (vector<MNamedRange>::iterator r = mNamedRange->subrange.begin(); r != mNamedRange->subrange.end(); ++r)
+		{
+			uint32 b = RangeStart(*r);
+
+			if (r->end <= from and b < from)
+				ranges.push_back(move(*r));
+			else if (b >= to)
+				tail.push_back(move(*r));
+		}
+		
+		for (vector<MNamedRange>::iterator r = job->range.subrange.begin(); r != job->range.subrange.end(); ++r)
+		{
+			// skip ranges starting at the very end, they belong to the next range
+			if (r->selectFrom >= to - from)
+				continue;
+			
+			OffsetNamedRange(*r, from);
+			ranges.push_back(move(*r));
+		}
+		
+		for (vector<MNamedRange>::iterator r = tail.begin(); r != tail.end(); ++r)
+			ranges.push_back(move(*r));
+		
+		mNamedRange->subrange.swap(ranges);
+		if (mNamedRange->end < to)
+			mNamedRange->end = to;
+		
+		MIncludeFileList includes;
+
+		for (MIncludeFileList::iterator i = mIncludeFiles->begin(); i != mIncludeFiles->end() and i->offset < from; ++i)
+			includes.push_back(*i);
+		
+		for (MIncludeFileList::iterator i = job->includes.begin(); i != job->includes.end(); ++i)
+		{
+			i->offset += from;
+			includes.push_back(*i);
+		}
+
+		for (MIncludeFileList::iterator i = mIncludeFiles->begin(); i != mIncludeFiles->end(); ++i)
+		{
+			if (i->offset >= to)
+				includes.push_back(*i);
+		}
+		
+		mIncludeFiles->swap(includes);
+	}
+
+	SendSelectionChangedEvent();
+}
+
+// ---------------------------------------------------------------------------
+//	ParseNow, for when we need the parse results right away
+
+void MTextDocument::ParseNow()
+{
+	if (mParseJob != nil)
+		FinishParse();
+	
+	if (mNeedReparse)
+	{
+		StartParse(false);
+		
+		if (mParseJob != nil)
+			FinishParse();
+	}
+}
+
 // ---------------------------------------------------------------------------
 //	MDocument::GetParsePopupItems
 
@@ -4257,8 +5402,7 @@ bool MTextDocument::GetParsePopupItems(MMenu& inMenu)
 	
 	if (mLanguage and mNamedRange)
 	{
-		if (mNeedReparse)
-			Idle(0);		// force reparse
+		ParseNow();
 
 		mLanguage->GetParsePopupItems(*mNamedRange, "", inMenu, ix);
 		result = true;
@@ -4292,8 +5436,15 @@ bool MTextDocument::GetIncludePopupItems(MMenu& inMenu)
 	
 	if (mLanguage and mIncludeFiles)
 	{
-		if (mNeedReparse)
-			Idle(0);		// force reparse
+		// the project's symbol index knows the includes of unmodified files
+		MProject* project = MProject::Instance();
+		
+		bool indexed = mNeedReparse and not mDirty and mFile.IsLocal() and
+			project != nil and project->GetSymbolIndex() != nil and
+			project->GetSymbolIndex()->GetIncludes(mFile.GetPath(), *mIncludeFiles);
+
+		if (not indexed)
+			ParseNow();
 
 		for (MIncludeFileList::iterator i = mIncludeFiles->begin(); i != mIncludeFiles->end(); ++i)
 			inMenu.AppendItem(i->name, cmd_OpenIncludeFromMenu);
@@ -4330,7 +5481,12 @@ void MTextDocument::SelectIncludePopupItem(uint32 inItem)
 			MProject* project = MProject::Instance();
 			fs::path p;
 			
-			if (project != nil and project->LocateFile(file.name, file.isQuoted, p))
+			if (project != nil and mFile.IsLocal() and project->GetSymbolIndex() != nil and
+				project->GetSymbolIndex()->LocateInclude(mFile.GetPath(), file.name, p))
+			{
+				gApp->OpenOneDocument(MFile(p));
+			}
+			else if (project != nil and project->LocateFile(file.name, file.isQuoted, p))
 				gApp->OpenOneDocument(MFile(p));
 			else if (mFile.IsValid())
 			{
@@ -4355,6 +5511,10 @@ bool MTextDocument::ProcessCommand(
 	bool result = true;
 	MProject* project = MProject::Instance();
 
+	// nothing but closing the window while the file is being read
+	if (IsLoading() and inCommand != cmd_Close)
+		return true;
+
 	string s;
 	
 	switch (inCommand)
@@ -4696,6 +5856,12 @@ bool MTextDocument::UpdateCommandStatus(
 {
 	bool result = true;
 
+	if (IsLoading())
+	{
+		outEnabled = inCommand == cmd_Close;
+		return true;
+	}
+
 	MProject* project = MProject::Instance();
 	MLanguage* lang = GetLanguage();
 
@@ -4884,12 +6050,15 @@ void MTextDocument::IOProgress(
 
 void MTextDocument::IOFileLoaded()
 {
-	MDocument::IOFileLoaded();
 	eSSHProgress(-1.f, "");
 	
 	MDocState state = {};
 	if (not ReadDocState(state))
-		Rewrap();
+		RewrapForLayout();
+
+	// the windows restore their scroll position when they hear of this,
+	// so it comes after the selection and softwrap were restored
+	MDocument::IOFileLoaded();
 }
 
 void MTextDocument::IOFileWritten()
@@ -4900,7 +6069,8 @@ void MTextDocument::IOFileWritten()
 
 void MTextDocument::MakeXHTML()
 {
-	StartAction("Convert to XHTML");
+	if (not StartAction("Convert to XHTML"))
+		return;
 	
 	SelectAll();
 	
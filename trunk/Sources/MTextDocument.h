@@ -28,6 +28,8 @@ class MMessageWindow;
 class MMessageList;
 class MMenu;
 class MDevice;
+struct MParseJob;
+struct MStyleJob;
 
 struct MTextInputAreaInfo
 {
@@ -35,6 +37,35 @@ struct MTextInputAreaInfo
 	int32				fLength[9];
 };
 
+// one replacement in a batch, offsets are in the text before any of
+// the replacements in the batch are done
+struct MTextEdit
+{
+	uint32				offset;
+	uint32				length;
+	std::string			text;
+};
+
+typedef std::vector<MTextEdit>	MTextEditList;
+
+// lines as laid out for printing, kept apart from the lines on screen
+struct MPrintLine
+{
+	uint32				start;
+	uint32				indent;		// in characters
+	uint16				state;
+};
+
+struct MPrintLayout
+{
+	uint32				width;		// zero if lines are not wrapped
+	uint32				next;		// offset of the first line still to lay out
+	uint16				state;		// state at next, used when its style is pending
+	uint32				changes;	// change count of the text this was laid out for
+	std::vector<MPrintLine>
+						lines;
+};
+
 struct MDocState
 {
 	uint32			mSelection[4];
@@ -73,6 +104,9 @@ class MTextDocument : public MDocument
 
 	virtual bool		DoSave();
 
+	// a file in plain view counts as read only until it is first edited
+	virtual bool		IsReadOnly() const;
+
 	virtual bool		DoSaveAs(
 							const MFile&			inFile);
 
@@ -123,6 +157,16 @@ class MTextDocument : public MDocument
 	virtual void		ReadFile(
 							std::istream&		inFile);
 
+	virtual void		ReadText(
+							MTextBuffer&		ioText,
+							const std::vector<uint32>&
+												inLineStarts);
+
+	// sets up the document for the text that was just read
+	void				TextRead(
+							const std::vector<uint32>&
+												inLineStarts);
+
 	virtual void		WriteFile(
 							std::ostream&		inFile);
 
@@ -159,7 +203,8 @@ class MTextDocument : public MDocument
 	
 	void				Reset();
 
-	void				StartAction(
+	// returns false if the edit should not take place after all
+	bool				StartAction(
 							const char*		inAction);
 
 	void				FinishAction();
@@ -188,6 +233,12 @@ class MTextDocument : public MDocument
 							MDevice&		inDevice,
 							std::string&	outText) const;
 
+	// lay out some more lines for printing, start with an empty ioLayout
+	// and call this until it returns true
+	bool				LayoutForPrinting(
+							MPrintLayout&	ioLayout,
+							uint32			inMaxLines);
+
 	std::string			GetFont() const						{ return mFont; }
 
 	void				HashLines(
@@ -255,6 +306,11 @@ class MTextDocument : public MDocument
 	bool				IsLineDirty(
 							uint32			inLine) const;
 
+	// the state of this line may be outdated, it is drawn with
+	// the previous styling until the restyle in Idle gets here
+	bool				IsStylePending(
+							uint32			inLine) const	{ return inLine >= mStylePendingFrom; }
+
 	bool				IsLineMarked(
 							uint32			inLine) const;
 
@@ -266,6 +322,10 @@ class MTextDocument : public MDocument
 
 	uint32				GetIndent(
 							uint32			inOffset) const;
+
+	uint32				GetIndent(
+							uint32			inOffset,
+							uint32			inWrapWidth) const;
 	
 	MLanguage*			GetLanguage() const					{ return mLanguage; }
 
@@ -300,6 +360,9 @@ class MTextDocument : public MDocument
 
 	bool				GetShowWhiteSpace() const			{ return mShowWhiteSpace; }
 
+	// large files are opened without language, parsing and softwrap
+	bool				IsPlainView() const					{ return mPlainView; }
+
 	void				HandleFindDialogCommand(
 							uint32			inCommand);
 
@@ -481,6 +544,11 @@ class MTextDocument : public MDocument
 							uint32			inOffset,
 							uint32			inLength);
 
+	// do a sorted list of non overlapping replacements at once
+	void				Replace(
+							const MTextEditList&
+											inEdits);
+
 	uint32				LineColumnToOffsetBreakingTabs(
 							uint32			inLine,
 							uint32			inColumn,
@@ -491,6 +559,7 @@ class MTextDocument : public MDocument
 							uint32			inToOffset,
 							uint16			inState,
 							uint32			inIndent,
+							uint32			inWrapWidth,
 							std::vector<uint32>&
 											outBreaks) const;
 
@@ -500,8 +569,17 @@ class MTextDocument : public MDocument
 
 	void				Rewrap();
 
-	void				RestyleDirtyLines(
-							uint32			inFromLine);
+	// rewrap after the font or tab width changed
+	void				RewrapForLayout();
+
+	void				Rewrap(
+							const std::vector<uint32>&
+											inLineStarts);
+
+	bool				RestyleDirtyLines(
+							uint32			inFromLine,
+							uint32			inToLine,
+							double			inDeadline);
 
 	void				UpdateDirtyLines();
 
@@ -554,6 +632,27 @@ class MTextDocument : public MDocument
 
 	void				Idle(
 							double			inSystemTime);
+
+	// incremental parsing of the named ranges and include files,
+	// done in a background thread
+	void				ShiftParseRanges(
+							uint32			inOffset,
+							uint32			inOldLength,
+							uint32			inNewLength);
+
+	void				InvalidateParse();
+	
+	void				StartParse(
+							bool			inBackground);
+
+	void				FinishParse();
+
+	// a large file that was read is styled in a worker thread
+	bool				StartStyling();
+
+	void				FinishStyling();
+
+	void				ParseNow();
 	
 	void				MakeXHTML();
 	
@@ -575,8 +674,15 @@ class MTextDocument : public MDocument
 	MNamedRange*				mNamedRange;
 	MIncludeFileList*			mIncludeFiles;
 	bool						mNeedReparse;
+	uint32						mParseDirtyFrom, mParseDirtyTo;
+	uint32						mParseGeneration;
+	MParseJob*					mParseJob;
+	MStyleJob*					mStyleJob;
+	boost::thread*				mParseThread;
 	bool						mSoftwrap;
 	bool						mShowWhiteSpace;
+	bool						mPlainView;
+	bool						mViewOnly;		// plain view, not edited yet
 	bool						mFastFindMode;
 	MDirection					mFastFindDirection;
 	bool						mFastFindInited;
@@ -591,6 +697,7 @@ class MTextDocument : public MDocument
 	bool						mStdErrWindowSelected;
 	bool						mPreparedForStdOut;
 	uint32						mPCLine;
+	uint32						mStylePendingFrom;
 	
 	static MTextDocument*		sWorksheet;
 };
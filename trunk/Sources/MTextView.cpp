@@ -21,6 +21,7 @@
 #include "MUtils.h"
 #include "MDevice.h"
 #include "MJapiApp.h"
+#include "MTrace.h"
 
 #ifndef NDEBUG
 #include <iostream>
@@ -92,6 +93,7 @@ MTextView::MTextView(
 	, mLastFocusTime(0)
 	, mInTick(false)
 	, mClickMode(eSelectNone)
+	, mPrintLayout(nil)
 {
 	AddRoute(eIdle, gApp->eIdle);
 	
@@ -128,6 +130,7 @@ MTextView::MTextView(
 
 MTextView::~MTextView()
 {
+	delete mPrintLayout;
 }
 
 bool MTextView::OnRealize()
@@ -362,27 +365,52 @@ bool MTextView::OnButtonReleaseEvent(
 	return true;
 }
 
-uint32 MTextView::CountPages(
-	MDevice&		inDevice)
+// ---------------------------------------------------------------------------
+//	Paginate
+//
+//	The text is laid out for the page width in a table of its own, the
+//	lines on screen are left alone. A few hundred lines are done per call.
+
+bool MTextView::Paginate(
+	MDevice&		inDevice,
+	uint32&			outPages)
 {
+	const uint32 kLinesPerStep = 500;
+
 	THROW_IF_NIL(mDocument);
 	
 	MRect bounds = inDevice.GetBounds();
 
-	uint32 wrapWidth = mDocument->GetWrapWidth();
-	mDocument->SetWrapWidth(bounds.width);
-	uint32 lines = mDocument->CountLines();
-	mDocument->SetWrapWidth(wrapWidth);
-
 	inDevice.SetFont(mDocument->GetFont());
 
 	uint32 lineHeight = inDevice.GetAscent() + inDevice.GetDescent() + inDevice.GetLeading();
 	
 	uint32 linesPerPage = bounds.height / lineHeight;
-	if (linesPerPage == 0 or lines == 0)
+	if (linesPerPage == 0)
 		THROW(("Invalid page height"));
+
+	if (mPrintLayout == nil)
+	{
+		mPrintLayout = new MPrintLayout;
+		mPrintLayout->width = mDocument->GetSoftwrap() ? bounds.width : 0;
+		mPrintLayout->next = 0;
+		mPrintLayout->state = 0;
+		mPrintLayout->changes = mDocument->GetTextBuffer().GetChangeCount();
+	}
+	
+	bool result = mDocument->LayoutForPrinting(*mPrintLayout, kLinesPerStep);
 	
-	return lines / linesPerPage + 1;
+	outPages = 0;
+	if (result)
+		outPages = max(static_cast<uint32>(mPrintLayout->lines.size() + linesPerPage - 1) / linesPerPage, 1U);
+	
+	return result;
+}
+
+void MTextView::EndPrint()
+{
+	delete mPrintLayout;
+	mPrintLayout = nil;
 }
 
 void MTextView::Draw(
@@ -392,6 +420,8 @@ void MTextView::Draw(
 	if (mDocument == nil)
 		return;
 
+	MTraceScope trace("view", "Draw");
+
 	MValueChanger<int32> saveXOrigin(mImageOriginX, mImageOriginX);
 	MValueChanger<int32> saveYOrigin(mImageOriginY, mImageOriginY);
 
@@ -420,7 +450,22 @@ void MTextView::Draw(
 		inUpdate.x = 0;
 		inUpdate.y = 0;
 		
-		mDocument->SetWrapWidth(bounds.width);
+		if (mPrintLayout != nil)
+		{
+			if (mPrintLayout->changes != mDocument->GetTextBuffer().GetChangeCount())
+				THROW(("The document was changed while printing"));
+
+			uint32 minLine = linesPerPage * inDevice.GetPageNr();
+			uint32 maxLine = min(minLine + linesPerPage, static_cast<uint32>(mPrintLayout->lines.size()));
+			
+			for (uint32 line = minLine; line < maxLine; ++line)
+			{
+				MRect lineRect(0, line * mLineHeight - mImageOriginY, bounds.width, mLineHeight);
+				DrawPrintLine(line, inDevice, lineRect);
+			}
+			
+			return;
+		}
 	}
 	else
 		inDevice.EraseRect(bounds);
@@ -447,6 +492,24 @@ void MTextView::Draw(
 		DrawDragHilite(inDevice);
 }
 
+void MTextView::DrawPrintLine(
+	uint32				inLineNr,
+	MDevice&			inDevice,
+	MRect				inLineRect)
+{
+	const vector<MPrintLine>& lines = mPrintLayout->lines;
+	const MPrintLine& line = lines[inLineNr];
+	
+	uint32 end = mDocument->GetTextSize();
+	if (inLineNr + 1 < lines.size())
+		end = lines[inLineNr + 1].start;
+	
+	string text;
+	mDocument->GetStyledText(line.start, end - line.start, line.state, inDevice, text);
+	
+	inDevice.DrawText(inLineRect.x + kLeftMargin + line.indent * mCharWidth, inLineRect.y);
+}
+
 void MTextView::DrawLine(
 	uint32				inLineNr,
 	MDevice&			inDevice,
@@ -18,6 +18,7 @@ class MTextDocument;
 class MDocWindow;
 class MController;
 class MDevice;
+struct MPrintLayout;
 
 class MTextView : public MView
 {
@@ -83,8 +84,11 @@ class MTextView : public MView
 							MDevice&		inDevice,
 							MRect			inUpdate);
 
-	virtual uint32		CountPages(
-							MDevice&		inDevice);
+	virtual bool		Paginate(
+							MDevice&		inDevice,
+							uint32&			outPages);
+
+	virtual void		EndPrint();
 
 	virtual bool		OnFocusInEvent(
 							GdkEventFocus*	inEvent);
@@ -117,6 +121,11 @@ class MTextView : public MView
 							uint32			inLineNr,
 							MDevice&		inDevice,
 							MRect			inLineRect);
+
+	void				DrawPrintLine(
+							uint32			inLineNr,
+							MDevice&		inDevice,
+							MRect			inLineRect);
 	
 	void				GetLine(
 							uint32			inLineNr,
@@ -269,6 +278,7 @@ class MTextView : public MView
 	uint32				mMinClickAnchor, mMaxClickAnchor;
 	
 	GtkIMContext*		mIMContext;
+	MPrintLayout*		mPrintLayout;
 	
 	uint32				mDragCaret;
 	bool				mDragIsAcceptable;
@@ -0,0 +1,223 @@
+//          Copyright Maarten L. Hekkelman 2006-2008
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "MJapi.h"
+
+#include <ctime>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include "MTrace.h"
+#include "MError.h"
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+namespace
+{
+
+// the calls are kept up to this number, the counts go on after that
+const uint32
+	kMaxTraceEvents = 1000000,
+	kHistogramSize = 24;		// buckets of 1, 2, 4 ... microseconds
+
+struct MTraceEvent
+{
+	const char*		category;
+	const char*		name;
+	uint64			start;
+	uint32			duration;
+	uint32			thread;
+};
+
+struct MTraceStats
+{
+	uint64			count;
+	uint64			total;
+	uint64			max;
+	uint64			histogram[kHistogramSize];
+};
+
+// names are compared by value, the same literal in two translation
+// units need not have the same address
+struct MTraceNameLess
+{
+	bool	operator()(
+				const pair<const char*,const char*>&	a,
+				const pair<const char*,const char*>&	b) const
+			{
+				int d = strcmp(a.first, b.first);
+				if (d == 0)
+					d = strcmp(a.second, b.second);
+				return d < 0;
+			}
+};
+
+typedef map<pair<const char*,const char*>,MTraceStats,MTraceNameLess>	MTraceStatsMap;
+
+boost::mutex			sTraceMutex;
+fs::path				sTraceFile;
+vector<MTraceEvent>		sTraceEvents;
+MTraceStatsMap			sTraceStats;
+uint64					sTraceStart;
+uint32					sNextThread = 1;
+__thread uint32			sThread = 0;
+
+void WriteString(
+	ostream&			inFile,
+	const char*			inString)
+{
+	inFile << '"';
+	for (const char* s = inString; *s != 0; ++s)
+	{
+		if (*s == '"' or *s == '\\')
+			inFile << '\\';
+		inFile << *s;
+	}
+	inFile << '"';
+}
+
+}
+
+std::atomic<bool> MTrace::sActive(false);
+
+// ---------------------------------------------------------------------------
+//	Start
+
+void MTrace::Start(
+	const fs::path&		inFile)
+{
+	boost::mutex::scoped_lock lock(sTraceMutex);
+
+	sTraceFile = inFile;
+	sTraceEvents.clear();
+	sTraceEvents.reserve(kMaxTraceEvents / 16);
+	sTraceStats.clear();
+	sTraceStart = Now();
+
+	sActive = true;
+}
+
+// ---------------------------------------------------------------------------
+//	Now
+
+uint64 MTrace::Now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<uint64>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+// ---------------------------------------------------------------------------
+//	Record
+
+void MTrace::Record(
+	const char*			inCategory,
+	const char*			inName,
+	uint64				inStart,
+	uint64				inEnd)
+{
+	uint64 duration = inEnd - inStart;
+
+	boost::mutex::scoped_lock lock(sTraceMutex);
+
+	if (not sActive)
+		return;
+
+	if (sThread == 0)
+		sThread = sNextThread++;
+
+	MTraceStats& stats = sTraceStats[make_pair(inCategory, inName)];
+
+	++stats.count;
+	stats.total += duration;
+	if (stats.max < duration)
+		stats.max = duration;
+
+	uint32 bucket = 0;
+	while (bucket + 1 < kHistogramSize and (1ULL << (bucket + 1)) <= duration)
+		++bucket;
+	++stats.histogram[bucket];
+
+	if (sTraceEvents.size() < kMaxTraceEvents)
+	{
+		MTraceEvent e = { inCategory, inName, inStart, static_cast<uint32>(duration), sThread };
+		sTraceEvents.push_back(e);
+	}
+}
+
+// ---------------------------------------------------------------------------
+//	Stop
+//
+//	The file is in the Chrome trace event format, the calls are complete
+//	('X') events. The counts and histograms are added as an extra member,
+//	the trace viewer ignores it.
+
+void MTrace::Stop()
+{
+	boost::mutex::scoped_lock lock(sTraceMutex);
+
+	if (not sActive)
+		return;
+
+	sActive = false;
+
+	fs::ofstream file(sTraceFile, ios::trunc);
+	if (not file.is_open())
+		THROW(("Could not write trace file %s", sTraceFile.string().c_str()));
+
+	file << "{\"traceEvents\":[" << endl;
+
+	for (vector<MTraceEvent>::iterator e = sTraceEvents.begin(); e != sTraceEvents.end(); ++e)
+	{
+		if (e != sTraceEvents.begin())
+			file << ',' << endl;
+
+		file << "{\"name\":";
+		WriteString(file, e->name);
+		file << ",\"cat\":";
+		WriteString(file, e->category);
+		file << ",\"ph\":\"X\",\"ts\":" << (e->start - sTraceStart)
+			 << ",\"dur\":" << e->duration
+			 << ",\"pid\":1,\"tid\":" << e->thread << '}';
+	}
+
+	file << endl << "],\"stats\":[" << endl;
+
+	for (MTraceStatsMap::iterator s = sTraceStats.begin(); s != sTraceStats.end(); ++s)
+	{
+		if (s != sTraceStats.begin())
+			file << ',' << endl;
+
+		const MTraceStats& stats = s->second;
+
+		file << "{\"name\":";
+		WriteString(file, s->first.second);
+		file << ",\"cat\":";
+		WriteString(file, s->first.first);
+		file << ",\"count\":" << stats.count
+			 << ",\"total\":" << stats.total
+			 << ",\"max\":" << stats.max
+			 << ",\"histogram\":[";
+
+		for (uint32 b = 0; b < kHistogramSize; ++b)
+		{
+			if (b > 0)
+				file << ',';
+			file << stats.histogram[b];
+		}
+
+		file << "]}";
+	}
+
+	file << endl << "]}" << endl;
+
+	sTraceEvents.clear();
+	sTraceStats.clear();
+}
@@ -0,0 +1,76 @@
+//          Copyright Maarten L. Hekkelman 2006-2008
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+/*
+	MTrace records where the time goes in the hot paths of the editor.
+	Place an MTraceScope at the top of a block to time it:
+
+		MTraceScope trace("text", "RewrapLines");
+
+	Nothing is recorded unless tracing was started, japi does this when
+	it is started with -T file. Each name then gets a count, the total
+	time and a histogram of durations, and the individual calls are kept
+	to be written as a Chrome trace (open it at chrome://tracing) when
+	tracing stops.
+*/
+
+#ifndef MTRACE_H
+#define MTRACE_H
+
+#include <atomic>
+
+#include <boost/filesystem/path.hpp>
+
+class MTrace
+{
+  public:
+	static void		Start(
+						const boost::filesystem::path&	inFile);
+
+	// writes the trace file
+	static void		Stop();
+
+	static bool		IsActive()					{ return sActive; }
+
+	// time in microseconds
+	static uint64	Now();
+
+	static void		Record(
+						const char*			inCategory,
+						const char*			inName,
+						uint64				inStart,
+						uint64				inEnd);
+
+  private:
+	static std::atomic<bool>
+					sActive;
+};
+
+class MTraceScope
+{
+  public:
+					MTraceScope(
+						const char*			inCategory,
+						const char*			inName)
+						: mCategory(inCategory)
+						, mName(inName)
+						, mStart(MTrace::IsActive() ? MTrace::Now() : 0) {}
+
+					~MTraceScope()
+					{
+						if (mStart != 0)
+							MTrace::Record(mCategory, mName, mStart, MTrace::Now());
+					}
+
+  private:
+					MTraceScope(const MTraceScope&);
+	MTraceScope&	operator=(const MTraceScope&);
+
+	const char*		mCategory;
+	const char*		mName;
+	uint64			mStart;
+};
+
+#endif
@@ -32,8 +32,10 @@ struct MRect
 				MRect(
 					const MRect&		inRHS);
 
+#if not defined(JAPI_HEADLESS)
 				MRect(
 					const GdkRectangle&	inRHS);
+#endif
 
 				MRect(
 					int32				inX,
@@ -52,6 +54,7 @@ struct MRect
 					int32				inDeltaX,
 					int32				inDeltaY);
 
+#if not defined(JAPI_HEADLESS)
 				operator GdkRectangle*()
 				{
 					return reinterpret_cast<GdkRectangle*>(this);
@@ -61,8 +64,11 @@ struct MRect
 				{
 					return reinterpret_cast<const GdkRectangle*>(this);
 				}
+#endif
 };
 
+#if not defined(JAPI_HEADLESS)
+
 struct MRegion
 {
 				MRegion()
@@ -117,6 +123,8 @@ struct MRegion
 	GdkRegion*	mGdkRegion;	
 };
 
+#endif
+
 enum MDirection
 {
 	kDirectionForward = 1,
@@ -261,6 +269,7 @@ MRect::MRect(
 {
 }
 
+#if not defined(JAPI_HEADLESS)
 inline
 MRect::MRect(
 	const GdkRectangle&	inRHS)
@@ -270,6 +279,7 @@ MRect::MRect(
 	, height(inRHS.height)
 {
 }
+#endif
 
 inline
 MRect::MRect(
@@ -12,6 +12,11 @@
 
 #include <sstream>
 #include <cassert>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "MUnicode.h"
 #include "MError.h"
@@ -621,3 +626,456 @@ string::iterator next_line_break(
 
 	return text;
 }
+
+// --------------------------------------------------------------------
+//	Bulk conversion
+//
+//	Most text is plain ASCII. The routines below skip over runs of ASCII
+//	sixteen bytes at a time using SSE2 when available, or a machine word
+//	at a time otherwise. Everything else is handled one character at a
+//	time using the encoding traits, so the results are the same as those
+//	of MDecoder and MEncoder.
+
+namespace
+{
+
+// the number of ASCII characters at the start of inText
+inline uint32 AsciiPrefixLength(
+	const char*		inText,
+	uint32			inLength)
+{
+	uint32 n = 0;
+
+#if defined(__SSE2__)
+	while (n + 16 <= inLength)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inText + n));
+		int mask = _mm_movemask_epi8(v);
+		if (mask != 0)
+			return n + __builtin_ctz(mask);
+		n += 16;
+	}
+#else
+	while (n + sizeof(uint64) <= inLength)
+	{
+		uint64 w;
+		memcpy(&w, inText + n, sizeof(w));
+		if (w & 0x8080808080808080ULL)
+			break;
+		n += sizeof(uint64);
+	}
+#endif
+
+	while (n < inLength and (inText[n] & 0x080) == 0)
+		++n;
+	
+	return n;
+}
+
+template<bool BIGENDIAN>
+inline uint32 ReadUTF16Unit(
+	const char*		inText)
+{
+	const unsigned char* p = reinterpret_cast<const unsigned char*>(inText);
+	return BIGENDIAN ? ((p[0] << 8) | p[1]) : ((p[1] << 8) | p[0]);
+}
+
+// the number of UTF-16 units at the start of inText that are ASCII
+template<bool BIGENDIAN>
+uint32 UTF16AsciiPrefixLength(
+	const char*		inText,
+	uint32			inUnits)
+{
+	uint32 n = 0;
+
+#if defined(__SSE2__)
+	// a unit is ASCII when only the low seven bits are set, the
+	// lanes are loaded little endian so swap the mask for BE text
+	const __m128i mask = _mm_set1_epi16(BIGENDIAN ? 0x080FF : 0x0FF80);
+	const __m128i zero = _mm_setzero_si128();
+
+	while (n + 8 <= inUnits)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inText + 2 * n));
+		int ascii = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, mask), zero));
+		if (ascii != 0x0ffff)
+			return n + __builtin_ctz(~ascii) / 2;
+		n += 8;
+	}
+#endif
+
+	while (n < inUnits and ReadUTF16Unit<BIGENDIAN>(inText + 2 * n) < 0x080)
+		++n;
+	
+	return n;
+}
+
+// narrow inUnits ASCII UTF-16 units to bytes
+template<bool BIGENDIAN>
+void NarrowUTF16(
+	const char*		inText,
+	uint32			inUnits,
+	char*			outText)
+{
+	uint32 n = 0;
+
+#if defined(__SSE2__)
+	while (n + 8 <= inUnits)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inText + 2 * n));
+		if (BIGENDIAN)
+			v = _mm_srli_epi16(v, 8);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(outText + n), _mm_packus_epi16(v, v));
+		n += 8;
+	}
+#endif
+
+	for (; n < inUnits; ++n)
+		outText[n] = static_cast<char>(ReadUTF16Unit<BIGENDIAN>(inText + 2 * n));
+}
+
+// widen inLength ASCII bytes to UTF-16 units
+template<bool BIGENDIAN>
+void WidenToUTF16(
+	const char*		inText,
+	uint32			inLength,
+	char*			outText)
+{
+	uint32 n = 0;
+
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+
+	while (n + 16 <= inLength)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inText + n));
+		__m128i lo, hi;
+		
+		if (BIGENDIAN)
+		{
+			lo = _mm_unpacklo_epi8(zero, v);
+			hi = _mm_unpackhi_epi8(zero, v);
+		}
+		else
+		{
+			lo = _mm_unpacklo_epi8(v, zero);
+			hi = _mm_unpackhi_epi8(v, zero);
+		}
+		
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(outText + 2 * n), lo);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(outText + 2 * n + 16), hi);
+		n += 16;
+	}
+#endif
+
+	for (; n < inLength; ++n)
+	{
+		outText[2 * n + (BIGENDIAN ? 0 : 1)] = 0;
+		outText[2 * n + (BIGENDIAN ? 1 : 0)] = inText[n];
+	}
+}
+
+// MBulkTraits tell how runs of ASCII are found and copied for an encoding,
+// the default is to not use runs at all.
+
+template<MEncoding ENCODING>
+struct MBulkTraits
+{
+	static uint32	AsciiRun(const char* inText, uint32 inLength)
+						{ return 0; }
+
+	static void		NarrowAscii(const char* inText, uint32 inLength, char* outText)
+						{ }
+
+	static void		WidenAscii(const char* inText, uint32 inLength, char*& outText)
+						{
+							for (uint32 i = 0; i < inLength; ++i)
+								MEncodingTraits<ENCODING>::WriteUnicode(outText, static_cast<wchar_t>(inText[i]));
+						}
+};
+
+template<MEncoding ENCODING>
+struct MSingleByteBulkTraits
+{
+	static uint32	AsciiRun(const char* inText, uint32 inLength)
+						{ return AsciiPrefixLength(inText, inLength); }
+
+	static void		NarrowAscii(const char* inText, uint32 inLength, char* outText)
+						{ memcpy(outText, inText, inLength); }
+
+	static void		WidenAscii(const char* inText, uint32 inLength, char*& outText)
+						{
+							memcpy(outText, inText, inLength);
+							outText += inLength;
+						}
+};
+
+template<> struct MBulkTraits<kEncodingUTF8> : public MSingleByteBulkTraits<kEncodingUTF8> {};
+template<> struct MBulkTraits<kEncodingISO88591> : public MSingleByteBulkTraits<kEncodingISO88591> {};
+template<> struct MBulkTraits<kEncodingMacOSRoman> : public MSingleByteBulkTraits<kEncodingMacOSRoman> {};
+
+template<bool BIGENDIAN>
+struct MUTF16BulkTraits
+{
+	static uint32	AsciiRun(const char* inText, uint32 inLength)
+						{ return 2 * UTF16AsciiPrefixLength<BIGENDIAN>(inText, inLength / 2); }
+
+	static void		NarrowAscii(const char* inText, uint32 inLength, char* outText)
+						{ NarrowUTF16<BIGENDIAN>(inText, inLength / 2, outText); }
+
+	static void		WidenAscii(const char* inText, uint32 inLength, char*& outText)
+						{
+							WidenToUTF16<BIGENDIAN>(inText, inLength, outText);
+							outText += 2 * inLength;
+						}
+};
+
+template<> struct MBulkTraits<kEncodingUTF16BE> : public MUTF16BulkTraits<true> {};
+template<> struct MBulkTraits<kEncodingUTF16LE> : public MUTF16BulkTraits<false> {};
+
+// read one character, the traits may read past the end of a
+// character so near the end of the text a padded copy is used
+template<MEncoding ENCODING>
+inline bool ReadChar(
+	const char*		inText,
+	uint32			inLength,
+	uint32&			outLength,
+	wchar_t&		outUnicode)
+{
+	const uint32 kMaxCharLength = 8;
+
+	if (inLength >= kMaxCharLength)
+		MEncodingTraits<ENCODING>::ReadUnicode(inText, outLength, outUnicode);
+	else
+	{
+		char padded[kMaxCharLength] = {};
+		memcpy(padded, inText, inLength);
+		MEncodingTraits<ENCODING>::ReadUnicode(padded, outLength, outUnicode);
+	}
+	
+	return outLength > 0 and outLength <= inLength;
+}
+
+inline uint32 UTF8Length(
+	wchar_t			inUnicode)
+{
+	uint32 result;
+	if (inUnicode < 0x080)
+		result = 1;
+	else if (inUnicode < 0x0800)
+		result = 2;
+	else if (inUnicode < 0x010000)
+		result = 3;
+	else
+		result = 4;
+	return result;
+}
+
+template<MEncoding ENCODING>
+uint32 GetUTF8Length(
+	const char*		inText,
+	uint32			inLength)
+{
+	uint32 result = 0, i = 0;
+	
+	while (i < inLength)
+	{
+		uint32 n = MBulkTraits<ENCODING>::AsciiRun(inText + i, inLength - i);
+		if (n > 0)
+		{
+			result += ENCODING == kEncodingUTF16BE or ENCODING == kEncodingUTF16LE ? n / 2 : n;
+			i += n;
+			continue;
+		}
+
+		uint32 l;
+		wchar_t uc;
+		if (not ReadChar<ENCODING>(inText + i, inLength - i, l, uc))
+			break;
+		
+		result += UTF8Length(uc);
+		i += l;
+	}
+	
+	return result;
+}
+
+template<MEncoding ENCODING>
+uint32 ConvertToUTF8(
+	const char*		inText,
+	uint32			inLength,
+	char*			outText)
+{
+	char* out = outText;
+	uint32 i = 0;
+	
+	while (i < inLength)
+	{
+		uint32 n = MBulkTraits<ENCODING>::AsciiRun(inText + i, inLength - i);
+		if (n > 0)
+		{
+			MBulkTraits<ENCODING>::NarrowAscii(inText + i, n, out);
+			out += ENCODING == kEncodingUTF16BE or ENCODING == kEncodingUTF16LE ? n / 2 : n;
+			i += n;
+			continue;
+		}
+
+		uint32 l;
+		wchar_t uc;
+		if (not ReadChar<ENCODING>(inText + i, inLength - i, l, uc))
+			break;
+		
+		MEncodingTraits<kEncodingUTF8>::WriteUnicode(out, uc);
+		i += l;
+	}
+	
+	return out - outText;
+}
+
+template<MEncoding ENCODING>
+uint32 ConvertFromUTF8(
+	const char*		inText,
+	uint32			inLength,
+	char*			outText)
+{
+	char* out = outText;
+	uint32 i = 0;
+	
+	while (i < inLength)
+	{
+		uint32 n = AsciiPrefixLength(inText + i, inLength - i);
+		if (n > 0)
+		{
+			MBulkTraits<ENCODING>::WidenAscii(inText + i, n, out);
+			i += n;
+			continue;
+		}
+
+		uint32 l;
+		wchar_t uc;
+		if (not ReadChar<kEncodingUTF8>(inText + i, inLength - i, l, uc))
+			break;
+		
+		MEncodingTraits<ENCODING>::WriteUnicode(out, uc);
+		i += l;
+	}
+	
+	return out - outText;
+}
+
+}
+
+bool IsValidUTF8(
+	const char*		inText,
+	uint32			inLength)
+{
+	bool result = true;
+	uint32 i = 0;
+	
+	while (result and i < inLength)
+	{
+		i += AsciiPrefixLength(inText + i, inLength - i);
+		if (i == inLength)
+			break;
+
+		unsigned char c = static_cast<unsigned char>(inText[i]);
+		uint32 cLen = 0;
+	 
+		if ((c & 0x00E0) == 0x00C0)
+			cLen = 2;
+		else if ((c & 0x00F0) == 0x00E0)
+			cLen = 3;
+		else if ((c & 0x00F8) == 0x00F0)
+			cLen = 4;
+		else if ((c & 0x00FC) == 0x00F8)
+			cLen = 5;
+
+		if (cLen == 0 or i + cLen > inLength)
+			result = false;
+		else
+		{
+			for (uint32 j = 1; j < cLen and result; ++j)
+			{
+				if ((inText[i + j] & 0x00C0) != 0x0080)
+					result = false;
+			}
+			
+			i += cLen;
+		}
+	}
+	
+	return result;
+}
+
+uint32 GetUTF8Length(
+	MEncoding		inEncoding,
+	const char*		inText,
+	uint32			inLength)
+{
+	uint32 result;
+
+	switch (inEncoding)
+	{
+		case kEncodingUTF8:			result = inLength; break;
+		case kEncodingUTF16BE:		result = GetUTF8Length<kEncodingUTF16BE>(inText, inLength); break;
+		case kEncodingUTF16LE:		result = GetUTF8Length<kEncodingUTF16LE>(inText, inLength); break;
+		case kEncodingUCS2:			result = GetUTF8Length<kEncodingUCS2>(inText, inLength); break;
+		case kEncodingMacOSRoman:	result = GetUTF8Length<kEncodingMacOSRoman>(inText, inLength); break;
+		case kEncodingISO88591:		result = GetUTF8Length<kEncodingISO88591>(inText, inLength); break;
+		default:					THROW(("Unknown encoding"));
+	}
+	
+	return result;
+}
+
+uint32 ConvertToUTF8(
+	MEncoding		inEncoding,
+	const char*		inText,
+	uint32			inLength,
+	char*			outText)
+{
+	uint32 result;
+
+	switch (inEncoding)
+	{
+		case kEncodingUTF8:
+			memcpy(outText, inText, inLength);
+			result = inLength;
+			break;
+
+		case kEncodingUTF16BE:		result = ConvertToUTF8<kEncodingUTF16BE>(inText, inLength, outText); break;
+		case kEncodingUTF16LE:		result = ConvertToUTF8<kEncodingUTF16LE>(inText, inLength, outText); break;
+		case kEncodingUCS2:			result = ConvertToUTF8<kEncodingUCS2>(inText, inLength, outText); break;
+		case kEncodingMacOSRoman:	result = ConvertToUTF8<kEncodingMacOSRoman>(inText, inLength, outText); break;
+		case kEncodingISO88591:		result = ConvertToUTF8<kEncodingISO88591>(inText, inLength, outText); break;
+		default:					THROW(("Unknown encoding"));
+	}
+	
+	return result;
+}
+
+uint32 ConvertFromUTF8(
+	MEncoding		inEncoding,
+	const char*		inText,
+	uint32			inLength,
+	char*			outText)
+{
+	uint32 result;
+
+	switch (inEncoding)
+	{
+		case kEncodingUTF8:
+			memcpy(outText, inText, inLength);
+			result = inLength;
+			break;
+
+		case kEncodingUTF16BE:		result = ConvertFromUTF8<kEncodingUTF16BE>(inText, inLength, outText); break;
+		case kEncodingUTF16LE:		result = ConvertFromUTF8<kEncodingUTF16LE>(inText, inLength, outText); break;
+		case kEncodingUCS2:			result = ConvertFromUTF8<kEncodingUCS2>(inText, inLength, outText); break;
+		case kEncodingMacOSRoman:	result = ConvertFromUTF8<kEncodingMacOSRoman>(inText, inLength, outText); break;
+		case kEncodingISO88591:		result = ConvertFromUTF8<kEncodingISO88591>(inText, inLength, outText); break;
+		default:					THROW(("Unknown encoding"));
+	}
+	
+	return result;
+}
@@ -121,6 +121,36 @@ wchar_t GetUnicode(MEncoding inEncoding, char inByte);
 char GetChar(MEncoding inEncoding, wchar_t inChar);
 }
 
+// bulk conversion routines, these work on complete blocks of text
+
+bool IsValidUTF8(
+	const char*		inText,
+	uint32			inLength);
+
+// the number of bytes needed to store inText as UTF-8
+uint32 GetUTF8Length(
+	MEncoding		inEncoding,
+	const char*		inText,
+	uint32			inLength);
+
+// outText must be large enough to hold GetUTF8Length bytes,
+// returns the number of bytes written
+uint32 ConvertToUTF8(
+	MEncoding		inEncoding,
+	const char*		inText,
+	uint32			inLength,
+	char*			outText);
+
+// outText must be large enough to hold kMaxEncodedBytesPerUTF8Byte
+// times inLength bytes, returns the number of bytes written
+const uint32 kMaxEncodedBytesPerUTF8Byte = sizeof(wchar_t);
+
+uint32 ConvertFromUTF8(
+	MEncoding		inEncoding,
+	const char*		inText,
+	uint32			inLength,
+	char*			outText);
+
 class MEncoder
 {
   public:
@@ -355,7 +355,7 @@ MEncodingTraits<kEncodingUCS2>::WriteUnicode(
 	wchar_t				inUnicode)
 {
 	char* p = reinterpret_cast<char*>(&inUnicode);
-	std::copy(p, p + sizeof(wchar_t), inText);
+	inText = std::copy(p, p + sizeof(wchar_t), inText);
 	return sizeof(wchar_t);
 }
 
@@ -635,10 +635,16 @@ uint32 MView::GetModifiers() const
 	return modifiers & gtk_accelerator_get_default_mod_mask();
 }
 
-uint32 MView::CountPages(
-	MDevice&		inDevice)
+bool MView::Paginate(
+	MDevice&		inDevice,
+	uint32&			outPages)
+{
+	outPages = 1;
+	return true;
+}
+
+void MView::EndPrint()
 {
-	return 1;
 }
 
 void MView::OnPopupMenu(
@@ -90,9 +90,13 @@ class MView
 
 	uint32			GetModifiers() const;
 
-	// called for printing
-	virtual uint32	CountPages(
-						MDevice&		inDevice);
+	// called for printing, Paginate is called until it returns true,
+	// a page count of zero means the page count is not known yet
+	virtual bool	Paginate(
+						MDevice&		inDevice,
+						uint32&			outPages);
+
+	virtual void	EndPrint();
 
   protected:
 
@@ -6,6 +6,7 @@
 #include "MJapi.h"
 
 #include <iostream>
+#include <map>
 #include <boost/thread.hpp>
 #include <boost/bind.hpp>
 #include <boost/foreach.hpp>
@@ -124,6 +125,49 @@ GtkWidget* MGtkBuilder::GetWidget(
 	return GTK_WIDGET(gtk_builder_get_object(mGtkBuilder, inWidgetName));
 }
 
+// --------------------------------------------------------------------
+//
+//	MGtkBuilderCache
+//
+//	GtkBuilder has to parse the UI definition for each new window, there's
+//	no way to reuse the parsed form. Building one ahead of time is no option
+//	either, GtkBuilder creates the toplevels right away and some of them are
+//	visible. What is kept is the resource lookup, a window resource is only
+//	searched for in the resource index once.
+
+class MGtkBuilderCache
+{
+  public:
+
+	static MGtkBuilder*	Create(
+							const string&	inResource);
+
+  private:
+
+	typedef map<string,mrsrc::rsrc>	MResourceMap;
+
+	static MResourceMap	sResources;
+};
+
+MGtkBuilderCache::MResourceMap MGtkBuilderCache::sResources;
+
+MGtkBuilder* MGtkBuilderCache::Create(
+	const string&		inResource)
+{
+	MResourceMap::iterator r = sResources.find(inResource);
+	if (r == sResources.end())
+	{
+		mrsrc::rsrc rsrc(inResource);
+		
+		if (not rsrc)
+			THROW(("Could not load dialog resource %s", inResource.c_str()));
+		
+		r = sResources.insert(make_pair(inResource, rsrc)).first;
+	}
+
+	return new MGtkBuilder(r->second.data(), r->second.size());
+}
+
 // --------------------------------------------------------------------
 //
 //	MWindow
@@ -173,20 +217,13 @@ MWindow::MWindow(
 	, mChildFocus(this, &MWindow::ChildFocus)
 	, mChanged(this, &MWindow::Changed)
 {
-	mrsrc::rsrc rsrc;
-	
 	if (strcmp(inRootWidgetName, "dialog") == 0)
-		rsrc = mrsrc::rsrc(
+		mGtkBuilder = MGtkBuilderCache::Create(
 			string("Dialogs/") + inWindowResourceName + ".ui");
 	else
-		rsrc = mrsrc::rsrc(
+		mGtkBuilder = MGtkBuilderCache::Create(
 			string("Windows/") + inWindowResourceName + ".ui");
 	
-	if (not rsrc)
-		THROW(("Could not load dialog resource %s", inWindowResourceName));
-
-	mGtkBuilder = new MGtkBuilder(rsrc.data(), rsrc.size());
-	
 	GtkWidget* w = mGtkBuilder->GetWidget(inRootWidgetName);
 	if (w == nil)
 		THROW(("Failed to extract root widget from gtk-builder data (%s)", inRootWidgetName));
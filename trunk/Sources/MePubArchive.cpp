@@ -0,0 +1,488 @@
+//          Copyright Maarten L. Hekkelman 2006-2008
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "MJapi.h"
+
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <algorithm>
+#include <limits>
+#include <zlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/range/iterator_range.hpp>
+#include <boost/iostreams/filtering_streambuf.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/copy.hpp>
+
+#include <cryptopp/aes.h>
+#include <cryptopp/ccm.h>
+#include <cryptopp/filters.h>
+
+#include "MePubArchive.h"
+#include "MError.h"
+
+using namespace std;
+namespace io = boost::iostreams;
+namespace cpp = CryptoPP;
+
+namespace
+{
+
+const uint32
+	kLocalFileHeaderSignature = 0x04034b50UL,
+	kCentralDirectorySignature = 0x02014b50UL,
+	kEndOfCentralDirectorySignature = 0x06054b50UL,
+	kLocalFileHeaderSize = 30,
+	kCentralDirectoryEntrySize = 46,
+	kEndOfCentralDirectorySize = 22,
+	kMaxCommentSize = 65535,
+	kCopyBlockSize = 65536;
+
+inline uint16 read16(
+	const char*		inData)
+{
+	const uint8* p = reinterpret_cast<const uint8*>(inData);
+	return p[0] | (p[1] << 8);
+}
+
+inline uint32 read32(
+	const char*		inData)
+{
+	const uint8* p = reinterpret_cast<const uint8*>(inData);
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32>(p[3]) << 24);
+}
+
+struct MEntryOffsetLess
+{
+	bool	operator()(const MePubArchiveEntry& a, const MePubArchiveEntry& b) const
+				{ return a.offset < b.offset; }
+};
+
+void DecryptFile(
+	string&			ioFile,
+	uint8			inBookKey[16])
+{
+	uint8* iv = reinterpret_cast<uint8*>(const_cast<char*>(ioFile.c_str()));
+	uint8* src = iv + 16;
+
+	cpp::CBC_Mode<cpp::AES>::Decryption dec;
+	dec.SetKeyWithIV(inBookKey, 16, iv);
+
+	string b;
+	cpp::StringSource s(src, ioFile.length() - 16, true,
+		new cpp::StreamTransformationFilter(dec, new cpp::StringSink(b),
+			cpp::StreamTransformationFilter::NO_PADDING));
+
+	io::zlib_params params;
+	params.noheader = true;	// don't read header, i.e. true deflate compression
+	params.calculate_crc = true;
+	io::zlib_decompressor z_stream(params);
+
+	io::filtering_streambuf<io::input> in;
+	in.push(z_stream);
+
+	io::filtering_istream bin(boost::make_iterator_range(b));
+	in.push(bin);
+
+	ioFile.clear();
+	io::filtering_ostream out(io::back_inserter(ioFile));
+	io::copy(in, out);
+}
+
+}
+
+// ---------------------------------------------------------------------------
+//	MePubArchive
+
+MePubArchive::MePubArchive(
+	const fs::path&		inFile)
+	: mFile(inFile)
+	, mFD(-1)
+	, mSize(0)
+	, mHasKey(false)
+{
+	mFD = open(inFile.string().c_str(), O_RDONLY);
+	if (mFD < 0)
+		THROW(("Could not open %s: %s", inFile.string().c_str(), strerror(errno)));
+
+	off_t size = lseek(mFD, 0, SEEK_END);
+	if (size < 0 or size > numeric_limits<uint32>::max())
+	{
+		close(mFD);
+		THROW(("ePub file is too large"));
+	}
+
+	mSize = size;
+
+	try
+	{
+		ReadDirectory();
+	}
+	catch (...)
+	{
+		close(mFD);
+		throw;
+	}
+}
+
+MePubArchive::MePubArchive(
+	istream&			inData)
+	: mFD(-1)
+	, mSize(0)
+	, mHasKey(false)
+{
+	streambuf* b = inData.rdbuf();
+
+	int64 len = b->pubseekoff(0, ios::end);
+	b->pubseekpos(0);
+
+	if (len < 0 or len > numeric_limits<uint32>::max())
+		THROW(("ePub file is too large"));
+
+	mData.resize(len);
+	if (len > 0)
+		b->sgetn(&mData[0], len);
+	mSize = len;
+
+	ReadDirectory();
+}
+
+MePubArchive::~MePubArchive()
+{
+	if (mFD >= 0)
+		close(mFD);
+}
+
+// ---------------------------------------------------------------------------
+//	ReadAt
+
+void MePubArchive::ReadAt(
+	uint32				inOffset,
+	char*				outData,
+	uint32				inSize)
+{
+	if (inOffset > mSize or inSize > mSize - inOffset)
+		THROW(("Invalid ePub file, perhaps it is damaged"));
+
+	if (mFD < 0)
+		memcpy(outData, mData.c_str() + inOffset, inSize);
+	else
+	{
+		while (inSize > 0)
+		{
+			ssize_t r = pread(mFD, outData, inSize, inOffset);
+
+			if (r == 0 or (r < 0 and errno != EINTR))
+				THROW(("Error reading ePub file, perhaps it was changed on disk"));
+
+			if (r > 0)
+			{
+				outData += r;
+				inOffset += r;
+				inSize -= r;
+			}
+		}
+	}
+}
+
+// ---------------------------------------------------------------------------
+//	ReadDirectory
+//
+//	The end of central directory record is the last thing in the archive,
+//	only followed by a comment of at most 64k.
+
+void MePubArchive::ReadDirectory()
+{
+	if (mSize < kEndOfCentralDirectorySize)
+		THROW(("Invalid ePub file"));
+
+	uint32 tailSize = min(mSize, kEndOfCentralDirectorySize + kMaxCommentSize);
+	vector<char> tail(tailSize);
+	ReadAt(mSize - tailSize, &tail[0], tailSize);
+
+	const char* end = nil;
+	for (int32 i = tailSize - kEndOfCentralDirectorySize; i >= 0; --i)
+	{
+		if (read32(&tail[i]) == kEndOfCentralDirectorySignature)
+		{
+			end = &tail[i];
+			break;
+		}
+	}
+
+	if (end == nil)
+		THROW(("Invalid ePub file, perhaps it is damaged"));
+
+	uint16 diskNumber = read16(end + 4);
+	uint16 entries = read16(end + 10);
+	uint32 directorySize = read32(end + 12);
+	uint32 directoryOffset = read32(end + 16);
+
+	if (diskNumber != 0)
+		THROW(("Split ePub archives are not supported"));
+
+	vector<char> directory(directorySize);
+	if (directorySize > 0)
+		ReadAt(directoryOffset, &directory[0], directorySize);
+
+	mEntries.reserve(entries);
+
+	for (uint32 offset = 0; mEntries.size() < entries; )
+	{
+		if (offset + kCentralDirectoryEntrySize > directorySize or
+			read32(&directory[offset]) != kCentralDirectorySignature)
+		{
+			THROW(("Invalid ePub file, perhaps it is damaged"));
+		}
+
+		const char* p = &directory[offset];
+
+		MePubArchiveEntry e;
+		e.method = read16(p + 10);
+		e.crc = read32(p + 16);
+		e.compressed_size = read32(p + 20);
+		e.uncompressed_size = read32(p + 24);
+		e.decrypted_size = 0;
+		e.offset = read32(p + 42);
+		e.data_offset = 0;
+		e.encrypted = false;
+
+		uint16 fileNameLength = read16(p + 28);
+		uint16 extraFieldLength = read16(p + 30);
+		uint16 commentLength = read16(p + 32);
+
+		if (offset + kCentralDirectoryEntrySize + fileNameLength > directorySize)
+			THROW(("Invalid ePub file, perhaps it is damaged"));
+
+		if (e.method != 0 and e.method != 8)
+			THROW(("Unsupported compression method used in ePub file"));
+
+		e.name.assign(p + kCentralDirectoryEntrySize, fileNameLength);
+		mEntries.push_back(e);
+
+		offset += kCentralDirectoryEntrySize + fileNameLength + extraFieldLength + commentLength;
+	}
+
+	stable_sort(mEntries.begin(), mEntries.end(), MEntryOffsetLess());
+}
+
+// ---------------------------------------------------------------------------
+//	GetDataOffset, the local header may have a different extra field
+
+uint32 MePubArchive::GetDataOffset(
+	uint32				inEntry)
+{
+	MePubArchiveEntry& e = mEntries.at(inEntry);
+
+	if (e.data_offset == 0)
+	{
+		char h[kLocalFileHeaderSize];
+		ReadAt(e.offset, h, sizeof(h));
+
+		if (read32(h) != kLocalFileHeaderSignature)
+			THROW(("Invalid ePub file, perhaps it is damaged"));
+
+		e.data_offset = e.offset + kLocalFileHeaderSize + read16(h + 26) + read16(h + 28);
+	}
+
+	return e.data_offset;
+}
+
+// ---------------------------------------------------------------------------
+//	ReadRaw
+
+void MePubArchive::ReadRaw(
+	uint32				inEntry,
+	string&				outData)
+{
+	boost::mutex::scoped_lock lock(mMutex);
+
+	uint32 offset = GetDataOffset(inEntry);
+	const MePubArchiveEntry& e = mEntries[inEntry];
+
+	outData.resize(e.compressed_size);
+	if (e.compressed_size > 0)
+		ReadAt(offset, &outData[0], e.compressed_size);
+}
+
+// ---------------------------------------------------------------------------
+//	Read
+
+void MePubArchive::Read(
+	uint32				inEntry,
+	string&				outData)
+{
+	const MePubArchiveEntry& e = mEntries.at(inEntry);
+
+	if (e.method == 0)
+		ReadRaw(inEntry, outData);
+	else
+	{
+		string raw;
+		ReadRaw(inEntry, raw);
+
+		outData.resize(e.uncompressed_size);
+
+		z_stream z = {};
+		if (inflateInit2(&z, -MAX_WBITS) != Z_OK)
+			THROW(("Error initializing zlib"));
+
+		z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(raw.c_str()));
+		z.avail_in = raw.length();
+		z.next_out = reinterpret_cast<Bytef*>(outData.empty() ? nil : &outData[0]);
+		z.avail_out = outData.length();
+
+		int err = inflate(&z, Z_FINISH);
+		uint32 size = z.total_out;
+		inflateEnd(&z);
+
+		if (err != Z_STREAM_END or size != e.uncompressed_size)
+			THROW(("ePub data, uncompressed data is wrong size"));
+	}
+
+	if (crc32(0, reinterpret_cast<const Bytef*>(outData.c_str()), outData.length()) != e.crc)
+		THROW(("ePub data, bad crc"));
+
+	if (e.encrypted and mHasKey)
+	{
+		DecryptFile(outData, mKey);
+
+		boost::mutex::scoped_lock lock(mMutex);
+		mEntries[inEntry].decrypted_size = outData.length();
+	}
+}
+
+// ---------------------------------------------------------------------------
+//	GetDataSize
+//
+//	Encrypted entries are deflated before they are encrypted, the size of
+//	the decrypted data is only known after decrypting it once.
+
+uint32 MePubArchive::GetDataSize(
+	uint32				inEntry)
+{
+	uint32 result;
+
+	{
+		boost::mutex::scoped_lock lock(mMutex);
+
+		const MePubArchiveEntry& e = mEntries.at(inEntry);
+		
+		if (not (e.encrypted and mHasKey))
+			return e.uncompressed_size;
+		
+		result = e.decrypted_size;
+	}
+	
+	if (result == 0)
+	{
+		string data;
+		Read(inEntry, data);
+		result = data.length();
+	}
+	
+	return result;
+}
+
+// ---------------------------------------------------------------------------
+//	SetKey
+
+void MePubArchive::SetKey(
+	const uint8			inKey[16])
+{
+	boost::mutex::scoped_lock lock(mMutex);
+
+	memcpy(mKey, inKey, sizeof(mKey));
+	mHasKey = true;
+}
+
+void MePubArchive::SetEncrypted(
+	uint32				inEntry)
+{
+	boost::mutex::scoped_lock lock(mMutex);
+
+	mEntries.at(inEntry).encrypted = true;
+}
+
+// ---------------------------------------------------------------------------
+//	UsesFile
+
+bool MePubArchive::UsesFile(
+	const fs::path&		inFile) const
+{
+	bool result = false;
+	
+	try
+	{
+		result = mFD >= 0 and not mFile.empty() and
+			fs::exists(inFile) and fs::equivalent(mFile, inFile);
+	}
+	catch (...) {}
+	
+	return result;
+}
+
+// ---------------------------------------------------------------------------
+//	Detach
+//
+//	The archive is copied a block at a time to a temporary file, which is
+//	unlinked right away. Entries are read from that copy from then on.
+
+void MePubArchive::Detach()
+{
+	boost::mutex::scoped_lock lock(mMutex);
+
+	if (mFD >= 0 and not mFile.empty())
+	{
+		const char* tmpdir = getenv("TMPDIR");
+		string temp = string(tmpdir != nil ? tmpdir : "/tmp") + "/japi-epub-XXXXXX";
+		vector<char> tempName(temp.begin(), temp.end());
+		tempName.push_back(0);
+		
+		int fd = mkstemp(&tempName[0]);
+		if (fd < 0)
+			THROW(("Could not create a temporary file: %s", strerror(errno)));
+		
+		unlink(&tempName[0]);
+		
+		try
+		{
+			vector<char> block(kCopyBlockSize);
+			
+			for (uint32 offset = 0; offset < mSize; )
+			{
+				uint32 size = min(mSize - offset, kCopyBlockSize);
+				ReadAt(offset, &block[0], size);
+				
+				for (uint32 written = 0; written < size; )
+				{
+					ssize_t r = write(fd, &block[written], size - written);
+					
+					if (r < 0 and errno != EINTR)
+						THROW(("Could not write a temporary file: %s", strerror(errno)));
+					
+					if (r > 0)
+						written += r;
+				}
+				
+				offset += size;
+			}
+		}
+		catch (...)
+		{
+			close(fd);
+			throw;
+		}
+
+		close(mFD);
+		mFD = fd;
+		mFile = fs::path();
+	}
+}
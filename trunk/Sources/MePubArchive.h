@@ -0,0 +1,115 @@
+//          Copyright Maarten L. Hekkelman 2006-2008
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+/*
+	MePubArchive gives access to the files in an ePub (zip) archive using
+	the central directory at the end of the archive. Nothing is inflated
+	until the data of an entry is asked for.
+
+	A local archive stays on disk, it is read with pread from a file that
+	is kept open. Other archives are kept in memory, still compressed.
+	Reading is thread safe, MePubServer reads from its own thread.
+*/
+
+#ifndef MEPUBARCHIVE_H
+#define MEPUBARCHIVE_H
+
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+
+#include "MFile.h"
+
+struct MePubArchiveEntry
+{
+	std::string		name;
+	uint32			offset;				// of the local file header
+	uint32			data_offset;		// zero until the local header was read
+	uint32			compressed_size;
+	uint32			uncompressed_size;
+	uint32			decrypted_size;		// zero until the entry was decrypted
+	uint32			crc;
+	uint16			method;				// 0 is stored, 8 is deflated
+	bool			encrypted;			// decrypt with the book key
+};
+
+class MePubArchive
+{
+  public:
+						// the archive file is kept open
+	explicit			MePubArchive(
+							const fs::path&		inFile);
+
+						// the archive is copied into memory
+	explicit			MePubArchive(
+							std::istream&		inData);
+
+						~MePubArchive();
+
+	// entries are in the order they are stored in the archive
+	uint32				GetCount() const					{ return mEntries.size(); }
+
+	const MePubArchiveEntry&
+						GetEntry(
+							uint32				inEntry) const	{ return mEntries.at(inEntry); }
+
+	// the uncompressed, and decrypted if needed, data of an entry
+	void				Read(
+							uint32				inEntry,
+							std::string&		outData);
+
+	// the size of what Read returns, decrypts the entry if needed
+	uint32				GetDataSize(
+							uint32				inEntry);
+
+	// the data as it is stored in the archive
+	void				ReadRaw(
+							uint32				inEntry,
+							std::string&		outData);
+
+	// false for entries that are decrypted when read
+	bool				CanCopyRaw(
+							uint32				inEntry) const	{ return not (mEntries.at(inEntry).encrypted and mHasKey); }
+
+	void				SetKey(
+							const uint8			inKey[16]);
+
+	void				SetEncrypted(
+							uint32				inEntry);
+
+	// true if the archive is still read from inFile
+	bool				UsesFile(
+							const fs::path&		inFile) const;
+
+	// copy the archive to a temporary file and close the original,
+	// needed before the file it was read from is overwritten
+	void				Detach();
+
+  private:
+						MePubArchive(const MePubArchive&);
+	MePubArchive&		operator=(const MePubArchive&);
+
+	void				ReadDirectory();
+
+	uint32				GetDataOffset(
+							uint32				inEntry);
+
+	void				ReadAt(
+							uint32				inOffset,
+							char*				outData,
+							uint32				inSize);
+
+	fs::path			mFile;
+	int					mFD;
+	std::string			mData;
+	uint32				mSize;
+	std::vector<MePubArchiveEntry>
+						mEntries;
+	uint8				mKey[16];
+	bool				mHasKey;
+	boost::mutex		mMutex;
+};
+
+#endif
@@ -30,6 +30,8 @@
 #include "boost/archive/iterators/transform_width.hpp"
 
 #include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
 
 #include <boost/uuid/uuid_generators.hpp>
 #include <boost/uuid/uuid_io.hpp>
@@ -47,6 +49,8 @@
 #include "MePubDocument.h"
 #include "MePubItem.h"
 #include "MePubContentFile.h"
+#include "MePubArchive.h"
+#include "MePubServer.h"
 #include "MTextBuffer.h"
 #include "MFile.h"
 #include "MResources.h"
@@ -72,9 +76,6 @@ namespace cpp = CryptoPP;
 
 namespace {
 	
-const uint32
-	kZipLengthAtEndMask	= 8;
-
 const char
 	kEPubMimeType[] = "application/epub+zip",
 	kMagicMT[] = "mimetypeapplication/epub+zip",
@@ -141,28 +142,6 @@ inline char* write(uint32 value, char* buffer)
 	return buffer;
 }
 
-inline char* read(uint16& value, char* buffer)
-{
-	char* p = buffer + sizeof(value);
-	
-	value <<= 8; value |= static_cast<uint8>(*--p);
-	value <<= 8; value |= static_cast<uint8>(*--p);
-	
-	return buffer + sizeof(value);
-}
-
-inline char* read(uint32& value, char* buffer)
-{
-	char* p = buffer + sizeof(value);
-
-	value <<= 8; value |= static_cast<uint8>(*--p);
-	value <<= 8; value |= static_cast<uint8>(*--p);
-	value <<= 8; value |= static_cast<uint8>(*--p);
-	value <<= 8; value |= static_cast<uint8>(*--p);
-
-	return buffer + sizeof(value);
-}
-
 const uint32
 	kLocalFileHeaderSignature = 0x04034b50UL,
 	kCentralDirectorySignature = 0x02014b50,
@@ -212,132 +191,6 @@ uint32 write_next_file(ostream& lhs, ZIPLocalFileHeader& rhs)
 	return result;
 }
 
-bool read_next_file(istream& s, ZIPLocalFileHeader& fh)
-{
-	char b[30];
-	
-	s.read(b, 4);
-
-	if (b[0] != 'P' or b[1] != 'K')
-		THROW(("Invalid ePub file"));
-	
-	if (b[2] == '0' and b[3] == '0')			// split
-		THROW(("Split ePub archives are not supported"));
-	
-	if ((b[2] == '\001' and b[3] == '\002') or	// central directory
-		(b[2] == '\005' and b[3] == '\006'))	// end of archive record
-	{
-		return false;
-	}
-
-	// now it must be a regular file entry, otherwise we bail out
-	if (not (b[2] == '\003' and b[3] == '\004'))
-		THROW(("Invalid ePub file, perhaps it is damaged"));
-
-	s.read(b + 4, sizeof(b) - 4);
-
-	uint16 versionNeededToExtract, bitFlag, compressionMethod, fileNameLength, extraFieldLength;
-	
-	char* p = read(versionNeededToExtract, b + 4);
-	p = read(bitFlag, p);
-	p = read(compressionMethod, p);
-	p = read(fh.file_mod_time, p);
-	p = read(fh.file_mod_date, p);
-	p = read(fh.crc, p);
-	p = read(fh.compressed_size, p);
-	p = read(fh.uncompressed_size, p);
-	p = read(fileNameLength, p);
-	p = read(extraFieldLength, p);
-
-	// sanity checks
-	if (compressionMethod != 0 and compressionMethod != 8)
-		THROW(("Unsupported compression method used in ePub file"));
-
-	assert(p == b + sizeof(b));
-	
-	// read file name
-	
-	vector<char> fn(fileNameLength);
-	s.read(&fn[0], fileNameLength);
-	fh.filename.assign(&fn[0], fileNameLength);	
-	
-	// skip over the extra data
-	s.seekg(extraFieldLength, ios::cur);
-	
-	// OK, now read in the data and inflate if required
-	fh.data.clear();
-
-	// save the offset in the stream to be able to seek back if needed
-	std::streamsize offset = s.tellg();
-	
-	if (compressionMethod == 0) // no compression
-	{
-		if (fh.compressed_size > 0)
-		{
-			vector<char> b(fh.compressed_size);
-			s.read(&b[0], fh.compressed_size);
-			
-			fh.data.assign(&b[0], fh.compressed_size);
-		}
-	}
-	else	 // inflate
-	{
-		if (fh.compressed_size == 0 and not (bitFlag & kZipLengthAtEndMask))
-			THROW(("Invalid ePub file, missing compressed size"));
-		
-		// setup a boost::iostreams pair to read the compressed data
-		io::zlib_params params;
-		params.noheader = true;	// don't read header, i.e. true deflate compression
-		params.calculate_crc = true;
-		
-		io::zlib_decompressor z_stream(params);
-		
-		io::filtering_streambuf<io::input> in;
-		in.push(z_stream);
-		in.push(s);
-		
-		io::filtering_ostream out(io::back_inserter(fh.data));
-		io::copy(in, out);
-		
-		s.seekg(offset + z_stream.filter().total_in(), ios::beg);
-		
-		// now read the trailing length if needed
-		
-		if (bitFlag & kZipLengthAtEndMask)
-		{
-			char b2[16];
-			s.read(b2, sizeof(b2));
-
-			uint32 signature;
-			char* p = read(signature, b2);
-			
-			if (signature == 0x08074b50UL)
-				p = read(fh.crc, p);
-			else
-			{
-				fh.crc = signature;
-				s.seekg(-4, ios::cur);
-			}
-			
-			p = read(fh.compressed_size, p);
-			p = read(fh.uncompressed_size, p);
-		}
-		
-		// OK, so decompression succeeded, now validate the data
-
-//		if (compressed_size != fh.compressed_size)
-//			THROW(("ePub data, compressed data is wrong size"));
-
-		if (static_cast<uint32>(z_stream.total_out()) != fh.uncompressed_size)
-			THROW(("ePub data, uncompressed data is wrong size"));
-		
-		if (z_stream.crc() != fh.crc)
-			THROW(("ePub data, bad crc"));
-	}
-	
-	return true;
-}
-
 uint32 write_central_directory(ostream& lhs, ZIPCentralDirectory& rhs)
 {
 	char b[46];
@@ -442,6 +295,58 @@ void deflate(
 	deflate(s.str(), outFileHeader);
 }
 
+// deflates the items that have no compressed data anymore, the
+// queue is shared by a couple of threads
+
+struct MDeflateQueue
+{
+						MDeflateQueue(
+							vector<MePubItem*>&	inItems,
+							vector<ZIPLocalFileHeader>&
+												inHeaders)
+							: items(inItems)
+							, headers(inHeaders)
+							, next(0) {}
+	
+	void				Run();
+
+	vector<MePubItem*>&	items;
+	vector<ZIPLocalFileHeader>&
+						headers;
+	vector<uint32>		todo;
+	uint32				next;
+	string				error;
+	boost::mutex		mutex;
+};
+
+void MDeflateQueue::Run()
+{
+	for (;;)
+	{
+		uint32 ix;
+		
+		{
+			boost::mutex::scoped_lock lock(mutex);
+
+			if (next == todo.size() or not error.empty())
+				break;
+			
+			ix = todo[next++];
+		}
+		
+		try
+		{
+			deflate(items[ix]->GetData(), headers[ix]);
+		}
+		catch (exception& e)
+		{
+			boost::mutex::scoped_lock lock(mutex);
+			if (error.empty())
+				error = e.what();
+		}
+	}
+}
+
 void DecryptBookKey(
 	const string&	inBase64Key,
 	uint8			outBookKey[16])
@@ -474,37 +379,6 @@ void DecryptBookKey(
 	rsa->Decrypt(rng, &adeptKey[0], 16, outBookKey);
 }
 
-void DecryptFile(
-	string&			ioFile,
-	uint8			inBookKey[16])
-{
-	uint8* iv = reinterpret_cast<uint8*>(const_cast<char*>(ioFile.c_str()));
-	uint8* src = iv + 16;
-	
-	cpp::CBC_Mode<cpp::AES>::Decryption dec;
-	dec.SetKeyWithIV(inBookKey, 16, iv);
-
-	string b;
-	cpp::StringSource s(src, ioFile.length() - 16, true, 
-		new cpp::StreamTransformationFilter(dec, new cpp::StringSink(b),
-			cpp::StreamTransformationFilter::NO_PADDING));
-	
-	io::zlib_params params;
-	params.noheader = true;	// don't read header, i.e. true deflate compression
-	params.calculate_crc = true;
-	io::zlib_decompressor z_stream(params);
-	
-	io::filtering_streambuf<io::input> in;
-	in.push(z_stream);
-	
-	io::filtering_istream bin(boost::make_iterator_range(b));
-	in.push(bin);
-	
-	ioFile.clear();
-	io::filtering_ostream out(io::back_inserter(ioFile));
-	io::copy(in, out);
-}
-
 string ISODate()
 {
 	time_t now = time(nil);
@@ -554,6 +428,25 @@ MePubDocument::MePubDocument()
 
 MePubDocument::~MePubDocument()
 {
+	try
+	{
+		MePubServer::Instance().RemoveDocument(this);
+	}
+	catch (...) {}
+}
+
+// ---------------------------------------------------------------------------
+//	DoSave
+//
+//	Items that were not changed are still read from the original file,
+//	that file must not be overwritten while we're reading from it.
+
+bool MePubDocument::DoSave()
+{
+	if (mArchive and mFile.IsLocal() and mArchive->UsesFile(mFile.GetPath()))
+		mArchive->Detach();
+	
+	return MDocument::DoSave();
 }
 
 MePubDocument* MePubDocument::GetFirstEPubDocument()
@@ -722,37 +615,57 @@ void MePubDocument::ImportOEB(
 	}
 }
 
+// ---------------------------------------------------------------------------
+//	ReadFile
+//
+//	Only the central directory and the meta data files are read here, the
+//	items keep a reference to the archive and are inflated when needed.
+
 void MePubDocument::ReadFile(
 	std::istream&		inFile)
 {
-	ZIPLocalFileHeader fh;
+	if (mFile.IsLocal())
+		mArchive.reset(new MePubArchive(mFile.GetPath()));
+	else
+		mArchive.reset(new MePubArchive(inFile));
 	
 	MMessageList problems;
 	set<fs::path> encrypted;
 	
 	// read first file, should be the mimetype file
-	map<fs::path,string> content;
+	map<fs::path,uint32> content;
 	bool keyDecrypted = false, hasMimeType = false, firstItem = true;
 	
-	while (read_next_file(inFile, fh))
+	for (uint32 entry = 0; entry < mArchive->GetCount(); ++entry)
 	{
-		if (fh.filename == "mimetype" and ba::starts_with(fh.data, "application/epub+zip"))
+		const MePubArchiveEntry& fh = mArchive->GetEntry(entry);
+		string data;
+		
+		if (fh.name == "mimetype")
 		{
-			hasMimeType = true;
-			if (not firstItem)
-				problems.AddMessage(kMsgKindError, MFile(), 0, 0, 0, _("Invalid ePub file, mimetype should be first file"));
-			firstItem = false;
-			continue;
+			mArchive->Read(entry, data);
+			
+			if (ba::starts_with(data, "application/epub+zip"))
+			{
+				hasMimeType = true;
+				if (not firstItem)
+					problems.AddMessage(kMsgKindError, MFile(), 0, 0, 0, _("Invalid ePub file, mimetype should be first file"));
+				firstItem = false;
+				continue;
+			}
 		}
 		
-		if (ba::ends_with(fh.filename, "/") or fh.uncompressed_size == 0)
+		firstItem = false;
+		
+		if (ba::ends_with(fh.name, "/") or fh.uncompressed_size == 0)
 			continue;
 		
-		fs::path path(fh.filename);
+		fs::path path(fh.name);
 
 		if (path == "META-INF/container.xml")
 		{
-			xml::document container(fh.data);
+			mArchive->Read(entry, data);
+			xml::document container(data);
 			xml::element* root = container.child();
 			
 			if (root->name() != "container" or root->ns() != kContainerNS)
@@ -773,7 +686,8 @@ void MePubDocument::ReadFile(
 		}
 		else if (path == "META-INF/encryption.xml")
 		{
-			xml::document encryption(fh.data);
+			mArchive->Read(entry, data);
+			xml::document encryption(data);
 			xml::element* root = encryption.child();
 			
 			if (root->name() != "encryption" or root->ns() != kContainerNS)
@@ -798,7 +712,8 @@ void MePubDocument::ReadFile(
 		}
 		else if (path == "META-INF/rights.xml")
 		{
-			xml::document rights(fh.data);
+			mArchive->Read(entry, data);
+			xml::document rights(data);
 			xml::element* root = rights.child();
 			
 			if (root->name() != "rights" or root->ns() != kAdobeAdeptNS)
@@ -833,23 +748,29 @@ void MePubDocument::ReadFile(
 			}
 		}
 		else
-			content[path] = fh.data;
+			content[path] = entry;
 	}
 
 	if (not hasMimeType)
 		problems.AddMessage(kMsgKindError, MFile(), 0, 0, 0, _("Invalid ePub file, mimetype file is missing"));
 
-	xml::document opf(content[mRootFile]);
+	string opfData;
+	if (content.count(mRootFile))
+		mArchive->Read(content[mRootFile], opfData);
+	
+	xml::document opf(opfData);
 	
 	ParseOPF(mRootFile.parent_path(), opf.child(), problems);
 	
-	// decrypt all the files, if we can
+	// the files will be decrypted when they're read, if we can
 	if (keyDecrypted and not encrypted.empty())
 	{
-		for (map<fs::path,string>::iterator item = content.begin(); item != content.end(); ++item)
+		mArchive->SetKey(mKey);
+		
+		for (map<fs::path,uint32>::iterator item = content.begin(); item != content.end(); ++item)
 		{
 			if (encrypted.count(item->first))
-				DecryptFile(item->second, mKey);
+				mArchive->SetEncrypted(item->second);
 		}
 	}
 	
@@ -859,7 +780,11 @@ void MePubDocument::ReadFile(
 	{
 		try
 		{
-			xml::document ncx(content[mTOCFile]);
+			string ncxData;
+			if (content.count(mTOCFile))
+				mArchive->Read(content[mTOCFile], ncxData);
+			
+			xml::document ncx(ncxData);
 			ParseNCX(ncx.child());
 		}
 		catch (exception& e)
@@ -872,7 +797,7 @@ void MePubDocument::ReadFile(
 	
 	// and now fill in the data for the items we've found
 	
-	for (map<fs::path,string>::iterator item = content.begin(); item != content.end(); ++item)
+	for (map<fs::path,uint32>::iterator item = content.begin(); item != content.end(); ++item)
 	{
 		if (item->first == mRootFile or item->first == mTOCFile)
 			continue;
@@ -897,7 +822,7 @@ void MePubDocument::ReadFile(
 		if (epi == nil)
 			THROW(("Internal error, item is not an ePub item"));
 
-		epi->SetData(item->second);
+		epi->SetData(mArchive, item->second);
 		
 		if (keyDecrypted == false and encrypted.count(item->first))
 			epi->SetEncrypted(true);
@@ -994,22 +919,58 @@ void MePubDocument::WriteFile(
 	cd.file = fh;
 	dir.push_back(cd);
 	
-	// rest of the items
+	// rest of the items. Items that were not changed are copied as they are
+	// stored in the original archive, the others are deflated in parallel
+	
+	vector<MePubItem*> items;
 	
 	for (MProjectGroup::iterator item = mRoot.begin(); item != mRoot.end(); ++item)
 	{
 		MePubItem* file = dynamic_cast<MePubItem*>(&*item);
 		if (file != nil)
-		{
-			fh.filename = file->GetPath().string();
-			
-			deflate(file->GetData(), fh);
+			items.push_back(file);
+	}
+	
+	vector<ZIPLocalFileHeader> headers(items.size());
+	MDeflateQueue queue(items, headers);
+	
+	for (uint32 ix = 0; ix < items.size(); ++ix)
+	{
+		headers[ix].filename = items[ix]->GetPath().string();
+		
+		if (not items[ix]->IsArchived())
+			queue.todo.push_back(ix);
+	}
 	
-			cd.offset = offset;
-			offset += write_next_file(inFile, fh);
-			cd.file = fh;
-			dir.push_back(cd);
+	uint32 threadCount = min<uint32>(max(gConcurrentJobs, 1U), queue.todo.size());
+	
+	boost::thread_group threads;
+	for (uint32 n = 1; n < threadCount; ++n)
+		threads.create_thread(boost::bind(&MDeflateQueue::Run, &queue));
+	
+	queue.Run();
+	threads.join_all();
+	
+	if (not queue.error.empty())
+		THROW(("%s", queue.error.c_str()));
+	
+	for (uint32 ix = 0; ix < items.size(); ++ix)
+	{
+		ZIPLocalFileHeader& h = headers[ix];
+		
+		MePubArchiveEntry entry;
+		if (items[ix]->GetArchivedData(h.data, entry))
+		{
+			h.crc = entry.crc;
+			h.compressed_size = entry.compressed_size;
+			h.uncompressed_size = entry.uncompressed_size;
+			h.deflated = entry.method == 8;
 		}
+	
+		cd.offset = offset;
+		offset += write_next_file(inFile, h);
+		cd.file = h;
+		dir.push_back(cd);
 	}
 	
 	// now write out directory
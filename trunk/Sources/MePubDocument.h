@@ -10,6 +10,7 @@
 #include <set>
 
 #include <boost/array.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include "MDocument.h"
 #include "MProjectItem.h"
@@ -19,6 +20,7 @@ class MProjectGroup;
 class MProjectItem;
 class MTextDocument;
 class MMessageList;
+class MePubArchive;
 
 class MePubDocument : public MDocument
 {
@@ -97,6 +99,8 @@ class MePubDocument : public MDocument
 	MFile				GetFileForSrc(
 							const std::string&	inSrc);
 
+	virtual bool		DoSave();
+
 	virtual void		SetModified(
 							bool				inModified);
 
@@ -139,6 +143,8 @@ class MePubDocument : public MDocument
 	MProjectGroup		mRoot, mTOC;
 	std::string			mDocumentID, mDocumentIDScheme;
 	uint8				mKey[16];
+	boost::shared_ptr<MePubArchive>
+						mArchive;
 	std::map<std::string,std::string>
 						mDublinCore;
 };
@@ -7,6 +7,11 @@
 
 #include "MFile.h"
 #include "MePubItem.h"
+#include "MePubArchive.h"
+
+using namespace std;
+
+uint32 MePubItem::sNextVersion = 1;
 
 // ---------------------------------------------------------------------------
 //	MePubItem::MePubItem
@@ -18,7 +23,76 @@ MePubItem::MePubItem(
 	, mIsOutOfDate(false)
 	, mEncrypted(false)
 	, mLinear(false)
+	, mEntry(0)
+	, mVersion(sNextVersion++)
+{
+}
+
+// ---------------------------------------------------------------------------
+//	MePubItem::GetData
+
+string MePubItem::GetData() const
+{
+	string result;
+	
+	if (mArchive)
+		mArchive->Read(mEntry, result);
+	else
+		result = mData;
+	
+	return result;
+}
+
+uint32 MePubItem::GetDataSize() const
+{
+	uint32 result;
+	
+	if (mArchive)
+		result = mArchive->GetDataSize(mEntry);
+	else
+		result = mData.length();
+	
+	return result;
+}
+
+void MePubItem::SetData(
+	const string&		inData)
+{
+	mData = inData;
+	mArchive.reset();
+	mVersion = sNextVersion++;
+}
+
+bool MePubItem::IsArchived() const
+{
+	return mArchive and mArchive->CanCopyRaw(mEntry);
+}
+
+bool MePubItem::GetArchivedData(
+	string&				outData,
+	MePubArchiveEntry&	outEntry) const
+{
+	bool result = false;
+	
+	if (IsArchived())
+	{
+		outEntry = mArchive->GetEntry(mEntry);
+		mArchive->ReadRaw(mEntry, outData);
+		result = true;
+	}
+	
+	return result;
+}
+
+void MePubItem::SetData(
+	boost::shared_ptr<MePubArchive>
+						inArchive,
+	uint32				inEntry)
 {
+	mData.clear();
+	mArchive = inArchive;
+	mEntry = inEntry;
+	mVersion = sNextVersion++;
 }
 
 // ---------------------------------------------------------------------------
@@ -6,8 +6,13 @@
 #ifndef MEPUBITEM_H
 #define MEPUBITEM_H
 
+#include <boost/shared_ptr.hpp>
+
 #include "MProjectItem.h"
 
+class MePubArchive;
+struct MePubArchiveEntry;
+
 class MePubItem : public MProjectItem
 {
   public:
@@ -21,16 +26,33 @@ class MePubItem : public MProjectItem
 
 	fs::path		GetPath() const							{ return mParent->GetGroupPath() / mName; }
 
-	virtual uint32	GetDataSize() const						{ return mData.length(); }
+	virtual uint32	GetDataSize() const;
 
 	std::string		GetID() const							{ return mID; }
 	void			SetID(
 						const std::string&	inID)			{ mID = inID; }
 
-	const std::string&
-					GetData() const							{ return mData; }
+	// data that still lives in the archive is inflated on each call
+	std::string		GetData() const;
+
+	void			SetData(
+						const std::string&	inData);
+
 	void			SetData(
-						const std::string&	inData)			{ mData = inData; }
+						boost::shared_ptr<MePubArchive>
+											inArchive,
+						uint32				inEntry);
+
+	// changes each time the data changes, unique within a session
+	uint32			GetVersion() const						{ return mVersion; }
+
+	// true if the data can be copied from the archive
+	bool			IsArchived() const;
+
+	// the data as it is stored in the archive, if the item was not changed
+	bool			GetArchivedData(
+						std::string&		outData,
+						MePubArchiveEntry&	outEntry) const;
 
 	std::string		GetMediaType() const					{ return mMediaType; }
 	void			SetMediaType(
@@ -50,6 +72,11 @@ class MePubItem : public MProjectItem
 	bool			mIsOutOfDate, mEncrypted, mLinear;
 	std::string		mID;
 	std::string		mData;
+	boost::shared_ptr<MePubArchive>
+					mArchive;
+	uint32			mEntry;
+	uint32			mVersion;
+	static uint32	sNextVersion;
 	std::string		mMediaType;
 };
 
@@ -6,9 +6,12 @@
 #include "MJapi.h"
 
 #include <iostream>
+#include <ctime>
+#include <zlib.h>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem/operations.hpp>
+#include <boost/lexical_cast.hpp>
 
 #include "MePubServer.h"
 #include "MePubDocument.h"
@@ -20,6 +23,83 @@ using namespace zeep;
 namespace ba = boost::algorithm;
 namespace fs = boost::filesystem;
 
+namespace
+{
+
+// compressed responses are kept until they take up this much
+const uint32 kMaxCompressedCacheSize = 32 * 1024 * 1024;
+
+string GetHeader(
+	const http::request&	inRequest,
+	const char*				inName)
+{
+	string result;
+	
+	for (vector<http::header>::const_iterator h = inRequest.headers.begin(); h != inRequest.headers.end(); ++h)
+	{
+		if (ba::iequals(h->name, inName))
+		{
+			result = h->value;
+			break;
+		}
+	}
+	
+	return result;
+}
+
+void SetHeader(
+	http::reply&			inReply,
+	const char*				inName,
+	const string&			inValue)
+{
+	for (vector<http::header>::iterator h = inReply.headers.begin(); h != inReply.headers.end(); ++h)
+	{
+		if (ba::iequals(h->name, inName))
+		{
+			h->value = inValue;
+			return;
+		}
+	}
+	
+	http::header h = { inName, inValue };
+	inReply.headers.push_back(h);
+}
+
+bool IsTextMediaType(
+	const string&			inMediaType)
+{
+	return ba::starts_with(inMediaType, "text/") or
+		ba::ends_with(inMediaType, "+xml") or
+		ba::ends_with(inMediaType, "/xml");
+}
+
+void GZip(
+	const string&			inData,
+	string&					outData)
+{
+	z_stream z = {};
+	
+	// 16 added to the window bits means a gzip header and trailer
+	if (deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		THROW(("Error initializing zlib"));
+	
+	outData.resize(deflateBound(&z, inData.length()) + 32);
+	
+	z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(inData.c_str()));
+	z.avail_in = inData.length();
+	z.next_out = reinterpret_cast<Bytef*>(&outData[0]);
+	z.avail_out = outData.length();
+	
+	int err = deflate(&z, Z_FINISH);
+	outData.resize(z.total_out);
+	deflateEnd(&z);
+	
+	if (err != Z_STREAM_END)
+		THROW(("Error compressing data"));
+}
+
+}
+
 MePubServer& MePubServer::Instance()
 {
 	static MePubServer sInstance;
@@ -28,10 +108,124 @@ MePubServer& MePubServer::Instance()
 
 MePubServer::MePubServer()
 	: http::server("0.0.0.0", 9090, 1)
+	, mCompressedSize(0)
+	// item versions start over each session, the ETags should not
+	, mSessionTag(boost::lexical_cast<string>(time(nil)))
 	, mServerThread(boost::bind(&MePubServer::run, this))
 {
 }
 
+// ---------------------------------------------------------------------------
+//	GetDocument
+//
+//	Document IDs can change while a document is open, an entry in the map
+//	is checked before it is used and the map is rebuilt when needed.
+
+MePubDocument* MePubServer::GetDocument(
+	const string&		inID)
+{
+	boost::mutex::scoped_lock lock(mMutex);
+	
+	MePubDocument* result = nil;
+	
+	MDocumentMap::iterator d = mDocuments.find(inID);
+	if (d != mDocuments.end() and d->second->GetDocumentID() == inID)
+		result = d->second;
+	else
+	{
+		mDocuments.clear();
+		
+		for (MePubDocument* doc = MePubDocument::GetFirstEPubDocument(); doc != nil; doc = doc->GetNextEPubDocument())
+		{
+			string id = doc->GetDocumentID();
+			
+			mDocuments[id] = doc;
+			if (id == inID)
+				result = doc;
+		}
+	}
+	
+	return result;
+}
+
+void MePubServer::RemoveDocument(
+	MePubDocument*		inDocument)
+{
+	boost::mutex::scoped_lock lock(mMutex);
+	
+	for (MDocumentMap::iterator d = mDocuments.begin(); d != mDocuments.end(); )
+	{
+		if (d->second == inDocument)
+			d = mDocuments.erase(d);
+		else
+			++d;
+	}
+}
+
+// ---------------------------------------------------------------------------
+//	ServeItem
+//
+//	Items are sent with an ETag built from their version, the browser can
+//	then ask whether its copy is still valid. Text is sent gzipped when
+//	the browser accepts it.
+
+void MePubServer::ServeItem(
+	const http::request&	req,
+	http::reply&			rep,
+	MePubItem*				inItem)
+{
+	string etag = '"' + mSessionTag + '-' + boost::lexical_cast<string>(inItem->GetVersion()) + '"';
+	
+	string ifNoneMatch = GetHeader(req, "If-None-Match");
+	if (not ifNoneMatch.empty() and (ifNoneMatch == "*" or ifNoneMatch.find(etag) != string::npos))
+	{
+		rep = http::reply::stock_reply(http::not_modified);
+		SetHeader(rep, "ETag", etag);
+		log() << "not modified";
+		return;
+	}
+	
+	string mediaType = inItem->GetMediaType();
+	
+	if (IsTextMediaType(mediaType) and GetHeader(req, "Accept-Encoding").find("gzip") != string::npos)
+	{
+		string data;
+		
+		{
+			boost::mutex::scoped_lock lock(mMutex);
+			
+			MCompressedCache::iterator c = mCompressed.find(etag);
+			if (c != mCompressed.end())
+				data = c->second;
+		}
+		
+		if (data.empty())
+		{
+			GZip(inItem->GetData(), data);
+			
+			boost::mutex::scoped_lock lock(mMutex);
+			
+			if (mCompressedSize + data.length() > kMaxCompressedCacheSize)
+			{
+				mCompressed.clear();
+				mCompressedSize = 0;
+			}
+			
+			mCompressed[etag] = data;
+			mCompressedSize += data.length();
+		}
+		
+		rep.set_content(data, mediaType);
+		SetHeader(rep, "Content-Encoding", "gzip");
+		SetHeader(rep, "Vary", "Accept-Encoding");
+	}
+	else
+		rep.set_content(inItem->GetData(), mediaType);
+	
+	SetHeader(rep, "ETag", etag);
+	SetHeader(rep, "Cache-Control", "no-cache");
+}
+
 MePubServer::~MePubServer()
 {
 	stop();
@@ -107,14 +301,7 @@ void MePubServer::handle_request(
 			
 			string docID = *p++;
 			
-			MePubDocument* doc = MePubDocument::GetFirstEPubDocument();
-			while (doc != nil)
-			{
-				if (doc->GetDocumentID() == docID)
-					break;
-				
-				doc = doc->GetNextEPubDocument();
-			}
+			MePubDocument* doc = GetDocument(docID);
 			
 			if (doc != nil)
 			{
@@ -160,9 +347,7 @@ void MePubServer::handle_request(
 				}
 				else if (dynamic_cast<MePubItem*>(item) != nil)
 				{
-					MePubItem* epubItem = static_cast<MePubItem*>(item);
-					
-					rep.set_content(epubItem->GetData(), epubItem->GetMediaType());
+					ServeItem(req, rep, static_cast<MePubItem*>(item));
 				}
 			}
 		}
@@ -6,8 +6,16 @@
 #ifndef MEPUBSERVER_H
 #define MEPUBSERVER_H
 
+#include <map>
+
+#include <boost/unordered_map.hpp>
+#include <boost/thread/mutex.hpp>
+
 #include <zeep/http/server.hpp>
 
+class MePubDocument;
+class MePubItem;
+
 class MePubServer : public zeep::http::server
 {
   public:
@@ -15,6 +23,10 @@ class MePubServer : public zeep::http::server
 	static MePubServer&
 					Instance();
 
+	// called when a document is deleted
+	void			RemoveDocument(
+						MePubDocument*				inDocument);
+
   private:
 					MePubServer();
 					~MePubServer();
@@ -23,7 +35,24 @@ class MePubServer : public zeep::http::server
 						const zeep::http::request&	req,
 						zeep::http::reply&			rep);
 
-	boost::thread	mServerThread;
+	MePubDocument*	GetDocument(
+						const std::string&			inID);
+
+	void			ServeItem(
+						const zeep::http::request&	req,
+						zeep::http::reply&			rep,
+						MePubItem*					inItem);
+
+	typedef boost::unordered_map<std::string,MePubDocument*>	MDocumentMap;
+	typedef std::map<std::string,std::string>					MCompressedCache;
+
+	boost::mutex	mMutex;
+	MDocumentMap	mDocuments;
+	MCompressedCache
+					mCompressed;		// gzipped items, by ETag
+	uint32			mCompressedSize;
+	std::string		mSessionTag;
+	boost::thread	mServerThread;		// last, it uses the members above
 };
 
 #endif
@@ -9,6 +9,7 @@
 #include <string>
 #include <list>
 #include <exception>
+#include <cstring>
 
 /*
 	Resources are data sources for the application.
@@ -25,6 +26,10 @@
 		
 		...
 	}
+
+	Next to the tree of resources there's a hash table containing the full
+	path of each node. A path is looked up there first, the tree is only
+	walked when it is not found, e.g. for paths ending in a slash.
 */
 
 namespace mrsrc {
@@ -36,13 +41,35 @@ namespace mrsrc {
 		unsigned int	m_size;
 		unsigned int	m_data;
 	};
+
+	struct rsrc_hash_imp
+	{
+		unsigned int	m_hash;
+		unsigned int	m_path;		// full path, offset in gResourceName
+		unsigned int	m_node;		// in gResourceIndex, zero for an empty slot
+	};
+
+	// FNV-1a, used by the resource compiler as well
+	inline unsigned int rsrc_hash(
+		const char*		path)
+	{
+		unsigned int h = 2166136261U;
+		while (*path)
+		{
+			h ^= static_cast<unsigned char>(*path++);
+			h *= 16777619U;
+		}
+		return h;
+	}
 }
 
-// The following three variables are generated by the japi resource compiler:
+// The following five variables are generated by the japi resource compiler:
 
-extern const mrsrc::rsrc_imp	gResourceIndex[];
-extern const char				gResourceData[];
-extern const char				gResourceName[];
+extern const mrsrc::rsrc_imp		gResourceIndex[];
+extern const char					gResourceData[];
+extern const char					gResourceName[];
+extern const mrsrc::rsrc_hash_imp	gResourceHash[];
+extern const unsigned int			gResourceHashSize;	// a power of two, or zero
 
 namespace mrsrc
 {
@@ -121,6 +148,22 @@ rsrc::rsrc(
 	
 	m_impl = gResourceIndex;
 	
+	if (gResourceHashSize > 0 and not path.empty())
+	{
+		unsigned int mask = gResourceHashSize - 1;
+		unsigned int h = rsrc_hash(path.c_str());
+		
+		for (unsigned int i = h & mask; gResourceHash[i].m_node != 0; i = (i + 1) & mask)
+		{
+			if (gResourceHash[i].m_hash == h and
+				std::strcmp(gResourceName + gResourceHash[i].m_path, path.c_str()) == 0)
+			{
+				m_impl = gResourceIndex + gResourceHash[i].m_node;
+				return;
+			}
+		}
+	}
+	
 	std::string p(path);
 	
 	// would love to use boost functions here, but then the dependancies